@@ -6,12 +6,23 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
+#include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/merger.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -22,14 +33,21 @@
 //   Actual benchmarks:
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
+//      fillsweep     -- fillrandom with 1, 2, 4, ... --sweep_max_threads writers
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      updaterandom  -- increment N random 8-byte counters with Get() and Put()
+//      mergerandom   -- increment N random 8-byte counters with Merge()
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
+//      mergeseq      -- read N entries merged from --merge_children in-memory
+//                       sorted runs, the way readseq merges level-0 files
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, --multiget_batch_size
+//                       keys per MultiGet() call
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
@@ -64,9 +82,21 @@ static int FLAGS_num = 1000000;
 // Number of read operations to do.  If negative, do FLAGS_num reads.
 static int FLAGS_reads = -1;
 
+// Number of keys looked up by each MultiGet() call of multireadrandom.
+static int FLAGS_multiget_batch_size = 100;
+
+// If true, multireadrandom issues the block reads of each batch together.
+static bool FLAGS_async_io = false;
+
+// Number of sorted runs mergeseq merges, e.g. overlapping level-0 files.
+static int FLAGS_merge_children = 16;
+
 // Number of concurrent threads to run.
 static int FLAGS_threads = 1;
 
+// Largest number of writer threads tried by fillsweep.
+static int FLAGS_sweep_max_threads = 64;
+
 // Size of each value
 static int FLAGS_value_size = 100;
 
@@ -89,6 +119,9 @@ static int FLAGS_max_file_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// Number of threads compressing the data blocks of each table file.
+static int FLAGS_compression_parallel_threads = 1;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
@@ -100,6 +133,21 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Memtable bloom filter bits per key (0 disables the filter).
+static int FLAGS_memtable_bloom_bits = 0;
+
+// Memtable representation: "skiplist", "vector" or "hash_skiplist".
+static const char* FLAGS_memtablerep = "skiplist";
+
+// Length of the key prefix that --memtablerep=hash_skiplist hashes on.
+static int FLAGS_prefix_length = 8;
+
+// Size of the blocks the memtable arena hands out.
+static int FLAGS_arena_block_size = 4 * 1024;
+
+// If true, carve memtable arena blocks from mmap'ed (huge page) regions.
+static bool FLAGS_memtable_use_mmap = false;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -108,6 +156,25 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// Number of obsolete log files to keep around and write new logs over.
+static int FLAGS_recycle_log_file_num = 0;
+
+// If true, write benchmarks other than fillsync skip the log.
+static bool FLAGS_disable_wal = false;
+
+// If true, pipeline the log write and the memtable insertion of
+// consecutive write groups.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, the writers of a write group insert into the memtable in parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Group commit policy (see the Options fields of the same names).
+static int FLAGS_max_write_group_size = leveldb::Options().max_write_group_size;
+static int FLAGS_max_write_group_writers = 0;
+static int FLAGS_write_group_linger_micros = 0;
+static bool FLAGS_merge_sync_writes = false;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -305,12 +372,27 @@ struct ThreadState {
   ThreadState(int index) : tid(index), rand(1000 + index), shared(nullptr) {}
 };
 
+// Return the factory named by --memtablerep, or null for the default.
+static const MemTableRepFactory* NewMemTableRepFactory() {
+  if (strcmp(FLAGS_memtablerep, "skiplist") == 0) {
+    return nullptr;
+  } else if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+    return NewVectorRepFactory();
+  } else if (strcmp(FLAGS_memtablerep, "hash_skiplist") == 0) {
+    return NewHashSkipListRepFactory(FLAGS_prefix_length);
+  }
+  fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+  exit(1);
+}
+
 }  // namespace
 
 class Benchmark {
  private:
   Cache* cache_;
   const FilterPolicy* filter_policy_;
+  const MemTableRepFactory* memtable_factory_;
+  const MergeOperator* merge_operator_;
   DB* db_;
   int num_;
   int value_size_;
@@ -399,6 +481,8 @@ class Benchmark {
         filter_policy_(FLAGS_bloom_bits >= 0
                            ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                            : nullptr),
+        memtable_factory_(NewMemTableRepFactory()),
+        merge_operator_(NewUInt64AddOperator()),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -421,6 +505,8 @@ class Benchmark {
     delete db_;
     delete cache_;
     delete filter_policy_;
+    delete memtable_factory_;
+    delete merge_operator_;
   }
 
   void Run() {
@@ -445,6 +531,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = nullptr;
       bool fresh_db = false;
@@ -464,6 +551,8 @@ class Benchmark {
       } else if (name == Slice("fillrandom")) {
         fresh_db = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillsweep")) {
+        WriteSweep();
       } else if (name == Slice("overwrite")) {
         fresh_db = false;
         method = &Benchmark::WriteRandom;
@@ -471,6 +560,7 @@ class Benchmark {
         fresh_db = true;
         num_ /= 1000;
         write_options_.sync = true;
+        write_options_.disable_wal = false;
         method = &Benchmark::WriteRandom;
       } else if (name == Slice("fill100K")) {
         fresh_db = true;
@@ -479,10 +569,14 @@ class Benchmark {
         method = &Benchmark::WriteRandom;
       } else if (name == Slice("readseq")) {
         method = &Benchmark::ReadSequential;
+      } else if (name == Slice("mergeseq")) {
+        method = &Benchmark::MergeSequential;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -496,6 +590,10 @@ class Benchmark {
         method = &Benchmark::DeleteSeq;
       } else if (name == Slice("deleterandom")) {
         method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("updaterandom")) {
+        method = &Benchmark::UpdateRandom;
+      } else if (name == Slice("mergerandom")) {
+        method = &Benchmark::MergeRandom;
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
@@ -686,9 +784,23 @@ class Benchmark {
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
+    options.compression_parallel_threads = FLAGS_compression_parallel_threads;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.memtable_bloom_bits_per_key = FLAGS_memtable_bloom_bits;
+    options.memtable_factory = memtable_factory_;
+    options.merge_operator = merge_operator_;
+    options.arena_block_size = FLAGS_arena_block_size;
+    options.memtable_use_mmap = FLAGS_memtable_use_mmap;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.max_write_group_size = FLAGS_max_write_group_size;
+    options.max_write_group_writers = FLAGS_max_write_group_writers;
+    options.write_group_linger_micros = FLAGS_write_group_linger_micros;
+    options.merge_sync_writes = FLAGS_merge_sync_writes;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -708,6 +820,27 @@ class Benchmark {
 
   void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
 
+  // fillrandom on a fresh database with a doubling number of writer threads.
+  // The total number of writes stays at FLAGS_num, so the results show how
+  // write throughput scales with concurrent writers.
+  void WriteSweep() {
+    if (FLAGS_use_existing_db) {
+      fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+              "fillsweep");
+      return;
+    }
+    for (int n = 1; n <= FLAGS_sweep_max_threads; n *= 2) {
+      delete db_;
+      db_ = nullptr;
+      DestroyDB(FLAGS_db, Options());
+      Open();
+      num_ = std::max(FLAGS_num / n, 1);
+      char name[100];
+      snprintf(name, sizeof(name), "fillsweep/%d", n);
+      RunBenchmark(n, name, &Benchmark::WriteRandom);
+    }
+  }
+
   void DoWrite(ThreadState* thread, bool seq) {
     if (num_ != FLAGS_num) {
       char msg[100];
@@ -751,6 +884,47 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  void MergeSequential(ThreadState* thread) {
+    // Deal the keys round-robin to the runs, so that every step of the
+    // merge moves to another run, as it does over overlapping files.
+    const int runs = FLAGS_merge_children;
+    Options options;
+    RandomGenerator gen;
+    std::vector<std::string> contents(runs);
+    std::vector<Block*> blocks;
+    std::vector<Iterator*> children;
+    for (int r = 0; r < runs; r++) {
+      BlockBuilder builder(&options);
+      for (int i = r; i < reads_; i += runs) {
+        char key[100];
+        snprintf(key, sizeof(key), "%016d", i);
+        builder.Add(key, gen.Generate(value_size_));
+      }
+      contents[r] = builder.Finish().ToString();
+      BlockContents block_contents;
+      block_contents.data = contents[r];
+      block_contents.cachable = false;
+      block_contents.heap_allocated = false;
+      blocks.push_back(new Block(block_contents));
+      children.push_back(blocks.back()->NewIterator(BytewiseComparator()));
+    }
+    Iterator* iter =
+        NewMergingIterator(BytewiseComparator(), &children[0], runs);
+
+    // Do not count building the runs in stats.
+    thread->stats.Start();
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    for (Block* block : blocks) {
+      delete block;
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
   void ReadReverse(ThreadState* thread) {
     Iterator* iter = db_->NewIterator(ReadOptions());
     int i = 0;
@@ -782,6 +956,77 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    options.async_io = FLAGS_async_io;
+    std::vector<std::string> keys(FLAGS_multiget_batch_size);
+    std::vector<Slice> key_slices(FLAGS_multiget_batch_size);
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    int found = 0;
+    for (int i = 0; i < reads_; i += FLAGS_multiget_batch_size) {
+      const int batch = std::min(FLAGS_multiget_batch_size, reads_ - i);
+      key_slices.resize(batch);
+      for (int j = 0; j < batch; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        keys[j] = key;
+        key_slices[j] = keys[j];
+      }
+      db_->MultiGet(options, key_slices, &values, &statuses);
+      for (int j = 0; j < batch; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Read-modify-write increments of counters, which mergerandom replaces
+  // with a single Merge().
+  void UpdateRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      uint64_t count = 0;
+      if (db_->Get(options, key, &value).ok() && value.size() == 8) {
+        count = DecodeFixed64(value.data());
+      }
+      value.clear();
+      PutFixed64(&value, count + 1);
+      Status s = db_->Put(write_options_, key, value);
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  void MergeRandom(ThreadState* thread) {
+    std::string one;
+    PutFixed64(&one, 1);
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      Status s = db_->Merge(write_options_, key, one);
+      if (!s.ok()) {
+        fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -938,12 +1183,47 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c", &n, &junk) == 1) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--max_write_group_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_write_group_size = n;
+    } else if (sscanf(argv[i], "--max_write_group_writers=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_max_write_group_writers = n;
+    } else if (sscanf(argv[i], "--write_group_linger_micros=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_write_group_linger_micros = n;
+    } else if (sscanf(argv[i], "--merge_sync_writes=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_merge_sync_writes = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
+    } else if (sscanf(argv[i], "--multiget_batch_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_multiget_batch_size = n;
+    } else if (sscanf(argv[i], "--async_io=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_async_io = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
       FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--merge_children=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_merge_children = n;
     } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
       FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--sweep_max_threads=%d%c", &n, &junk) == 1) {
+      FLAGS_sweep_max_threads = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
@@ -952,12 +1232,27 @@ int main(int argc, char** argv) {
       FLAGS_max_file_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--compression_parallel_threads=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_compression_parallel_threads = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--memtable_bloom_bits=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_memtable_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+      FLAGS_memtablerep = argv[i] + 14;
+    } else if (sscanf(argv[i], "--prefix_length=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_length = n;
+    } else if (sscanf(argv[i], "--arena_block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_arena_block_size = n;
+    } else if (sscanf(argv[i], "--memtable_use_mmap=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_memtable_use_mmap = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -0,0 +1,182 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Microbenchmark of the memtable skiplist, with and without the key prefix
+// that nodes keep next to their links.  Entries are encoded like memtable
+// entries, so every full comparison decodes two length-prefixed internal
+// keys.
+//
+//   --num=N       number of entries inserted and looked up
+//   --keys=X      "hex": keys whose first bytes are random (the prefix
+//                 decides most comparisons), "padded": zero-padded decimal
+//                 keys like db_bench's (the first 8 bytes are all equal),
+//                 or "both"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+static int FLAGS_num = 1000000;
+
+static const char* FLAGS_keys = "both";
+
+namespace leveldb {
+
+namespace {
+
+Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = GetVarint32Ptr(data, data + 5, &len);
+  return Slice(p, len);
+}
+
+class EntryComparator {
+ public:
+  explicit EntryComparator(bool use_prefix)
+      : icmp_(BytewiseComparator()), use_prefix_(use_prefix) {}
+
+  int operator()(const char* a, const char* b) const {
+    return icmp_.Compare(GetLengthPrefixedSlice(a), GetLengthPrefixedSlice(b));
+  }
+
+  // Same summary as MemTable's: the first 8 bytes of the user key.
+  uint64_t KeyPrefix(const char* entry) const {
+    if (!use_prefix_) {
+      return 0;
+    }
+    const Slice user_key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+    const size_t n = user_key.size() < 8 ? user_key.size() : 8;
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < n; i++) {
+      prefix |= static_cast<uint64_t>(static_cast<uint8_t>(user_key[i]))
+                << (56 - 8 * i);
+    }
+    return prefix;
+  }
+
+ private:
+  const InternalKeyComparator icmp_;
+  const bool use_prefix_;
+};
+
+typedef SkipList<const char*, EntryComparator> List;
+
+const char* NewEntry(Arena* arena, const std::string& user_key,
+                     SequenceNumber seq) {
+  const size_t internal_size = user_key.size() + 8;
+  char* entry = arena->Allocate(VarintLength(internal_size) + internal_size);
+  char* p = EncodeVarint32(entry, internal_size);
+  memcpy(p, user_key.data(), user_key.size());
+  EncodeFixed64(p + user_key.size(), (seq << 8) | kTypeValue);
+  return entry;
+}
+
+std::vector<std::string> MakeKeys(bool hex) {
+  Random rnd(301);
+  std::vector<std::string> keys;
+  keys.reserve(FLAGS_num);
+  char buf[32];
+  for (int i = 0; i < FLAGS_num; i++) {
+    if (hex) {
+      const uint64_t r = (static_cast<uint64_t>(rnd.Next()) << 32) | rnd.Next();
+      snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(r));
+    } else {
+      snprintf(buf, sizeof(buf), "%016d", rnd.Uniform(FLAGS_num));
+    }
+    keys.push_back(buf);
+  }
+  return keys;
+}
+
+void Report(const char* name, const char* keys, bool use_prefix,
+            uint64_t start_micros) {
+  const uint64_t micros = Env::Default()->NowMicros() - start_micros;
+  fprintf(stdout, "%-7s %-6s %-9s: %8.3f micros/op\n", name, keys,
+          use_prefix ? "prefix" : "no-prefix",
+          static_cast<double>(micros) / FLAGS_num);
+}
+
+void Run(const char* keys_name, const std::vector<std::string>& keys,
+         bool use_prefix) {
+  Arena arena;
+  EntryComparator cmp(use_prefix);
+  List list(cmp, &arena);
+
+  // Encode up front so that only the list operations are timed.
+  std::vector<const char*> entries;
+  entries.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    entries.push_back(NewEntry(&arena, keys[i], i + 1));
+  }
+
+  uint64_t start = Env::Default()->NowMicros();
+  for (const char* entry : entries) {
+    list.Insert(entry);
+  }
+  Report("insert", keys_name, use_prefix, start);
+
+  // Look up every key at a snapshot newer than all entries, like
+  // MemTable::Get() does.
+  std::vector<const char*> targets;
+  targets.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    targets.push_back(NewEntry(&arena, keys[(i * 7919) % keys.size()],
+                               kMaxSequenceNumber));
+  }
+  int found = 0;
+  start = Env::Default()->NowMicros();
+  List::Iterator iter(&list);
+  for (const char* target : targets) {
+    iter.Seek(target);
+    if (iter.Valid()) {
+      found++;
+    }
+  }
+  Report("seek", keys_name, use_prefix, start);
+  if (found != FLAGS_num) {
+    fprintf(stderr, "seek found only %d of %d keys\n", found, FLAGS_num);
+    exit(1);
+  }
+}
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
+      FLAGS_num = n;
+    } else if (strncmp(argv[i], "--keys=", 7) == 0) {
+      FLAGS_keys = argv[i] + 7;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  for (const char* keys_name : {"hex", "padded"}) {
+    if (strcmp(FLAGS_keys, "both") != 0 && strcmp(FLAGS_keys, keys_name) != 0) {
+      continue;
+    }
+    const std::vector<std::string> keys =
+        leveldb::MakeKeys(strcmp(keys_name, "hex") == 0);
+    leveldb::Run(keys_name, keys, false);
+    leveldb::Run(keys_name, keys, true);
+  }
+  return 0;
+}
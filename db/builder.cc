@@ -6,6 +6,7 @@
 
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del_aggregator.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -15,13 +16,19 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -29,15 +36,42 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    meta->smallest.Clear();
+    meta->largest.Clear();
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
     }
 
+    if (range_del_iter != nullptr) {
+      const Comparator* ucmp =
+          static_cast<const InternalKeyComparator*>(options.comparator)
+              ->user_comparator();
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        RangeTombstone tombstone;
+        if (!tombstone.DecodeFrom(range_del_iter->key(),
+                                  range_del_iter->value())) {
+          s = Status::Corruption("corrupted range tombstone key");
+          break;
+        }
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        ExtendBoundsForTombstone(ucmp, tombstone.start, tombstone.end,
+                                 &meta->smallest, &meta->largest);
+        meta->has_range_deletions = true;
+      }
+    }
+
     // Finish and check for builder errors
-    s = builder->Finish();
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
     if (s.ok()) {
       meta->file_size = builder->FileSize();
       assert(meta->file_size > 0);
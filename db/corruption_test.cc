@@ -13,6 +13,8 @@
 #include "leveldb/db.h"
 #include "leveldb/table.h"
 #include "leveldb/write_batch.h"
+#include "table/block.h"
+#include "table/format.h"
 #include "util/logging.h"
 #include "util/testutil.h"
 
@@ -155,6 +157,50 @@ namespace leveldb {
             ASSERT_TRUE(s.ok()) << s.ToString();
         }
 
+        // Return the offset of the block type byte that follows the range
+        // deletion block of the latest table file, or 0 if it has none.
+        uint64_t RangeDelBlockTrailerOffset() {
+            std::vector<std::string> filenames;
+            EXPECT_LEVELDB_OK(env_.target()->GetChildren(dbname_, &filenames));
+            uint64_t number;
+            FileType type;
+            std::string fname;
+            int picked_number = -1;
+            for (size_t i = 0; i < filenames.size(); i++) {
+                if (ParseFileName(filenames[i], &number, &type) && type == kTableFile &&
+                    int(number) > picked_number) {
+                    fname = dbname_ + "/" + filenames[i];
+                    picked_number = number;
+                }
+            }
+            uint64_t file_size;
+            EXPECT_LEVELDB_OK(env_.target()->GetFileSize(fname, &file_size));
+            RandomAccessFile *file;
+            EXPECT_LEVELDB_OK(env_.target()->NewRandomAccessFile(fname, &file));
+
+            char footer_space[Footer::kEncodedLength];
+            Slice footer_input;
+            EXPECT_LEVELDB_OK(file->Read(file_size - Footer::kEncodedLength, Footer::kEncodedLength,
+                                         &footer_input, footer_space));
+            Footer footer;
+            EXPECT_LEVELDB_OK(footer.DecodeFrom(&footer_input));
+            BlockContents contents;
+            EXPECT_LEVELDB_OK(ReadBlock(file, ReadOptions(), footer.metaindex_handle(), &contents));
+            Block meta(contents);
+            Iterator *iter = meta.NewIterator(BytewiseComparator());
+            iter->Seek(kRangeDelBlockName);
+            uint64_t offset = 0;
+            if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+                BlockHandle handle;
+                Slice v = iter->value();
+                EXPECT_LEVELDB_OK(handle.DecodeFrom(&v));
+                offset = handle.offset() + handle.size();
+            }
+            delete iter;
+            delete file;
+            return offset;
+        }
+
         int Property(const std::string &name) {
             std::string property;
             int result;
@@ -341,6 +387,49 @@ namespace leveldb {
         ASSERT_TRUE(!s.ok()) << "write did not fail in corrupted paranoid db";
     }
 
+    TEST_F(CorruptionTest, RangeDeletionBlock) {
+        DBImpl *dbi = reinterpret_cast<DBImpl *>(db_);
+        ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "b", "deleted"));
+        dbi->TEST_CompactMemTable();
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+        ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), "x", "v"));
+        dbi->TEST_CompactMemTable();
+        ASSERT_EQ("0,1,1", [this]() {
+            std::string files;
+            for (int level = 0; level < 3; level++) {
+                if (level > 0) files += ",";
+                files += NumberToString(Property("leveldb.num-files-at-level" + NumberToString(level)));
+            }
+            return files;
+        }());
+
+        // An invalid block type fails the read even without checksums
+        const uint64_t offset = RangeDelBlockTrailerOffset();
+        ASSERT_GT(offset, 0);
+        Corrupt(kTableFile, offset, 1);
+        Reopen();
+
+        // The deleted value must not come back
+        std::string v;
+        Status s = db_->Get(ReadOptions(), "b", &v);
+        ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+        s = db_->Get(ReadOptions(), "b", &v);
+        ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+        Iterator *iter = db_->NewIterator(ReadOptions());
+        iter->SeekToFirst();
+        ASSERT_TRUE(iter->status().IsCorruption()) << iter->status().ToString();
+        delete iter;
+
+        // Nor may a compaction drop the tombstones along with its input
+        dbi = reinterpret_cast<DBImpl *>(db_);
+        dbi->TEST_CompactRange(1, nullptr, nullptr);
+        ASSERT_EQ(1, Property("leveldb.num-files-at-level1"));
+        s = db_->Put(WriteOptions(), "y", "v");
+        ASSERT_TRUE(!s.ok()) << "write did not fail after the compaction error";
+        s = db_->Get(ReadOptions(), "b", &v);
+        ASSERT_TRUE(s.IsCorruption()) << s.ToString();
+    }
+
     TEST_F(CorruptionTest, UnrelatedKeys) {
         Build(10);
         DBImpl *dbi = reinterpret_cast<DBImpl *>(db_);
@@ -9,8 +9,11 @@
 
 #include <algorithm>
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include <test/main_log.h>
@@ -22,6 +25,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_del_aggregator.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -43,15 +48,44 @@ namespace leveldb {
     const std::string TAG = "db_impl.cc";
     const int kNumNonTableCacheFiles = 10;
 
+    namespace {
+
+        // Stored in local_sv_ while the thread uses its cached SuperVersion.
+        char sv_in_use_marker;
+        void *const kSVInUse = &sv_in_use_marker;
+
+    }  // anonymous namespace
+
     // Information kept for every waiting writer
     struct DBImpl::Writer {
-        explicit Writer(port::Mutex *mu) : batch(nullptr), sync(false), done(false), cv(mu) {}
+        // Writer::state values.  A writer waits for a mask of them in AwaitState().
+        enum : uint8_t {
+            kInit = 1,                    // Queued, waiting for a role
+            kGroupLeader = 2,             // Head of the queue: builds and logs the next group
+            kMemTableWriterLeader = 4,    // Pipelined: its group may now be applied to the memtable
+            kParallelMemTableWriter = 8,  // Should insert its own batch into the memtable
+            kParallelInsertsDone = 16,    // Leader only: every follower finished its insert
+            kCompleted = 32,              // Done; status holds the result
+            kLockedWaiting = 64,          // Parked on park_cv
+        };
+
+        Writer()
+                : batch(nullptr), sync(false), disable_wal(false), sequence(0), state(kInit), link_older(nullptr),
+                  link_newer(nullptr), leader(nullptr), mem(nullptr), pending_inserts(0), park_cv(&park_mu) {}
 
         Status status;
         WriteBatch *batch;
         bool sync;
-        bool done;
-        port::CondVar cv;
+        bool disable_wal;
+        SequenceNumber sequence;  // Last sequence of the group led by this writer
+        std::atomic<uint8_t> state;
+        Writer *link_older;       // Writer queued right before this one; read-only once queued
+        Writer *link_newer;       // Filled in lazily by the leader, see CreateMissingNewerLinks()
+        Writer *leader;           // Set together with kParallelMemTableWriter
+        MemTable *mem;            // Set together with kParallelMemTableWriter
+        std::atomic<int> pending_inserts;  // Leader only: inserts of the group still running
+        port::Mutex park_mu;
+        port::CondVar park_cv;
     };
 
     struct DBImpl::CompactionState {
@@ -60,6 +94,7 @@ namespace leveldb {
             uint64_t number;
             uint64_t file_size;
             InternalKey smallest, largest;
+            bool has_range_deletions;
         };
 
         Output *current_output() { return &outputs[outputs.size() - 1]; }
@@ -67,10 +102,14 @@ namespace leveldb {
         explicit CompactionState(Compaction *c)
                 : compaction(c),
                   smallest_snapshot(0),
+                  range_del(nullptr),
+                  has_range_del_lower(false),
                   outfile(nullptr),
                   builder(nullptr),
                   total_bytes(0) {}
 
+        ~CompactionState() { delete range_del; }
+
         Compaction *const compaction;
 
         // Sequence numbers < smallest_snapshot are not significant since we
@@ -79,6 +118,18 @@ namespace leveldb {
         // we can drop all entries for the same key with sequence numbers < S.
         SequenceNumber smallest_snapshot;
 
+        // The range tombstones of the inputs visible to every snapshot, which
+        // delete the older entries they cover.  nullptr if there are none.
+        RangeDelAggregator *range_del;
+
+        // The range tombstones of the inputs that are written to the outputs.
+        // Each output file keeps the part of them from range_del_lower (the
+        // first key of the file, unbounded for the first one) to the first key
+        // of the next output file.
+        std::vector<RangeTombstone> range_tombstones;
+        std::string range_del_lower;
+        bool has_range_del_lower;
+
         std::vector<Output> outputs;
 
         // State kept for output being generated
@@ -110,10 +161,14 @@ namespace leveldb {
         ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
         // 写缓冲区的大小
         ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+        // 内存中 memtable 的最大数量
+        ClipToRange(&result.max_write_buffer_number, 2, 64);
         // 单个文件的最大大小
         ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
         // 每个块的大小
         ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+        ClipToRange(&result.arena_block_size, 1 << 10, 64 << 20);
+        ClipToRange(&result.max_write_group_size, 1 << 10, 1 << 30);
         if (result.info_log == nullptr) {
             // 在与数据库相同的目录中打开一个日志文件
             src.env->CreateDir(dbname);
@@ -126,6 +181,9 @@ namespace leveldb {
                 result.info_log = nullptr;
             }
         }
+        if (result.memtable_factory != nullptr && !result.memtable_factory->IsInsertConcurrentlySupported()) {
+            result.allow_concurrent_memtable_write = false;
+        }
         if (result.block_cache == nullptr) {
             // block_cache 如果用户没有指定，Leveldb 会自己创建一个 8MB 的缓存
             result.block_cache = NewLRUCache(8 << 20);
@@ -157,17 +215,24 @@ namespace leveldb {
             shutting_down_(false),
             background_work_finished_signal_(&mutex_),
             mem_(nullptr),
-            imm_(nullptr),
             has_imm_(false),
             logfile_(nullptr),
             logfile_number_(0),
             log_(nullptr),
+            min_recyclable_log_number_(0),
             seed_(0),
+            super_version_(nullptr),
+            local_sv_(&DBImpl::UnrefLocalSuperVersion),
+            newest_writer_(nullptr),
             tmp_batch_(new WriteBatch),
+            memtable_drained_signal_(&mutex_),
             background_compaction_scheduled_(false),
             manual_compaction_(nullptr),
             // 创建版本控制
-            versions_(new VersionSet(dbname_, &options_, table_cache_, &internal_comparator_)) {}
+            versions_(new VersionSet(dbname_, &options_, table_cache_, &internal_comparator_)),
+            has_bg_error_(false),
+            writes_delayed_(false),
+            write_controller_(env_) {}
 
     DBImpl::~DBImpl() {
         // Wait for background work to finish.
@@ -176,6 +241,19 @@ namespace leveldb {
         while (background_compaction_scheduled_) {
             background_work_finished_signal_.Wait();
         }
+        // 释放各线程缓存的 SuperVersion，之后才能删除版本和内存表
+        std::vector<void *> cached;
+        local_sv_.Scrape(&cached, nullptr);
+        if (super_version_ != nullptr) cached.push_back(super_version_);
+        super_version_ = nullptr;
+        for (void *ptr : cached) {
+            if (ptr == kSVInUse) continue;
+            SuperVersion *sv = reinterpret_cast<SuperVersion *>(ptr);
+            if (sv->Unref()) {
+                sv->Cleanup();
+                delete sv;
+            }
+        }
         mutex_.Unlock();
 
         if (db_lock_ != nullptr) {
@@ -184,7 +262,9 @@ namespace leveldb {
 
         delete versions_;
         if (mem_ != nullptr) mem_->Unref();
-        if (imm_ != nullptr) imm_->Unref();
+        for (const ImmutableMemTable &imm : imm_) {
+            imm.mem->Unref();
+        }
         delete tmp_batch_;
         delete log_;
         delete logfile_;
@@ -296,6 +376,21 @@ namespace leveldb {
                         break;
                 }
 
+                if (!keep && type == kLogFile && min_recyclable_log_number_ != 0 &&
+                    number >= min_recyclable_log_number_) {
+                    // 不删除过时的日志文件，留给之后新建的日志覆盖写入
+                    if (std::find(log_recycle_files_.begin(), log_recycle_files_.end(), number) !=
+                        log_recycle_files_.end()) {
+                        continue;
+                    }
+                    if (log_recycle_files_.size() < options_.recycle_log_file_num) {
+                        log_recycle_files_.push_back(number);
+                        Log(options_.info_log, "Recycle log #%lld\n",
+                            static_cast<unsigned long long>(number));
+                        continue;
+                    }
+                }
+
                 if (!keep) {
                     files_to_delete.push_back(std::move(filename));
                     if (type == kTableFile) {
@@ -317,6 +412,45 @@ namespace leveldb {
         mutex_.Lock();
     }
 
+    MemTable *DBImpl::NewMemTable() const {
+        return new MemTable(internal_comparator_, options_);
+    }
+
+    Status DBImpl::NewLogFile(uint64_t log_number, WritableFile **file, log::Writer **writer) {
+        mutex_.AssertHeld();
+        const std::string fname = LogFileName(dbname_, log_number);
+        Status s;
+        *file = nullptr;
+        if (!log_recycle_files_.empty()) {
+            const std::string old_fname = LogFileName(dbname_, log_recycle_files_.front());
+            log_recycle_files_.pop_front();
+            s = env_->ReuseWritableFile(fname, old_fname, file);
+            if (s.ok()) {
+                Log(options_.info_log, "Reusing log file %s as %s\n", old_fname.c_str(), fname.c_str());
+            } else {
+                // Fall back to a new file; the old one is not needed any more.
+                env_->RemoveFile(old_fname);
+            }
+        }
+        if (*file == nullptr) {
+            s = env_->NewWritableFile(fname, file);
+        }
+        if (!s.ok()) {
+            return s;
+        }
+
+        uint64_t recycle_log_number = 0;
+        if (options_.recycle_log_file_num > 0) {
+            // Only logs written in the recyclable format may be recycled later.
+            if (min_recyclable_log_number_ == 0) {
+                min_recyclable_log_number_ = log_number;
+            }
+            recycle_log_number = log_number;
+        }
+        *writer = new log::Writer(*file, options_.wal_compression, recycle_log_number);
+        return s;
+    }
+
     Status DBImpl::Recover(VersionEdit *edit, bool *save_manifest) {
         mutex_.AssertHeld();
 
@@ -409,6 +543,201 @@ namespace leveldb {
         return Status::OK();
     }
 
+    namespace {
+
+        // Hands the records of a log file being recovered from the reader
+        // thread to the memtable builders, and the built memtables to the
+        // recovering thread, in log order.
+        class LogReplayQueue {
+        public:
+            // Consecutive records of the log.  A builder replays them into
+            // memtables, starting a new one whenever the current one is full.
+            struct Segment {
+                std::vector<std::string> records;
+                std::vector<MemTable *> mems;
+                SequenceNumber max_sequence = 0;
+                Status status;
+                bool built = false;
+            };
+
+            // At most "max_segments" segments are read but not yet released.
+            // Segments start out "write_buffer_size" bytes long.
+            LogReplayQueue(size_t max_segments, size_t write_buffer_size)
+                    : max_segments_(max_segments),
+                      cv_(&mu_),
+                      write_buffer_size_(write_buffer_size),
+                      full_mems_(0),
+                      full_mem_bytes_(0),
+                      reading_done_(false),
+                      stopped_(false),
+                      running_threads_(0) {}
+
+            LogReplayQueue(const LogReplayQueue &) = delete;
+
+            LogReplayQueue &operator=(const LogReplayQueue &) = delete;
+
+            ~LogReplayQueue() {
+                assert(running_threads_ == 0);
+                for (Segment *segment : segments_) {
+                    Release(segment);
+                }
+            }
+
+            // Run "function" on a new thread of "env".  WaitForThreads()
+            // waits until all of them have returned.
+            void StartThread(Env *env, std::function<void()> function) {
+                {
+                    MutexLock l(&mu_);
+                    running_threads_++;
+                }
+                env->StartThread(&LogReplayQueue::RunThread, new ThreadArg{this, std::move(function)});
+            }
+
+            void WaitForThreads() {
+                MutexLock l(&mu_);
+                while (running_threads_ > 0) {
+                    cv_.Wait();
+                }
+            }
+
+            // Called by the reader: the number of log bytes after which it
+            // cuts the current segment.  Learned from the memtables that
+            // filled up so far, and a little short of their average so that
+            // a segment rarely spills into a second memtable.  Never more
+            // than write_buffer_size bytes, which fill any memtable.
+            size_t SegmentBytes() {
+                MutexLock l(&mu_);
+                if (full_mems_ == 0) {
+                    return write_buffer_size_;
+                }
+                const uint64_t average = full_mem_bytes_ / full_mems_;
+                return static_cast<size_t>(std::min<uint64_t>(average - average / 16, write_buffer_size_));
+            }
+
+            // Called by the builders when "log_bytes" bytes of records filled
+            // a memtable.
+            void RecordFullMemTable(size_t log_bytes) {
+                MutexLock l(&mu_);
+                full_mems_++;
+                full_mem_bytes_ += log_bytes;
+            }
+
+            // Called by the reader.  Returns false, and deletes "segment", if
+            // the replay has been stopped.
+            bool AddSegment(Segment *segment) {
+                MutexLock l(&mu_);
+                while (segments_.size() >= max_segments_ && !stopped_) {
+                    cv_.Wait();
+                }
+                if (stopped_) {
+                    delete segment;
+                    return false;
+                }
+                segments_.push_back(segment);
+                to_build_.push_back(segment);
+                cv_.SignalAll();
+                return true;
+            }
+
+            void FinishReading() {
+                MutexLock l(&mu_);
+                reading_done_ = true;
+                cv_.SignalAll();
+            }
+
+            // Called by the builders.  Returns nullptr once there is nothing
+            // left to build.
+            Segment *NextToBuild() {
+                MutexLock l(&mu_);
+                while (to_build_.empty() && !reading_done_ && !stopped_) {
+                    cv_.Wait();
+                }
+                if (to_build_.empty() || stopped_) {
+                    return nullptr;
+                }
+                Segment *segment = to_build_.front();
+                to_build_.pop_front();
+                return segment;
+            }
+
+            void FinishBuild(Segment *segment) {
+                std::vector<std::string>().swap(segment->records);
+                MutexLock l(&mu_);
+                segment->built = true;
+                cv_.SignalAll();
+            }
+
+            // Called by the recovering thread.  Returns the oldest segment
+            // once it is built, or nullptr if the log has no more segments.
+            // Sets *last if it is the final segment of the log.
+            Segment *NextBuilt(bool *last) {
+                MutexLock l(&mu_);
+                while (!stopped_ && (segments_.empty() ? !reading_done_ : !segments_.front()->built ||
+                                                                           (segments_.size() == 1 && !reading_done_))) {
+                    cv_.Wait();
+                }
+                if (stopped_ || segments_.empty()) {
+                    return nullptr;
+                }
+                Segment *segment = segments_.front();
+                segments_.pop_front();
+                *last = segments_.empty() && reading_done_;
+                cv_.SignalAll();
+                return segment;
+            }
+
+            // Make the reader and the builders give up.
+            void Stop() {
+                MutexLock l(&mu_);
+                stopped_ = true;
+                cv_.SignalAll();
+            }
+
+            static void Release(Segment *segment) {
+                for (MemTable *mem : segment->mems) {
+                    mem->Unref();
+                }
+                delete segment;
+            }
+
+        private:
+            struct ThreadArg {
+                LogReplayQueue *queue;
+                std::function<void()> function;
+            };
+
+            static void RunThread(void *arg) {
+                ThreadArg *thread_arg = reinterpret_cast<ThreadArg *>(arg);
+                LogReplayQueue *queue = thread_arg->queue;
+                thread_arg->function();
+                delete thread_arg;
+                MutexLock l(&queue->mu_);
+                queue->running_threads_--;
+                queue->cv_.SignalAll();
+            }
+
+            const size_t max_segments_;
+            port::Mutex mu_;
+            port::CondVar cv_;
+            const size_t write_buffer_size_;
+            uint64_t full_mems_ GUARDED_BY(mu_);
+            uint64_t full_mem_bytes_ GUARDED_BY(mu_);  // Log bytes replayed into them
+            std::deque<Segment *> segments_ GUARDED_BY(mu_);  // Not yet released, oldest first
+            std::deque<Segment *> to_build_ GUARDED_BY(mu_);  // Not yet picked up by a builder
+            bool reading_done_ GUARDED_BY(mu_);
+            bool stopped_ GUARDED_BY(mu_);
+            int running_threads_ GUARDED_BY(mu_);
+        };
+
+        // Number of threads building memtables in parallel during recovery.
+        int NumLogReplayBuilders() {
+            static const unsigned int kMaxBuilders = 4;
+            const unsigned int cores = std::thread::hardware_concurrency();
+            return static_cast<int>(std::max(1u, std::min(kMaxBuilders, cores)));
+        }
+
+    }  // namespace
+
     /**
      * 恢复 Log 文件
      * @param log_number
@@ -451,60 +780,181 @@ namespace leveldb {
         reporter.env = env_;
         reporter.info_log = options_.info_log;
         reporter.fname = fname.c_str();
-        reporter.status = (options_.paranoid_checks ? &status : nullptr);
+        Status read_status;
+        reporter.status = (options_.paranoid_checks ? &read_status : nullptr);
         // We intentionally make log::Reader do checksumming even if
         // paranoid_checks==false so that corruptions cause entire commits
         // to be skipped instead of propagating bad information (like overly
         // large sequence numbers).
-        log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+        log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/, log_number);
         Log(options_.info_log, "Recovering log #%llu", (unsigned long long) log_number);
 
-        // 阅读所有记录并添加到内存表
-        std::string scratch;
-        Slice record;
-        WriteBatch batch;
         int compactions = 0;
         MemTable *mem = nullptr;
-        while (reader.ReadRecord(&record, &scratch) && status.ok()) {
-            if (record.size() < 12) {
-                reporter.Corruption(record.size(), Status::Corruption("log record too small"));
-                continue;
-            }
-            WriteBatchInternal::SetContents(&batch, record);
+        uint64_t file_size;
+        if (!env_->GetFileSize(fname, &file_size).ok()) {
+            file_size = 0;
+        }
+        if (file_size <= options_.write_buffer_size) {
+            // 日志最多填满一个 memtable，不值得启动线程：在本线程中逐条读取并添加到内存表
+            std::string scratch;
+            Slice record;
+            WriteBatch batch;
+            while (reader.ReadRecord(&record, &scratch) && status.ok() && read_status.ok()) {
+                if (record.size() < 12) {
+                    reporter.Corruption(record.size(), Status::Corruption("log record too small"));
+                    continue;
+                }
+                WriteBatchInternal::SetContents(&batch, record);
 
-            if (mem == nullptr) {
-                mem = new MemTable(internal_comparator_);
-                mem->Ref();
-            }
-            status = WriteBatchInternal::InsertInto(&batch, mem);
-            MaybeIgnoreError(&status);
-            if (!status.ok()) {
-                break;
+                if (mem == nullptr) {
+                    mem = NewMemTable();
+                    mem->Ref();
+                }
+                status = WriteBatchInternal::InsertInto(&batch, mem);
+                MaybeIgnoreError(&status);
+                if (!status.ok()) {
+                    break;
+                }
+                const SequenceNumber last_seq =
+                        WriteBatchInternal::Sequence(&batch) + WriteBatchInternal::Count(&batch) - 1;
+                if (last_seq > *max_sequence) {
+                    *max_sequence = last_seq;
+                }
+
+                if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+                    compactions++;
+                    *save_manifest = true;
+                    status = WriteLevel0Table(mem, edit, nullptr);
+                    mem->Unref();
+                    mem = nullptr;
+                    if (!status.ok()) {
+                        // Reflect errors immediately so that conditions like full
+                        // file-systems cause the DB::Open() to fail.
+                        break;
+                    }
+                }
             }
-            const SequenceNumber last_seq =
-                    WriteBatchInternal::Sequence(&batch) + WriteBatchInternal::Count(&batch) - 1;
-            if (last_seq > *max_sequence) {
-                *max_sequence = last_seq;
+        } else {
+            // 读取线程读取并校验记录，切分成段；构建线程并行地把各段插入 memtable，
+            // 与运行时一样在 memtable 写满时换一个新的；本线程按日志顺序把构建好的
+            // memtable 写入 level-0，与后续段的读取和构建重叠进行。
+            // 最多 builders + 1 个段同时在内存中，每段的记录和 memtable 各约一个写缓冲区。
+            // 在此期间没有其他线程访问数据库，所以可以释放 mutex_。
+            const int builders = NumLogReplayBuilders();
+            LogReplayQueue queue(builders + 1, options_.write_buffer_size);
+            mutex_.Unlock();
+
+            queue.StartThread(env_, [&]() {
+                std::string scratch;
+                Slice record;
+                auto *segment = new LogReplayQueue::Segment;
+                size_t segment_bytes = 0;
+                size_t max_segment_bytes = queue.SegmentBytes();
+                while (reader.ReadRecord(&record, &scratch) && read_status.ok()) {
+                    if (record.size() < 12) {
+                        reporter.Corruption(record.size(), Status::Corruption("log record too small"));
+                        continue;
+                    }
+                    segment->records.emplace_back(record.data(), record.size());
+                    segment_bytes += record.size();
+                    if (segment_bytes > max_segment_bytes) {
+                        if (!queue.AddSegment(segment)) {
+                            segment = nullptr;
+                            break;
+                        }
+                        segment = new LogReplayQueue::Segment;
+                        segment_bytes = 0;
+                        max_segment_bytes = queue.SegmentBytes();
+                    }
+                }
+                if (segment != nullptr && !segment->records.empty()) {
+                    queue.AddSegment(segment);
+                } else {
+                    delete segment;
+                }
+                queue.FinishReading();
+            });
+
+            for (int i = 0; i < builders; i++) {
+                queue.StartThread(env_, [&]() {
+                    WriteBatch batch;
+                    LogReplayQueue::Segment *segment;
+                    while ((segment = queue.NextToBuild()) != nullptr) {
+                        MemTable *building = nullptr;
+                        size_t mem_bytes = 0;
+                        for (const std::string &contents : segment->records) {
+                            if (building == nullptr) {
+                                building = NewMemTable();
+                                building->Ref();
+                                segment->mems.push_back(building);
+                                mem_bytes = 0;
+                            }
+                            WriteBatchInternal::SetContents(&batch, contents);
+                            segment->status = WriteBatchInternal::InsertInto(&batch, building);
+                            MaybeIgnoreError(&segment->status);
+                            if (!segment->status.ok()) {
+                                break;
+                            }
+                            const SequenceNumber last_seq =
+                                    WriteBatchInternal::Sequence(&batch) + WriteBatchInternal::Count(&batch) - 1;
+                            if (last_seq > segment->max_sequence) {
+                                segment->max_sequence = last_seq;
+                            }
+                            mem_bytes += contents.size();
+                            if (building->ApproximateMemoryUsage() > options_.write_buffer_size) {
+                                queue.RecordFullMemTable(mem_bytes);
+                                building = nullptr;
+                            }
+                        }
+                        queue.FinishBuild(segment);
+                    }
+                });
             }
 
-            if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-                compactions++;
-                *save_manifest = true;
-                status = WriteLevel0Table(mem, edit, nullptr);
-                mem->Unref();
-                mem = nullptr;
-                if (!status.ok()) {
+            bool last_segment;
+            LogReplayQueue::Segment *segment;
+            while ((segment = queue.NextBuilt(&last_segment)) != nullptr) {
+                status = segment->status;
+                if (segment->max_sequence > *max_sequence) {
+                    *max_sequence = segment->max_sequence;
+                }
+                for (size_t i = 0; status.ok() && i < segment->mems.size(); i++) {
+                    if (last_segment && i + 1 == segment->mems.size()) {
+                        // Keep the tail of the log in memory, as if it had been
+                        // replayed record by record.
+                        mem = segment->mems[i];
+                        segment->mems.pop_back();
+                    } else {
+                        compactions++;
+                        *save_manifest = true;
+                        mutex_.Lock();
+                        status = WriteLevel0Table(segment->mems[i], edit, nullptr);
+                        mutex_.Unlock();
+                    }
+                }
+                queue.Release(segment);
+                if (!status.ok() || last_segment) {
                     // Reflect errors immediately so that conditions like full
                     // file-systems cause the DB::Open() to fail.
                     break;
                 }
             }
+            queue.Stop();
+            queue.WaitForThreads();
+            mutex_.Lock();
+        }
+        if (status.ok()) {
+            status = read_status;
         }
 
         delete file;
 
-        // See if we should keep reusing the last log file.
-        if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+        // See if we should keep reusing the last log file.  A log in the
+        // recyclable format may hold stale records past its end, so new
+        // records cannot simply be appended to it.
+        if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+            !reader.IsRecyclableFormat()) {
             assert(logfile_ == nullptr);
             assert(log_ == nullptr);
             assert(mem_ == nullptr);
@@ -512,14 +962,14 @@ namespace leveldb {
             if (env_->GetFileSize(fname, &lfile_size).ok() &&
                 env_->NewAppendableFile(fname, &logfile_).ok()) {
                 Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-                log_ = new log::Writer(logfile_, lfile_size);
+                log_ = new log::Writer(logfile_, lfile_size, options_.wal_compression);
                 logfile_number_ = log_number;
                 if (mem != nullptr) {
                     mem_ = mem;
                     mem = nullptr;
                 } else {
                     // mem can be nullptr if lognum exists but was empty.
-                    mem_ = new MemTable(internal_comparator_);
+                    mem_ = NewMemTable();
                     mem_->Ref();
                 }
             }
@@ -544,13 +994,14 @@ namespace leveldb {
         meta.number = versions_->NewFileNumber();
         pending_outputs_.insert(meta.number);
         Iterator *iter = mem->NewIterator();
+        Iterator *range_del_iter = mem->NewRangeTombstoneIterator();
         Log(options_.info_log, "Level-0 table #%llu: started",
             (unsigned long long) meta.number);
 
         Status s;
         {
             mutex_.Unlock();
-            s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+            s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter, &meta);
             mutex_.Lock();
         }
 
@@ -558,6 +1009,7 @@ namespace leveldb {
             (unsigned long long) meta.number, (unsigned long long) meta.file_size,
             s.ToString().c_str());
         delete iter;
+        delete range_del_iter;
         pending_outputs_.erase(meta.number);
 
         // Note that if file_size is zero, the file has been deleted and
@@ -570,7 +1022,7 @@ namespace leveldb {
                 level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
             }
             edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                          meta.largest);
+                          meta.largest, meta.has_range_deletions);
         }
 
         CompactionStats stats;
@@ -582,13 +1034,14 @@ namespace leveldb {
 
     void DBImpl::CompactMemTable() {
         mutex_.AssertHeld();
-        assert(imm_ != nullptr);
+        assert(!imm_.empty());
 
-        // Save the contents of the memtable as a new Table
+        // Save the contents of the oldest memtable as a new Table
+        const ImmutableMemTable imm = imm_.front();
         VersionEdit edit;
         Version *base = versions_->current();
         base->Ref();
-        Status s = WriteLevel0Table(imm_, &edit, base);
+        Status s = WriteLevel0Table(imm.mem, &edit, base);
         base->Unref();
 
         if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -598,15 +1051,16 @@ namespace leveldb {
         // Replace immutable memtable with the generated Table
         if (s.ok()) {
             edit.SetPrevLogNumber(0);
-            edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+            edit.SetLogNumber(imm.next_log_number);  // Earlier logs no longer needed
             s = versions_->LogAndApply(&edit, &mutex_);
         }
 
         if (s.ok()) {
             // Commit to the new state
-            imm_->Unref();
-            imm_ = nullptr;
-            has_imm_.store(false, std::memory_order_release);
+            imm.mem->Unref();
+            imm_.pop_front();
+            has_imm_.store(!imm_.empty(), std::memory_order_release);
+            InstallSuperVersion();
             RemoveObsoleteFiles();
         } else {
             RecordBackgroundError(s);
@@ -669,16 +1123,18 @@ namespace leveldb {
         }
     }
 
-    Status DBImpl::TEST_CompactMemTable() {
+    Status DBImpl::TEST_CompactMemTable() { return FlushMemTable(); }
+
+    Status DBImpl::FlushMemTable() {
         // nullptr batch means just wait for earlier writes to be done
         Status s = Write(WriteOptions(), nullptr);
         if (s.ok()) {
             // Wait until the compaction completes
             MutexLock l(&mutex_);
-            while (imm_ != nullptr && bg_error_.ok()) {
+            while (!imm_.empty() && bg_error_.ok()) {
                 background_work_finished_signal_.Wait();
             }
-            if (imm_ != nullptr) {
+            if (!imm_.empty()) {
                 s = bg_error_;
             }
         }
@@ -689,6 +1145,7 @@ namespace leveldb {
         mutex_.AssertHeld();
         if (bg_error_.ok()) {
             bg_error_ = s;
+            has_bg_error_.store(true, std::memory_order_release);
             background_work_finished_signal_.SignalAll();
         }
     }
@@ -704,7 +1161,7 @@ namespace leveldb {
             // 数据库正在删除；没有更多的后台压缩
         } else if (!bg_error_.ok()) {
             // 已经出错了；没有更多的变化
-        } else if (imm_ == nullptr && manual_compaction_ == nullptr && !versions_->NeedsCompaction()) {
+        } else if (imm_.empty() && manual_compaction_ == nullptr && !versions_->NeedsCompaction()) {
             // 没有工作要做
         } else {
             // 表示开始进行后台工作？
@@ -744,7 +1201,7 @@ namespace leveldb {
     void DBImpl::BackgroundCompaction() {
         mutex_.AssertHeld();
 
-        if (imm_ != nullptr) {
+        if (!imm_.empty()) {
             CompactMemTable();
             return;
         }
@@ -777,9 +1234,11 @@ namespace leveldb {
             FileMetaData *f = c->input(0, 0);
             c->edit()->RemoveFile(c->level(), f->number);
             c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                               f->largest);
+                               f->largest, f->has_range_deletions);
             status = versions_->LogAndApply(c->edit(), &mutex_);
-            if (!status.ok()) {
+            if (status.ok()) {
+                InstallSuperVersion();
+            } else {
                 RecordBackgroundError(status);
             }
             VersionSet::LevelSummaryStorage tmp;
@@ -851,6 +1310,7 @@ namespace leveldb {
             out.number = file_number;
             out.smallest.Clear();
             out.largest.Clear();
+            out.has_range_deletions = false;
             compact->outputs.push_back(out);
             mutex_.Unlock();
         }
@@ -864,8 +1324,8 @@ namespace leveldb {
         return s;
     }
 
-    Status DBImpl::FinishCompactionOutputFile(CompactionState *compact,
-                                              Iterator *input) {
+    Status DBImpl::FinishCompactionOutputFile(CompactionState *compact, Iterator *input,
+                                              const Slice *next_user_key) {
         assert(compact != nullptr);
         assert(compact->outfile != nullptr);
         assert(compact->builder != nullptr);
@@ -875,6 +1335,9 @@ namespace leveldb {
 
         // Check for iterator errors
         Status s = input->status();
+        if (s.ok()) {
+            AddRangeTombstonesToOutput(compact, next_user_key);
+        }
         const uint64_t current_entries = compact->builder->NumEntries();
         if (s.ok()) {
             s = compact->builder->Finish();
@@ -913,6 +1376,239 @@ namespace leveldb {
         return s;
     }
 
+    Status DBImpl::AddToCompactionOutput(CompactionState *compact, const Slice &key, const Slice &value,
+                                         Iterator *input) {
+        Status status;
+        // Close output file if it is big enough.  Done before adding the next
+        // key, so that the range tombstones of the file can end at that key.
+        if (compact->builder != nullptr &&
+            compact->builder->FileSize() >= compact->compaction->MaxOutputFileSize()) {
+            status = MaybeFinishCompactionOutputFile(compact, key, input);
+            if (!status.ok()) {
+                return status;
+            }
+        }
+
+        // Open output file if necessary
+        if (compact->builder == nullptr) {
+            status = OpenCompactionOutputFile(compact);
+            if (!status.ok()) {
+                return status;
+            }
+        }
+        if (compact->builder->NumEntries() == 0) {
+            compact->current_output()->smallest.DecodeFrom(key);
+        }
+        compact->current_output()->largest.DecodeFrom(key);
+        compact->builder->Add(key, value);
+        return status;
+    }
+
+    Status DBImpl::MaybeFinishCompactionOutputFile(CompactionState *compact, const Slice &next_key,
+                                                   Iterator *input) {
+        assert(compact->builder != nullptr);
+        // 同一个用户键的条目不能分到两个文件中，否则前一个文件中的条目不受后一个文件中范围删除的约束
+        const Slice next_user_key = ExtractUserKey(next_key);
+        if (compact->builder->NumEntries() > 0 &&
+            user_comparator()->Compare(next_user_key, compact->current_output()->largest.user_key()) == 0) {
+            return Status::OK();
+        }
+        return FinishCompactionOutputFile(compact, input, &next_user_key);
+    }
+
+    void DBImpl::AddRangeTombstonesToOutput(CompactionState *compact, const Slice *upper) {
+        if (compact->range_tombstones.empty()) {
+            return;
+        }
+        const Comparator *ucmp = user_comparator();
+        const Slice lower(compact->range_del_lower);
+        // 截取 [lower, upper) 内的部分，按内部键排序后写入
+        std::vector<std::pair<std::string, Slice>> fragments;
+        for (const RangeTombstone &t : compact->range_tombstones) {
+            Slice start(t.start), end(t.end);
+            if (compact->has_range_del_lower && ucmp->Compare(start, lower) < 0) {
+                start = lower;
+            }
+            if (upper != nullptr && ucmp->Compare(end, *upper) > 0) {
+                end = *upper;
+            }
+            if (ucmp->Compare(start, end) < 0) {
+                std::string key;
+                AppendInternalKey(&key, ParsedInternalKey(start, t.seq, kTypeRangeDeletion));
+                fragments.emplace_back(std::move(key), end);
+            }
+        }
+        std::sort(fragments.begin(), fragments.end(),
+                  [this](const std::pair<std::string, Slice> &a, const std::pair<std::string, Slice> &b) {
+                      return internal_comparator_.Compare(a.first, b.first) < 0;
+                  });
+
+        CompactionState::Output *out = compact->current_output();
+        for (size_t i = 0; i < fragments.size(); i++) {
+            if (i > 0 && fragments[i].first == fragments[i - 1].first) {
+                continue;  // 同一个范围删除在不同输入文件中的部分
+            }
+            compact->builder->AddRangeTombstone(fragments[i].first, fragments[i].second);
+            ExtendBoundsForTombstone(ucmp, ExtractUserKey(fragments[i].first), fragments[i].second,
+                                     &out->smallest, &out->largest);
+            out->has_range_deletions = true;
+        }
+        if (upper != nullptr) {
+            compact->range_del_lower = upper->ToString();
+            compact->has_range_del_lower = true;
+        }
+    }
+
+    bool DBImpl::HasRangeTombstonesLeft(CompactionState *compact) {
+        for (const RangeTombstone &t : compact->range_tombstones) {
+            if (!compact->has_range_del_lower ||
+                user_comparator()->Compare(t.end, compact->range_del_lower) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Status DBImpl::CollectRangeTombstones(CompactionState *compact) {
+        Compaction *c = compact->compaction;
+        const Comparator *ucmp = user_comparator();
+        RangeDelAggregator all(ucmp, kMaxSequenceNumber);
+        for (int i = 0; i < c->num_input_files(0); i++) {
+            FileMetaData *f = c->input(0, i);
+            if (f->has_range_deletions) {
+                Status s = all.AddTombstones(table_cache_->NewRangeTombstoneIterator(f->number, f->file_size));
+                if (!s.ok()) {
+                    return s;
+                }
+            }
+        }
+
+        // "level+1" 中完全落在 "level" 的某个范围删除之内的文件比这个范围删除更旧，
+        // 如果所有快照都能看到这个范围删除，就不必读取这个文件
+        const size_t level_tombstones = all.tombstones().size();
+        for (int i = c->num_input_files(1) - 1; i >= 0; i--) {
+            FileMetaData *f = c->input(1, i);
+            for (size_t j = 0; j < level_tombstones; j++) {
+                const RangeTombstone &t = all.tombstones()[j];
+                if (t.seq <= compact->smallest_snapshot && ucmp->Compare(f->smallest.user_key(), t.start) >= 0 &&
+                    ucmp->Compare(f->largest.user_key(), t.end) < 0) {
+                    c->DropCoveredInput(i);
+                    break;
+                }
+            }
+        }
+        if (c->num_covered_inputs() > 0) {
+            Log(options_.info_log, "Dropping %d@%d files deleted by range tombstones", c->num_covered_inputs(),
+                c->level() + 1);
+        }
+
+        for (int i = 0; i < c->num_input_files(1); i++) {
+            FileMetaData *f = c->input(1, i);
+            if (f->has_range_deletions) {
+                Status s = all.AddTombstones(table_cache_->NewRangeTombstoneIterator(f->number, f->file_size));
+                if (!s.ok()) {
+                    return s;
+                }
+            }
+        }
+        if (all.empty()) {
+            return Status::OK();
+        }
+
+        compact->range_del = new RangeDelAggregator(ucmp, compact->smallest_snapshot);
+        for (const RangeTombstone &t : all.tombstones()) {
+            compact->range_del->AddTombstone(t);
+            if (t.seq <= compact->smallest_snapshot && c->IsBaseLevelForRange(t.start, t.end)) {
+                // 更低的层中没有这个范围内的数据，这次压缩中它覆盖的条目都会被丢弃
+                continue;
+            }
+            compact->range_tombstones.push_back(t);
+        }
+        return Status::OK();
+    }
+
+    Status DBImpl::CompactMergeOperands(CompactionState *compact, Iterator *input) {
+        ParsedInternalKey ikey;
+        bool ok = ParseInternalKey(input->key(), &ikey);
+        assert(ok && ikey.type == kTypeMerge);
+        (void) ok;
+        const std::string user_key = ikey.user_key.ToString();
+        const SequenceNumber sequence = ikey.sequence;
+
+        // 从新到旧收集操作数，直到遇到值、删除标记或者这个键的条目结束
+        MergeContext merge_context;
+        std::vector<std::string> operand_keys;
+        std::string base;
+        bool has_base = false;
+        bool resolved = false;
+        while (input->Valid()) {
+            if (!ParseInternalKey(input->key(), &ikey) ||
+                user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+                break;
+            }
+            if (compact->range_del != nullptr && compact->range_del->ShouldDelete(ikey)) {
+                // 被范围删除覆盖，相当于删除标记；剩下的条目由调用方丢弃
+                resolved = true;
+                break;
+            }
+            if (ikey.type == kTypeMerge) {
+                operand_keys.push_back(input->key().ToString());
+                merge_context.PushOlderOperand(input->value());
+                input->Next();
+                continue;
+            }
+            if (ikey.type == kTypeValue) {
+                base = input->value().ToString();
+                has_base = true;
+            }
+            resolved = true;
+            input->Next();
+            break;
+        }
+        if (!resolved && compact->compaction->IsBaseLevelForKey(user_key)) {
+            // 更低的层中没有这个键，操作数之下没有值
+            resolved = true;
+        }
+
+        if (!resolved) {
+            // 值可能在更低的层中，原样保留操作数
+            for (size_t i = 0; i < operand_keys.size(); i++) {
+                Status s = AddToCompactionOutput(compact, operand_keys[i], merge_context.operand(i), input);
+                if (!s.ok()) {
+                    return s;
+                }
+            }
+            return Status::OK();
+        }
+
+        std::string value;
+        Slice base_slice(base);
+        Status s = merge_context.Merge(options_.merge_operator, user_key, has_base ? &base_slice : nullptr, &value);
+        if (!s.ok()) {
+            return s;
+        }
+        std::string key;
+        AppendInternalKey(&key, ParsedInternalKey(user_key, sequence, kTypeValue));
+        return AddToCompactionOutput(compact, key, value, input);
+    }
+
+    Status DBImpl::CompactSingleDeletion(CompactionState *compact, Iterator *input) {
+        const std::string key = input->key().ToString();
+        const Slice user_key = ExtractUserKey(key);
+        input->Next();
+        ParsedInternalKey next;
+        if (input->Valid() && ParseInternalKey(input->key(), &next) &&
+            user_comparator()->Compare(next.user_key, user_key) == 0 && next.type == kTypeValue) {
+            // 与之下的插入相互抵消：两者都不输出，插入由调用方按规则 (A) 丢弃
+            return Status::OK();
+        }
+        if (compact->compaction->IsBaseLevelForKey(user_key)) {
+            // 与普通的删除标记一样，更低的层中没有这个键时可以丢弃
+            return Status::OK();
+        }
+        return AddToCompactionOutput(compact, key, Slice(), input);
+    }
+
     Status DBImpl::InstallCompactionResults(CompactionState *compact) {
         mutex_.AssertHeld();
         Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
@@ -926,9 +1622,13 @@ namespace leveldb {
         for (size_t i = 0; i < compact->outputs.size(); i++) {
             const CompactionState::Output &out = compact->outputs[i];
             compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                                 out.smallest, out.largest);
+                                                 out.smallest, out.largest, out.has_range_deletions);
         }
-        return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+        Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+        if (s.ok()) {
+            InstallSuperVersion();
+        }
+        return s;
     }
 
     Status DBImpl::DoCompactionWork(CompactionState *compact) {
@@ -949,23 +1649,24 @@ namespace leveldb {
             compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
         }
 
-        Iterator *input = versions_->MakeInputIterator(compact->compaction);
-
         // Release mutex while we're actually doing the compaction work
         mutex_.Unlock();
 
+        // May drop input files, so done before reading the inputs
+        Status status = CollectRangeTombstones(compact);
+        Iterator *input = versions_->MakeInputIterator(compact->compaction);
+
         input->SeekToFirst();
-        Status status;
         ParsedInternalKey ikey;
         std::string current_user_key;
         bool has_current_user_key = false;
         SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-        while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
+        while (status.ok() && input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
             // Prioritize immutable compaction work
             if (has_imm_.load(std::memory_order_relaxed)) {
                 const uint64_t imm_start = env_->NowMicros();
                 mutex_.Lock();
-                if (imm_ != nullptr) {
+                if (!imm_.empty()) {
                     CompactMemTable();
                     // Wake up MakeRoomForWrite() if necessary.
                     background_work_finished_signal_.SignalAll();
@@ -977,7 +1678,7 @@ namespace leveldb {
             Slice key = input->key();
             if (compact->compaction->ShouldStopBefore(key) &&
                 compact->builder != nullptr) {
-                status = FinishCompactionOutputFile(compact, input);
+                status = MaybeFinishCompactionOutputFile(compact, key, input);
                 if (!status.ok()) {
                     break;
                 }
@@ -985,6 +1686,8 @@ namespace leveldb {
 
             // Handle key/value, add to state, etc.
             bool drop = false;
+            bool merge = false;
+            bool single_delete = false;
             if (!ParseInternalKey(key, &ikey)) {
                 // Do not hide error keys
                 current_user_key.clear();
@@ -1003,6 +1706,9 @@ namespace leveldb {
                 if (last_sequence_for_key <= compact->smallest_snapshot) {
                     // Hidden by an newer entry for same user key
                     drop = true;  // (A)
+                } else if (compact->range_del != nullptr && compact->range_del->ShouldDelete(ikey)) {
+                    // Deleted by a range tombstone that every snapshot can see
+                    drop = true;
                 } else if (ikey.type == kTypeDeletion &&
                            ikey.sequence <= compact->smallest_snapshot &&
                            compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
@@ -1014,6 +1720,18 @@ namespace leveldb {
                     //     few iterations of this loop (by rule (A) above).
                     // Therefore this deletion marker is obsolete and can be dropped.
                     drop = true;
+                } else if (ikey.type == kTypeSingleDeletion &&
+                           ikey.sequence <= compact->smallest_snapshot) {
+                    // No snapshot can see the Put under this deletion, so the
+                    // two cancel out if the Put is the next entry.
+                    single_delete = true;
+                } else if (ikey.type == kTypeMerge &&
+                           ikey.sequence <= compact->smallest_snapshot &&
+                           options_.merge_operator != nullptr) {
+                    // No snapshot can see this operand without the older entries
+                    // of this key, so they can be merged into one value.  The
+                    // entries merged away would be dropped by rule (A) anyway.
+                    merge = true;
                 }
 
                 last_sequence_for_key = ikey.sequence;
@@ -1029,26 +1747,25 @@ namespace leveldb {
 #endif
 
             if (!drop) {
-                // Open output file if necessary
-                if (compact->builder == nullptr) {
-                    status = OpenCompactionOutputFile(compact);
+                if (merge) {
+                    // Consumes the older entries of this key, so do not advance input
+                    status = CompactMergeOperands(compact, input);
                     if (!status.ok()) {
                         break;
                     }
+                    continue;
                 }
-                if (compact->builder->NumEntries() == 0) {
-                    compact->current_output()->smallest.DecodeFrom(key);
-                }
-                compact->current_output()->largest.DecodeFrom(key);
-                compact->builder->Add(key, input->value());
-
-                // Close output file if it is big enough
-                if (compact->builder->FileSize() >=
-                    compact->compaction->MaxOutputFileSize()) {
-                    status = FinishCompactionOutputFile(compact, input);
+                if (single_delete) {
+                    // Looks at the next entry, so do not advance input
+                    status = CompactSingleDeletion(compact, input);
                     if (!status.ok()) {
                         break;
                     }
+                    continue;
+                }
+                status = AddToCompactionOutput(compact, key, input->value(), input);
+                if (!status.ok()) {
+                    break;
                 }
             }
 
@@ -1058,8 +1775,12 @@ namespace leveldb {
         if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
             status = Status::IOError("Deleting DB during compaction");
         }
+        if (status.ok() && compact->builder == nullptr && HasRangeTombstonesLeft(compact)) {
+            // 范围删除之后没有需要输出的条目了，仍然要为它们生成一个文件
+            status = OpenCompactionOutputFile(compact);
+        }
         if (status.ok() && compact->builder != nullptr) {
-            status = FinishCompactionOutputFile(compact, input);
+            status = FinishCompactionOutputFile(compact, input, nullptr);
         }
         if (status.ok()) {
             status = input->status();
@@ -1092,56 +1813,149 @@ namespace leveldb {
         return status;
     }
 
-    namespace {
+    void DBImpl::SuperVersion::Cleanup() {
+        mu->AssertHeld();
+        mem->Unref();
+        for (MemTable *imm : imms) imm->Unref();
+        current->Unref();
+    }
 
-        struct IterState {
-            port::Mutex *const mu;
-            Version *const version GUARDED_BY(mu);
-            MemTable *const mem GUARDED_BY(mu);
-            MemTable *const imm GUARDED_BY(mu);
+    void DBImpl::InstallSuperVersion() {
+        mutex_.AssertHeld();
+        assert(mem_ != nullptr);
+        SuperVersion *sv = new SuperVersion;
+        sv->mem = mem_;
+        mem_->Ref();
+        sv->imms.reserve(imm_.size());
+        for (auto iter = imm_.rbegin(); iter != imm_.rend(); ++iter) {
+            sv->imms.push_back(iter->mem);
+            iter->mem->Ref();
+        }
+        sv->current = versions_->current();
+        sv->current->Ref();
+        sv->mu = &mutex_;
+        sv->refs.store(1, std::memory_order_relaxed);
+
+        SuperVersion *old = super_version_;
+        super_version_ = sv;
+
+        // 线程缓存的旧 SuperVersion 不再可用。正在使用中的由线程在归还时释放
+        std::vector<void *> cached;
+        local_sv_.Scrape(&cached, nullptr);
+        if (old != nullptr) cached.push_back(old);
+        for (void *ptr : cached) {
+            if (ptr == kSVInUse) continue;
+            SuperVersion *stale = reinterpret_cast<SuperVersion *>(ptr);
+            if (stale->Unref()) {
+                stale->Cleanup();
+                delete stale;
+            }
+        }
+        // 版本变化后，写入是否需要限速可能也变了
+        UpdateWriteStallState();
+    }
 
-            IterState(port::Mutex *mutex, MemTable *mem, MemTable *imm, Version *version)
-                    : mu(mutex), version(version), mem(mem), imm(imm) {}
-        };
+    DBImpl::SuperVersion *DBImpl::GetAndRefSuperVersion() {
+        // The cached reference, if any, stays with the thread while it is
+        // marked in use.  Each thread only uses one SuperVersion at a time.
+        SuperVersion *sv = reinterpret_cast<SuperVersion *>(local_sv_.Swap(kSVInUse));
+        assert(sv != kSVInUse);
+        if (sv == nullptr) {
+            // Nothing cached, or InstallSuperVersion() dropped the cached one
+            MutexLock l(&mutex_);
+            sv = super_version_->Ref();
+        }
+        return sv;
+    }
 
-        static void CleanupIteratorState(void *arg1, void *arg2) {
-            IterState *state = reinterpret_cast<IterState *>(arg1);
-            state->mu->Lock();
-            state->mem->Unref();
-            if (state->imm != nullptr) state->imm->Unref();
-            state->version->Unref();
-            state->mu->Unlock();
-            delete state;
+    void DBImpl::ReturnAndCleanupSuperVersion(SuperVersion *sv) {
+        void *expected = kSVInUse;
+        if (!local_sv_.CompareAndSwap(sv, &expected)) {
+            // InstallSuperVersion() ran meanwhile, so sv is no longer current
+            assert(expected == nullptr);
+            UnrefSuperVersion(sv);
         }
+    }
 
-    }  // anonymous namespace
+    void DBImpl::UnrefSuperVersion(SuperVersion *sv) {
+        if (sv->Unref()) {
+            port::Mutex *mu = sv->mu;
+            mu->Lock();
+            sv->Cleanup();
+            mu->Unlock();
+            delete sv;
+        }
+    }
+
+    void DBImpl::UnrefLocalSuperVersion(void *ptr) {
+        // A thread only caches the current SuperVersion, which super_version_
+        // keeps referenced, so this never needs the DB mutex while the DB is
+        // open.  The DB destructor scrapes the caches before dropping it.
+        if (ptr != kSVInUse) {
+            UnrefSuperVersion(reinterpret_cast<SuperVersion *>(ptr));
+        }
+    }
 
     /**
      * 内部迭代器
      */
-    Iterator *DBImpl::NewInternalIterator(const ReadOptions &options, SequenceNumber *latest_snapshot, uint32_t *seed) {
-        mutex_.Lock();
-        // 获得当前版本的最新快照
+    Iterator *DBImpl::NewInternalIterator(const ReadOptions &options, SequenceNumber *latest_snapshot, uint32_t *seed,
+                                          RangeDelAggregator **range_del) {
+        SuperVersion *sv = GetAndRefSuperVersion();
+        // 获得当前版本的最新快照，必须在取得 SuperVersion 之后读取
         *latest_snapshot = versions_->LastSequence();
 
         // Collect together all needed child iterators
         std::vector<Iterator *> list;
-        list.push_back(mem_->NewIterator());
-        mem_->Ref();
-        if (imm_ != nullptr) {
-            list.push_back(imm_->NewIterator());
-            imm_->Ref();
+        list.push_back(sv->mem->NewIterator());
+        for (MemTable *imm : sv->imms) {
+            list.push_back(imm->NewIterator());
         }
-        versions_->current()->AddIterators(options, &list);
+        Version *current = sv->current;
+        current->AddIterators(options, &list);
         Iterator *internal_iter =
                 NewMergingIterator(&internal_comparator_, &list[0], list.size());
-        versions_->current()->Ref();
 
-        IterState *cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
-        internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
-
-        *seed = ++seed_;
-        mutex_.Unlock();
+        // 迭代器在其生命周期内持有 SuperVersion 的一个引用
+        internal_iter->RegisterCleanup(
+                [](void *arg1, void * /*arg2*/) { UnrefSuperVersion(reinterpret_cast<SuperVersion *>(arg1)); },
+                sv->Ref(), nullptr);
+
+        *seed = seed_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        if (range_del != nullptr) {
+            // 内存表和版本在迭代器的生命周期内保持引用，不持有锁读取它们的范围删除
+            const SequenceNumber snapshot =
+                    (options.snapshot != nullptr ? static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number()
+                                                 : *latest_snapshot);
+            RangeDelAggregator *aggregator = new RangeDelAggregator(user_comparator(), snapshot);
+            Status s;
+            Iterator *iter = sv->mem->NewRangeTombstoneIterator();
+            if (iter != nullptr) {
+                s = aggregator->AddTombstones(iter);
+            }
+            for (MemTable *imm : sv->imms) {
+                iter = imm->NewRangeTombstoneIterator();
+                if (iter != nullptr && s.ok()) {
+                    s = aggregator->AddTombstones(iter);
+                }
+            }
+            if (s.ok()) {
+                s = current->AddRangeTombstones(aggregator);
+            }
+            if (!s.ok()) {
+                delete aggregator;
+                delete internal_iter;
+                ReturnAndCleanupSuperVersion(sv);
+                return NewErrorIterator(s);
+            }
+            if (aggregator->empty()) {
+                delete aggregator;
+                aggregator = nullptr;
+            }
+            *range_del = aggregator;
+        }
+        ReturnAndCleanupSuperVersion(sv);
         return internal_iter;
     }
 
@@ -1159,7 +1973,8 @@ namespace leveldb {
     Status DBImpl::Get(const ReadOptions &options, const Slice &key,
                        std::string *value) {
         Status s;
-        MutexLock l(&mutex_);
+        // 不加锁取得内存表和版本，最新快照必须在此之后读取
+        SuperVersion *sv = GetAndRefSuperVersion();
         SequenceNumber snapshot;
         if (options.snapshot != nullptr) {
             snapshot =
@@ -1168,46 +1983,112 @@ namespace leveldb {
             snapshot = versions_->LastSequence();
         }
 
-        MemTable *mem = mem_;
-        MemTable *imm = imm_;
-        Version *current = versions_->current();
-        mem->Ref();
-        if (imm != nullptr) imm->Ref();
-        current->Ref();
+        // First look in the memtable, then in the immutable memtables
+        // from newest to oldest.
+        LookupKey lkey(key, snapshot);
+        // 收集沿途遇到的合并操作数，直到找到它们之下的值
+        MergeContext merge_context;
+        // 较新的数据中覆盖这个键的范围删除的最大序列号，更旧的条目都已被删除
+        SequenceNumber max_covering_tombstone_seq = 0;
+        bool found = sv->mem->Get(lkey, value, &s, &merge_context, &max_covering_tombstone_seq);
+        for (size_t i = 0; !found && i < sv->imms.size(); i++) {
+            found = sv->imms[i]->Get(lkey, value, &s, &merge_context, &max_covering_tombstone_seq);
+        }
+        if (!found) {
+            Version::GetStats stats;
+            s = sv->current->Get(options, lkey, value, &stats, &merge_context, &max_covering_tombstone_seq);
+            // 只有读取了多个文件时才需要加锁记录 seek 统计
+            if (stats.seek_file != nullptr) {
+                MutexLock l(&mutex_);
+                if (sv->current->UpdateStats(stats)) {
+                    MaybeScheduleCompaction();
+                }
+            }
+        }
+        ReturnAndCleanupSuperVersion(sv);
+        return s;
+    }
 
-        bool have_stat_update = false;
-        Version::GetStats stats;
+    void DBImpl::MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                          std::vector<std::string> *values, std::vector<Status> *statuses) {
+        const size_t n = keys.size();
+        values->resize(n);
+        statuses->resize(n);
+        if (n == 0) return;
 
-        // Unlock while reading from files and memtables
-        {
-            mutex_.Unlock();
-            // First look in the memtable, then in the immutable memtable (if any).
-            LookupKey lkey(key, snapshot);
-            if (mem->Get(lkey, value, &s)) {
-                // Done
-            } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-                // Done
-            } else {
-                s = current->Get(options, lkey, value, &stats);
-                have_stat_update = true;
-            }
-            mutex_.Lock();
+        SuperVersion *sv = GetAndRefSuperVersion();
+        SequenceNumber snapshot;
+        if (options.snapshot != nullptr) {
+            snapshot =
+                    static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
         }
 
-        if (have_stat_update && current->UpdateStats(stats)) {
-            MaybeScheduleCompaction();
+        // Look the keys up in sorted order so that the files of each level
+        // are visited once for the whole batch
+        const Comparator *ucmp = user_comparator();
+        std::vector<size_t> order(n);
+        for (size_t i = 0; i < n; i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&keys, ucmp](size_t a, size_t b) {
+            return ucmp->Compare(keys[a], keys[b]) < 0;
+        });
+
+        std::deque<LookupKey> lkeys;
+        std::vector<MergeContext> merge_contexts(n);
+        std::vector<SequenceNumber> max_covering_tombstone_seqs(n, 0);
+        std::vector<Version::GetRequest> requests;
+        std::vector<size_t> request_index;
+        for (size_t i : order) {
+            lkeys.emplace_back(keys[i], snapshot);
+            const LookupKey &lkey = lkeys.back();
+            std::string *value = &(*values)[i];
+            Status *s = &(*statuses)[i];
+            bool found = sv->mem->Get(lkey, value, s, &merge_contexts[i], &max_covering_tombstone_seqs[i]);
+            for (size_t j = 0; !found && j < sv->imms.size(); j++) {
+                found = sv->imms[j]->Get(lkey, value, s, &merge_contexts[i], &max_covering_tombstone_seqs[i]);
+            }
+            if (!found) {
+                Version::GetRequest req{};
+                req.key = &lkey;
+                req.value = value;
+                req.merge_context = &merge_contexts[i];
+                req.max_covering_tombstone_seq = &max_covering_tombstone_seqs[i];
+                requests.push_back(req);
+                request_index.push_back(i);
+            }
         }
-        mem->Unref();
-        if (imm != nullptr) imm->Unref();
-        current->Unref();
-        return s;
+        if (!requests.empty()) {
+            sv->current->MultiGet(options, &requests);
+            bool have_stat_update = false;
+            for (size_t j = 0; j < requests.size(); j++) {
+                (*statuses)[request_index[j]] = requests[j].status;
+                if (requests[j].stats.seek_file != nullptr) {
+                    have_stat_update = true;
+                }
+            }
+            if (have_stat_update) {
+                MutexLock l(&mutex_);
+                bool schedule_compaction = false;
+                for (const Version::GetRequest &req : requests) {
+                    if (sv->current->UpdateStats(req.stats)) {
+                        schedule_compaction = true;
+                    }
+                }
+                if (schedule_compaction) {
+                    MaybeScheduleCompaction();
+                }
+            }
+        }
+        ReturnAndCleanupSuperVersion(sv);
     }
 
     Iterator *DBImpl::NewIterator(const ReadOptions &options) {
         SequenceNumber latest_snapshot;
         uint32_t seed;
-        Iterator *iter = NewInternalIterator(options, &latest_snapshot, &seed);
-        return NewDBIterator(this, user_comparator(), iter,
+        RangeDelAggregator *range_del = nullptr;
+        Iterator *iter = NewInternalIterator(options, &latest_snapshot, &seed, &range_del);
+        return NewDBIterator(this, user_comparator(), options_.merge_operator, iter, range_del,
                              (options.snapshot != nullptr
                               ? static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number()
                               : latest_snapshot),
@@ -1240,105 +2121,377 @@ namespace leveldb {
         return DB::Delete(options, key);
     }
 
+    Status DBImpl::Merge(const WriteOptions &options, const Slice &key, const Slice &value) {
+        if (options_.merge_operator == nullptr) {
+            return Status::InvalidArgument("Merge() requires Options::merge_operator");
+        }
+        return DB::Merge(options, key, value);
+    }
+
+    Status DBImpl::DeleteRange(const WriteOptions &options, const Slice &begin_key, const Slice &end_key) {
+        const int cmp = user_comparator()->Compare(begin_key, end_key);
+        if (cmp > 0) {
+            return Status::InvalidArgument("DeleteRange() end key is before begin key");
+        } else if (cmp == 0) {
+            return Status::OK();  // Empty range
+        }
+        return DB::DeleteRange(options, begin_key, end_key);
+    }
+
+    Status DBImpl::SyncWAL() {
+        // Log the empty batch like any other write, so that the sync cannot
+        // race with a write group appending to the log.
+        WriteOptions options;
+        options.sync = true;
+        WriteBatch batch;
+        return Write(options, &batch);
+    }
+
     Status DBImpl::Write(const WriteOptions &options, WriteBatch *updates) {
-        Writer w(&mutex_);
+        if (options.sync && options.disable_wal) {
+            return Status::InvalidArgument("sync and disable_wal cannot both be set");
+        }
+        if (updates != nullptr && WriteBatchInternal::ByteSize(updates) < WriteBatchInternal::kHeader) {
+            // 例如从截断的 Data() 构造的批处理，连标头都读不出来
+            return Status::Corruption("malformed WriteBatch (too small)");
+        }
+        Writer w;
         w.batch = updates;
         w.sync = options.sync;
-        w.done = false;
-
-        MutexLock l(&mutex_);
-        writers_.push_back(&w);
-        // 还没完成，并且不等于当前
-        while (!w.done && &w != writers_.front()) {
-            w.cv.Wait();
-        }
-        if (w.done) {
-            return w.status;
+        w.disable_wal = options.disable_wal;
+
+        if (!JoinWriteQueue(&w)) {
+            uint8_t state = AwaitState(&w, Writer::kGroupLeader | Writer::kParallelMemTableWriter |
+                                           Writer::kCompleted);
+            if (state == Writer::kParallelMemTableWriter) {
+                // 领导者已经写好了日志，由我们自己把批处理插入 memtable
+                InsertOwnBatch(&w);
+                state = AwaitState(&w, Writer::kCompleted);
+            }
+            if (state == Writer::kCompleted) {
+                return w.status;
+            }
         }
 
-        // 可能会暂时解锁并等待
+        // 我们是队列的领导者：只有领导者会修改 mem_ 和日志。
+        // 只有在切换 memtable、限速、流水线写入或出错时才需要持有 mutex_
+        if (options.sync && options_.write_group_linger_micros > 0) {
+            // 等待更多的写入加入这个组，共用同一次 fsync
+            env_->SleepForMicroseconds(static_cast<int>(options_.write_group_linger_micros));
+        }
+        // 可能会加锁并等待
         // 为即将进行的写入提供足够的空间
         Status status = MakeRoomForWrite(updates == nullptr);
-        uint64_t last_sequence = versions_->LastSequence();
         Writer *last_writer = &w;
+        const bool pipelined = options_.enable_pipelined_write;
+        // 流水线写入时，当前组插入 memtable 期间下一组会复用 tmp_batch_，所以改用栈上的批处理
+        WriteBatch pipelined_batch;
         if (status.ok() && updates != nullptr) {  // nullptr 批处理用于压缩
-            WriteBatch *write_batch = BuildBatchGroup(&last_writer);
+            bool sync = false;
+            WriteBatch *write_batch =
+                    BuildBatchGroup(&w, &last_writer, pipelined ? &pipelined_batch : tmp_batch_, &sync);
+            if (writes_delayed_.load(std::memory_order_acquire)) {
+                // 压缩跟不上时，按整个写入组的大小限速
+                MutexLock l(&mutex_);
+                DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+            }
+            uint64_t last_sequence;
+            if (pipelined) {
+                // 序列号的分配与 memtable_writers_ 的入队必须在同一个临界区内
+                mutex_.Lock();
+                last_sequence = LastAllocatedSequence();
+            } else {
+                // 没有其他线程会推进 last_sequence_，读取原子变量即可
+                last_sequence = versions_->LastSequence();
+            }
             WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+            // 组里不止一个批处理时，每个写入者可以并发插入自己的批处理
+            const bool parallel = options_.allow_concurrent_memtable_write && write_batch != updates;
+            if (parallel) {
+                AssignGroupSequences(&w, last_writer, last_sequence + 1);
+            }
             last_sequence += WriteBatchInternal::Count(write_batch);
+            w.sequence = last_sequence;
+            // mem_ is only replaced by the leader, and not while pipelined
+            // groups are pending, so it stays valid for this group.
+            MemTable *mem = mem_;
+            if (pipelined) {
+                // Set under mutex_: the previous group hands the memtable over
+                // to us under mutex_ as well.
+                w.state.store(memtable_writers_.empty() ? Writer::kMemTableWriterLeader : Writer::kGroupLeader,
+                              std::memory_order_relaxed);
+                memtable_writers_.push_back(&w);
+                mutex_.Unlock();
+            }
 
-            // 添加到日志并应用于 memtable，我们可以在此阶段释放锁定，因为 ＆w 当前负责日志记录，并防止并发记录器和并发写入 mem_。
+            // 添加到日志并应用于 memtable，无需持有锁，因为 ＆w 当前负责日志记录，并防止并发记录器和并发写入 mem_。
             {
-                mutex_.Unlock();
-                // 添加日志记录
-                status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+                // 添加日志记录（整个组都跳过日志时除外）
+                if (!options.disable_wal) {
+                    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+                }
                 bool sync_error = false;
-                if (status.ok() && options.sync) {
+                if (status.ok() && sync) {
                     status = logfile_->Sync();
                     if (!status.ok()) {
                         sync_error = true;
                     }
                 }
-                if (status.ok()) {
-                    status = WriteBatchInternal::InsertInto(write_batch, mem_);
+                if (status.ok() && !pipelined) {
+                    if (parallel) {
+                        status = ParallelInsertIntoMemTable(&w, last_writer, mem);
+                    } else {
+                        status = WriteBatchInternal::InsertInto(write_batch, mem);
+                    }
                 }
-                mutex_.Lock();
                 if (sync_error) {
                     // The state of the log file is indeterminate: the log record we
                     // just added may or may not show up when the DB is re-opened.
                     // So we force the DB into a mode where all future writes fail.
+                    MutexLock l(&mutex_);
                     RecordBackgroundError(status);
                 }
             }
+            if (pipelined) {
+                return PipelinedInsertIntoMemTable(&w, last_writer, write_batch, mem, parallel, status);
+            }
             if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
             versions_->SetLastSequence(last_sequence);
         }
 
+        ExitAsBatchGroupLeader(&w, last_writer, status);
+        return status;
+    }
+
+    bool DBImpl::JoinWriteQueue(Writer *w) {
+        Writer *newest = newest_writer_.load(std::memory_order_relaxed);
+        while (true) {
+            w->link_older = newest;
+            if (newest_writer_.compare_exchange_weak(newest, w)) {
+                // 队列原本为空，直接成为领导者
+                return newest == nullptr;
+            }
+        }
+    }
+
+    uint8_t DBImpl::AwaitState(Writer *w, uint8_t goal_mask) {
+        // Hand-offs within a busy group usually take well under a
+        // microsecond, so spin first and only yield once that fails.
+        static const int kSpinIterations = 200;
+        static const uint64_t kMaxYieldMicros = 100;
+
+        uint8_t state;
+        for (int i = 0; i < kSpinIterations; i++) {
+            state = w->state.load(std::memory_order_acquire);
+            if ((state & goal_mask) != 0) {
+                return state;
+            }
+        }
+        const uint64_t yield_start = env_->NowMicros();
+        do {
+            std::this_thread::yield();
+            state = w->state.load(std::memory_order_acquire);
+            if ((state & goal_mask) != 0) {
+                return state;
+            }
+        } while (env_->NowMicros() - yield_start < kMaxYieldMicros);
+
+        // Park.  SetState() takes park_mu once it sees kLockedWaiting, so
+        // the wake-up cannot be lost.
+        MutexLock l(&w->park_mu);
+        while (true) {
+            state = w->state.load(std::memory_order_acquire);
+            if ((state & goal_mask) != 0) {
+                return state;
+            }
+            if (state == Writer::kLockedWaiting) {
+                w->park_cv.Wait();
+            } else {
+                w->state.compare_exchange_strong(state, Writer::kLockedWaiting);
+            }
+        }
+    }
+
+    void DBImpl::SetState(Writer *w, uint8_t new_state) {
+        uint8_t state = w->state.load(std::memory_order_acquire);
+        if (state == Writer::kLockedWaiting || !w->state.compare_exchange_strong(state, new_state)) {
+            assert(state == Writer::kLockedWaiting);
+            MutexLock l(&w->park_mu);
+            w->state.store(new_state, std::memory_order_release);
+            w->park_cv.Signal();
+        }
+    }
+
+    void DBImpl::CreateMissingNewerLinks(Writer *head) {
         while (true) {
-            Writer *ready = writers_.front();
-            writers_.pop_front();
-            if (ready != &w) {
-                ready->status = status;
-                ready->done = true;
-                ready->cv.Signal();
+            Writer *next = head->link_older;
+            if (next == nullptr || next->link_newer != nullptr) {
+                assert(next == nullptr || next->link_newer == head);
+                break;
             }
-            if (ready == last_writer) break;
+            next->link_newer = head;
+            head = next;
+        }
+    }
+
+    void DBImpl::AdvanceWriteQueue(Writer *last_writer) {
+        Writer *head = newest_writer_.load(std::memory_order_acquire);
+        if (head != last_writer || !newest_writer_.compare_exchange_strong(head, nullptr)) {
+            // Somebody queued after last_writer, either before the load or
+            // before the compare_exchange_strong.
+            CreateMissingNewerLinks(head);
+            Writer *next_leader = last_writer->link_newer;
+            assert(next_leader != nullptr);
+            next_leader->link_older = nullptr;
+            SetState(next_leader, Writer::kGroupLeader);
+        }
+    }
+
+    void DBImpl::ExitAsBatchGroupLeader(Writer *leader, Writer *last_writer, Status status) {
+        // Hand over first: once completed, a follower may return and destroy
+        // its Writer, including the link_newer read by AdvanceWriteQueue().
+        AdvanceWriteQueue(last_writer);
+        while (last_writer != leader) {
+            last_writer->status = status;
+            Writer *next = last_writer->link_older;
+            SetState(last_writer, Writer::kCompleted);
+            last_writer = next;
         }
+    }
 
-        // Notify new head of write queue
-        if (!writers_.empty()) {
-            writers_.front()->cv.Signal();
+    void DBImpl::AssignGroupSequences(Writer *leader, Writer *last_writer, SequenceNumber first_sequence) {
+        // Same order in which BuildBatchGroup() appended the batches.
+        SequenceNumber sequence = first_sequence;
+        for (Writer *w = leader;; w = w->link_newer) {
+            if (w->batch != nullptr) {
+                WriteBatchInternal::SetSequence(w->batch, sequence);
+                sequence += WriteBatchInternal::Count(w->batch);
+            }
+            if (w == last_writer) break;
         }
+    }
 
+    Status DBImpl::ParallelInsertIntoMemTable(Writer *leader, Writer *last_writer, MemTable *mem) {
+        int inserts = 1;
+        for (Writer *w = leader; w != last_writer;) {
+            w = w->link_newer;
+            if (w->batch != nullptr) inserts++;
+        }
+        leader->pending_inserts.store(inserts, std::memory_order_relaxed);
+        for (Writer *w = leader; w != last_writer;) {
+            w = w->link_newer;
+            if (w->batch != nullptr) {
+                w->leader = leader;
+                w->mem = mem;
+                SetState(w, Writer::kParallelMemTableWriter);
+            }
+        }
+
+        Status status = WriteBatchInternal::InsertInto(leader->batch, mem, true);
+        if (leader->pending_inserts.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            // The last follower to finish wakes us up.
+            AwaitState(leader, Writer::kParallelInsertsDone);
+        }
+        for (Writer *w = leader; status.ok() && w != last_writer;) {
+            w = w->link_newer;
+            status = w->status;
+        }
         return status;
     }
 
-    // 要求：Writer 列表必须为非空
-    // 要求：第一次写入必须具有非空批处理
-    WriteBatch *DBImpl::BuildBatchGroup(Writer **last_writer) {
+    void DBImpl::InsertOwnBatch(Writer *w) {
+        w->status = WriteBatchInternal::InsertInto(w->batch, w->mem, true);
+        Writer *leader = w->leader;
+        if (leader->pending_inserts.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            SetState(leader, Writer::kParallelInsertsDone);
+        }
+    }
+
+    SequenceNumber DBImpl::LastAllocatedSequence() {
         mutex_.AssertHeld();
-        assert(!writers_.empty());
-        Writer *first = writers_.front();
+        if (memtable_writers_.empty()) {
+            return versions_->LastSequence();
+        }
+        return memtable_writers_.back()->sequence;
+    }
+
+    Status DBImpl::PipelinedInsertIntoMemTable(Writer *leader, Writer *last_writer, WriteBatch *write_batch,
+                                               MemTable *mem, bool parallel, Status status) {
+        // Let the next group start its log write while we are inserting into
+        // the memtable.  Our followers stay parked until we complete them below.
+        AdvanceWriteQueue(last_writer);
+
+        // Memtable insertion must happen in sequence order, so wait until every
+        // earlier group has been applied.  The previous group wakes us up.
+        AwaitState(leader, Writer::kMemTableWriterLeader);
+        if (status.ok()) {
+            if (parallel) {
+                status = ParallelInsertIntoMemTable(leader, last_writer, mem);
+            } else {
+                status = WriteBatchInternal::InsertInto(write_batch, mem);
+            }
+        }
+
+        mutex_.Lock();
+        versions_->SetLastSequence(leader->sequence);
+        assert(memtable_writers_.front() == leader);
+        memtable_writers_.pop_front();
+        if (!memtable_writers_.empty()) {
+            SetState(memtable_writers_.front(), Writer::kMemTableWriterLeader);
+        } else {
+            // The queue leader may be waiting in MakeRoomForWrite() for the
+            // memtable to become quiescent.
+            memtable_drained_signal_.SignalAll();
+        }
+        mutex_.Unlock();
+
+        while (last_writer != leader) {
+            last_writer->status = status;
+            Writer *next = last_writer->link_older;
+            SetState(last_writer, Writer::kCompleted);
+            last_writer = next;
+        }
+        return status;
+    }
+
+    // 要求：leader 是写入队列的领导者
+    // 要求：第一次写入必须具有非空批处理
+    WriteBatch *DBImpl::BuildBatchGroup(Writer *leader, Writer **last_writer, WriteBatch *tmp_batch,
+                                        bool *sync) {
+        Writer *first = leader;
         WriteBatch *result = first->batch;
         assert(result != nullptr);
 
         size_t size = WriteBatchInternal::ByteSize(first->batch);
 
         // 允许组增长到最大大小，但是如果原始写入量很小，请限制增长，这样我们就不会太慢地减小较小的写入量。
-        size_t max_size = 1 << 20;
-        if (size <= (128 << 10)) {
-            max_size = size + (128 << 10);
+        const size_t small_growth = options_.max_write_group_size / 8;
+        size_t max_size = options_.max_write_group_size;
+        if (size <= small_growth) {
+            max_size = size + small_growth;
         }
+        const int max_writers = options_.max_write_group_writers;
+        int writers = 1;
 
+        *sync = first->sync;
         *last_writer = first;
-        std::deque<Writer *>::iterator iter = writers_.begin();
-        ++iter;  // Advance past "first"
-        for (; iter != writers_.end(); ++iter) {
-            Writer *w = *iter;
-            if (w->sync && !first->sync) {
+        Writer *newest = newest_writer_.load(std::memory_order_acquire);
+        CreateMissingNewerLinks(newest);
+        Writer *w = first;
+        while (w != newest) {
+            w = w->link_newer;
+            if (w->sync && !first->sync && !options_.merge_sync_writes) {
                 // 请勿将同步写入包含在由非同步写入处理的批处理中
                 break;
             }
+            if (max_writers > 0 && writers >= max_writers) {
+                break;
+            }
+            if (w->disable_wal != first->disable_wal) {
+                // 组内的写入要么全部写日志，要么全部跳过日志
+                break;
+            }
             if (w->batch != nullptr) {
                 size += WriteBatchInternal::ByteSize(w->batch);
                 if (size > max_size) {
@@ -1348,63 +2501,69 @@ namespace leveldb {
                 // 追加到 *result
                 if (result == first->batch) {
                     // 切换到临时批处理，而不打扰呼叫者的批处理
-                    result = tmp_batch_;
+                    result = tmp_batch;
                     assert(WriteBatchInternal::Count(result) == 0);
                     WriteBatchInternal::Append(result, first->batch);
                 }
                 WriteBatchInternal::Append(result, w->batch);
             }
+            *sync = *sync || w->sync;
+            writers++;
             *last_writer = w;
         }
         return result;
     }
 
     /**
-     * 要求：保持互斥锁
+     * 要求：不持有互斥锁
      * 要求：该线程当前位于编写者队列的最前面
      * @param force
      * @return
      */
     Status DBImpl::MakeRoomForWrite(bool force) {
-        mutex_.AssertHeld();
-        assert(!writers_.empty());
-        bool allow_delay = !force;
+        // 常见情况下 memtable 还有空间：mem_ 只会被领导者（也就是我们）替换，无需加锁即可检查
+        if (!force && !has_bg_error_.load(std::memory_order_acquire) &&
+            mem_->ApproximateMemoryUsage() <= options_.write_buffer_size) {
+            return Status::OK();
+        }
+
+        MutexLock l(&mutex_);
         Status s;
         while (true) {
             if (!bg_error_.ok()) {
                 // 产生先前的错误
                 s = bg_error_;
                 break;
-            } else if (allow_delay && versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
-                // We are getting close to hitting a hard limit on the number of
-                // L0 files.  Rather than delaying a single write by several
-                // seconds when we hit the hard limit, start delaying each
-                // individual write by 1ms to reduce latency variance.  Also,
-                // this delay hands over some CPU to the compaction thread in
-                // case it is sharing the same core as the writer.
-                mutex_.Unlock();
-                env_->SleepForMicroseconds(1000);
-                allow_delay = false;  // Do not delay a single write more than once
-                mutex_.Lock();
             } else if (!force &&
                        (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
                 // There is room in current memtable
                 break;
-            } else if (imm_ != nullptr) {
-                // We have filled up the current memtable, but the previous
-                // one is still being compacted, so we wait.
+            } else if (imm_.size() + 1 >= static_cast<size_t>(options_.max_write_buffer_number)) {
+                // We have filled up the current memtable, but every other
+                // write buffer is still waiting to be compacted, so we wait.
                 Log(options_.info_log, "Current memtable full; waiting...\n");
+                const uint64_t start_micros = env_->NowMicros();
                 background_work_finished_signal_.Wait();
+                stall_stats_[kStallMemTableLimit].count++;
+                stall_stats_[kStallMemTableLimit].micros += env_->NowMicros() - start_micros;
             } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
                 // There are too many level-0 files.
                 Log(options_.info_log, "Too many L0 files; waiting...\n");
+                const uint64_t start_micros = env_->NowMicros();
                 background_work_finished_signal_.Wait();
+                stall_stats_[kStallL0Stop].count++;
+                stall_stats_[kStallL0Stop].micros += env_->NowMicros() - start_micros;
+            } else if (!memtable_writers_.empty()) {
+                // Pipelined write groups are still being applied to mem_; it
+                // cannot be retired until they are done.
+                memtable_drained_signal_.Wait();
             } else {
                 // Attempt to switch to a new memtable and trigger compaction of old
                 assert(versions_->PrevLogNumber() == 0);
                 uint64_t new_log_number = versions_->NewFileNumber();
                 WritableFile *lfile = nullptr;
-                s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+                log::Writer *new_log = nullptr;
+                s = NewLogFile(new_log_number, &lfile, &new_log);
                 if (!s.ok()) {
                     // Avoid chewing through file number space in a tight loop.
                     versions_->ReuseFileNumber(new_log_number);
@@ -1414,11 +2573,12 @@ namespace leveldb {
                 delete logfile_;
                 logfile_ = lfile;
                 logfile_number_ = new_log_number;
-                log_ = new log::Writer(lfile);
-                imm_ = mem_;
+                log_ = new_log;
+                imm_.push_back(ImmutableMemTable{mem_, new_log_number});
                 has_imm_.store(true, std::memory_order_release);
-                mem_ = new MemTable(internal_comparator_);
+                mem_ = NewMemTable();
                 mem_->Ref();
+                InstallSuperVersion();
                 force = false;  // Do not force another compaction if have room
                 MaybeScheduleCompaction();
             }
@@ -1426,6 +2586,71 @@ namespace leveldb {
         return s;
     }
 
+    bool DBImpl::UpdateDelayedWriteRate(WriteStallReason *reason) {
+        mutex_.AssertHeld();
+        // How far compaction is behind, from 0 (writes may run at
+        // delayed_write_rate) towards 1 (writes are about to stop).
+        double pressure = 0;
+        bool delayed = false;
+
+        const int l0_files = versions_->NumLevelFiles(0);
+        if (l0_files >= config::kL0_SlowdownWritesTrigger) {
+            pressure = static_cast<double>(l0_files - config::kL0_SlowdownWritesTrigger + 1) /
+                       (config::kL0_StopWritesTrigger - config::kL0_SlowdownWritesTrigger + 1);
+            *reason = kStallL0Slowdown;
+            delayed = true;
+        }
+        const uint64_t soft_limit = options_.soft_pending_compaction_bytes_limit;
+        if (soft_limit > 0) {
+            const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+            if (pending_bytes >= soft_limit) {
+                // Reaches 1 at twice the soft limit.
+                const double debt_pressure = static_cast<double>(pending_bytes - soft_limit) / soft_limit;
+                if (!delayed || debt_pressure > pressure) {
+                    pressure = debt_pressure;
+                    *reason = kStallPendingCompaction;
+                }
+                delayed = true;
+            }
+        }
+
+        if (!delayed) {
+            write_controller_.SetDelayedWriteRate(0);
+            return false;
+        }
+        // Never stop writes completely here, MakeRoomForWrite() does that.
+        static const uint64_t kMinDelayedWriteRate = 16 * 1024;
+        const double rate = options_.delayed_write_rate * (1 - std::min(pressure, 1.0));
+        write_controller_.SetDelayedWriteRate(
+                std::max(static_cast<uint64_t>(rate), kMinDelayedWriteRate));
+        return true;
+    }
+
+    void DBImpl::UpdateWriteStallState() {
+        mutex_.AssertHeld();
+        WriteStallReason reason;
+        writes_delayed_.store(UpdateDelayedWriteRate(&reason), std::memory_order_release);
+    }
+
+    void DBImpl::DelayWrite(uint64_t num_bytes) {
+        mutex_.AssertHeld();
+        WriteStallReason reason;
+        if (!UpdateDelayedWriteRate(&reason)) {
+            writes_delayed_.store(false, std::memory_order_release);
+            return;
+        }
+        const uint64_t delay = write_controller_.GetDelay(num_bytes);
+        if (delay > 0) {
+            // Also hands some CPU over to the compaction thread in case it
+            // is sharing the same core as the writer.
+            mutex_.Unlock();
+            env_->SleepForMicroseconds(static_cast<int>(delay));
+            mutex_.Lock();
+            stall_stats_[reason].count++;
+            stall_stats_[reason].micros += delay;
+        }
+    }
+
     bool DBImpl::GetProperty(const Slice &property, std::string *value) {
         value->clear();
 
@@ -1475,14 +2700,35 @@ namespace leveldb {
             if (mem_) {
                 total_usage += mem_->ApproximateMemoryUsage();
             }
-            if (imm_) {
-                total_usage += imm_->ApproximateMemoryUsage();
+            for (const ImmutableMemTable &imm : imm_) {
+                total_usage += imm.mem->ApproximateMemoryUsage();
             }
             char buf[50];
             snprintf(buf, sizeof(buf), "%llu",
                      static_cast<unsigned long long>(total_usage));
             value->append(buf);
             return true;
+        } else if (in == "num-immutable-mem-table") {
+            *value = std::to_string(imm_.size());
+            return true;
+        } else if (in == "write-stall-stats") {
+            static const char *const kReasonNames[kNumWriteStallReasons] = {
+                    "l0-slowdown", "pending-compaction", "memtable-limit", "l0-stop"};
+            char buf[200];
+            snprintf(buf, sizeof(buf),
+                     "Write stall           Count  Time(sec)\n"
+                     "--------------------------------------\n");
+            value->append(buf);
+            for (int i = 0; i < kNumWriteStallReasons; i++) {
+                snprintf(buf, sizeof(buf), "%-18s %8llu %10.3f\n", kReasonNames[i],
+                         static_cast<unsigned long long>(stall_stats_[i].count),
+                         stall_stats_[i].micros / 1e6);
+                value->append(buf);
+            }
+            snprintf(buf, sizeof(buf), "Delayed write rate: %llu bytes/s\n",
+                     static_cast<unsigned long long>(write_controller_.delayed_write_rate()));
+            value->append(buf);
+            return true;
         }
 
         return false;
@@ -1508,7 +2754,8 @@ namespace leveldb {
 
     /** DB子类可以根据需要调用的便捷方法的默认实现 */
     Status DB::Put(const WriteOptions &opt, const Slice &key, const Slice &value) {
-        WriteBatch batch;
+        // 头部、类型和两个长度前缀的上限，避免追加记录时重新分配
+        WriteBatch batch(12 + 1 + 5 + key.size() + 5 + value.size());
         batch.Put(key, value);
         return Write(opt, &batch);
     }
@@ -1519,6 +2766,37 @@ namespace leveldb {
         return Write(opt, &batch);
     }
 
+    Status DB::SingleDelete(const WriteOptions &opt, const Slice &key) {
+        WriteBatch batch;
+        batch.SingleDelete(key);
+        return Write(opt, &batch);
+    }
+
+    Status DB::Merge(const WriteOptions &opt, const Slice &key, const Slice &value) {
+        WriteBatch batch;
+        batch.Merge(key, value);
+        return Write(opt, &batch);
+    }
+
+    Status DB::DeleteRange(const WriteOptions &opt, const Slice &begin_key, const Slice &end_key) {
+        WriteBatch batch;
+        batch.DeleteRange(begin_key, end_key);
+        return Write(opt, &batch);
+    }
+
+    void DB::MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                      std::vector<std::string> *values, std::vector<Status> *statuses) {
+        values->resize(keys.size());
+        statuses->resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            (*statuses)[i] = Get(options, keys[i], &(*values)[i]);
+        }
+    }
+
+    Status DB::FlushMemTable() { return Status::NotSupported("FlushMemTable"); }
+
+    Status DB::SyncWAL() { return Status::NotSupported("SyncWAL"); }
+
     DB::~DB() = default;
 
     /**
@@ -1549,16 +2827,16 @@ namespace leveldb {
             // 将日志号升级一下
             uint64_t new_log_number = impl->versions_->NewFileNumber();
             WritableFile *lfile;
-            // 创建日志文件
-            s = options.env->NewWritableFile(LogFileName(dbname, new_log_number), &lfile);
+            log::Writer *log_writer;
+            // 创建日志文件，文件交由 log::Writer 做追加操作
+            s = impl->NewLogFile(new_log_number, &lfile, &log_writer);
             if (s.ok()) {
                 edit.SetLogNumber(new_log_number);
                 impl->logfile_ = lfile;
                 impl->logfile_number_ = new_log_number;
-                // 文件交由 log::Writer 做追加操作
-                impl->log_ = new log::Writer(lfile);
+                impl->log_ = log_writer;
                 // 创建 MemTable
-                impl->mem_ = new MemTable(impl->internal_comparator_);
+                impl->mem_ = impl->NewMemTable();
                 impl->mem_->Ref(); // 引用计数加 1
             }
         }
@@ -1568,6 +2846,7 @@ namespace leveldb {
             s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
         }
         if (s.ok()) {
+            impl->InstallSuperVersion(); // 读操作从此开始使用 SuperVersion
             impl->RemoveObsoleteFiles(); // 移除过时文件
             impl->MaybeScheduleCompaction(); // 在后台进行压缩
         }
@@ -9,19 +9,24 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/thread_local.h"
 
 namespace leveldb {
 
     class MemTable;
 
+    class RangeDelAggregator;
+
     class TableCache;
 
     class Version;
@@ -48,10 +53,17 @@ namespace leveldb {
 
         Status Delete(const WriteOptions &, const Slice &key) override;
 
+        Status Merge(const WriteOptions &, const Slice &key, const Slice &value) override;
+
+        Status DeleteRange(const WriteOptions &, const Slice &begin_key, const Slice &end_key) override;
+
         Status Write(const WriteOptions &options, WriteBatch *updates) override;
 
         Status Get(const ReadOptions &options, const Slice &key, std::string *value) override;
 
+        void MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                      std::vector<std::string> *values, std::vector<Status> *statuses) override;
+
         Iterator *NewIterator(const ReadOptions &) override;
 
         const Snapshot *GetSnapshot() override;
@@ -64,6 +76,10 @@ namespace leveldb {
 
         void CompactRange(const Slice *begin, const Slice *end) override;
 
+        Status FlushMemTable() override;
+
+        Status SyncWAL() override;
+
         // 公有 DB 接口中没有的其他方法（用于测试）
 
         // Compact any files in the named level that overlap [*begin,*end]
@@ -92,6 +108,56 @@ namespace leveldb {
         struct CompactionState;
         struct Writer;
 
+        // Reasons why a write had to wait, see "leveldb.write-stall-stats".
+        enum WriteStallReason {
+            kStallL0Slowdown,          // Delayed: too many level-0 files
+            kStallPendingCompaction,   // Delayed: too many bytes waiting for compaction
+            kStallMemTableLimit,       // Stopped: all write buffers are full
+            kStallL0Stop,              // Stopped: level-0 file limit reached
+            kNumWriteStallReasons
+        };
+
+        struct WriteStallStats {
+            WriteStallStats() : count(0), micros(0) {}
+
+            uint64_t count;
+            uint64_t micros;
+        };
+
+        // A full memtable waiting to be compacted.
+        struct ImmutableMemTable {
+            MemTable *mem;
+            // Log file started when mem was retired.  Once mem has been written
+            // to a table, the logs before this one are no longer needed.
+            uint64_t next_log_number;
+        };
+
+        // The memtables and the version a read looks at, referenced as one
+        // unit.  A new SuperVersion is installed whenever mem_, imm_ or the
+        // current version changes, and every thread caches a reference to the
+        // latest one in local_sv_, so that reads can pin all of them without
+        // acquiring mutex_.
+        struct SuperVersion {
+            MemTable *mem;
+            std::vector<MemTable *> imms;  // 从新到旧排列
+            Version *current;
+            port::Mutex *mu;               // The DB mutex, held by Cleanup()
+            std::atomic<int> refs;
+
+            SuperVersion *Ref() {
+                refs.fetch_add(1, std::memory_order_relaxed);
+                return this;
+            }
+
+            // Returns true if the last reference was dropped, in which case
+            // the caller has to call Cleanup() and delete the SuperVersion.
+            bool Unref() { return refs.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+            // Drop the references to the memtables and the version.
+            // REQUIRES: *mu is held
+            void Cleanup();
+        };
+
         // Information for a manual compaction
         struct ManualCompaction {
             int level;
@@ -117,7 +183,28 @@ namespace leveldb {
             int64_t bytes_written;
         };
 
-        Iterator *NewInternalIterator(const ReadOptions &, SequenceNumber *latest_snapshot, uint32_t *seed);
+        // If range_del is not nullptr, also stores in *range_del the range
+        // tombstones visible to the iterator, or nullptr if there are none.
+        Iterator *NewInternalIterator(const ReadOptions &, SequenceNumber *latest_snapshot, uint32_t *seed,
+                                      RangeDelAggregator **range_del = nullptr);
+
+        // Replace super_version_ with one that references the current mem_,
+        // imm_ and version, and drop the copies cached by the threads.
+        void InstallSuperVersion() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Return a reference to the latest SuperVersion, from the cache of the
+        // calling thread if possible.  Only takes mutex_ if the cache is empty.
+        SuperVersion *GetAndRefSuperVersion() LOCKS_EXCLUDED(mutex_);
+
+        // Give back a SuperVersion returned by GetAndRefSuperVersion(), to the
+        // cache of the calling thread unless a newer one was installed.
+        void ReturnAndCleanupSuperVersion(SuperVersion *sv) LOCKS_EXCLUDED(mutex_);
+
+        // Drop a reference to sv, cleaning it up if it was the last one.
+        static void UnrefSuperVersion(SuperVersion *sv);
+
+        // Release the SuperVersion cached by a thread that exits.
+        static void UnrefLocalSuperVersion(void *ptr);
 
         Status NewDB();
 
@@ -130,6 +217,14 @@ namespace leveldb {
         // Delete any unneeded files and stale in-memory entries.
         void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+        // Create an empty memtable configured by options_.
+        MemTable *NewMemTable() const;
+
+        // Create the log file numbered "log_number", writing over an obsolete
+        // log from log_recycle_files_ if there is one, and a writer for it.
+        Status NewLogFile(uint64_t log_number, WritableFile **file, log::Writer **writer)
+        EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
         // 将内存中的写缓冲区压缩到磁盘。切换到新的 日志文件/内存表 并成功写入新的描述符。
         // 错误记录在 bg_error_ 中
         void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -141,11 +236,77 @@ namespace leveldb {
         Status WriteLevel0Table(MemTable *mem, VersionEdit *edit, Version *base)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+        // Only takes mutex_ if mem_ is full (or force is set), or after a
+        // background error.
         Status MakeRoomForWrite(bool force /* compact even if there is room? */)
-        EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        LOCKS_EXCLUDED(mutex_);
 
-        WriteBatch *BuildBatchGroup(Writer **last_writer)
-        EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        // Writer queue.  Writers join a lock-free list and park on their own
+        // Writer until a leader hands them a role.  Unless the memtable is
+        // full, writes are delayed, pipelining is on or an error occurred,
+        // the leader does not take mutex_ at all.
+
+        // Add w to the writer queue.  Returns true if w became the leader.
+        bool JoinWriteQueue(Writer *w);
+
+        // Spin, then yield, then block until w->state matches goal_mask.
+        // Returns the matching state.
+        uint8_t AwaitState(Writer *w, uint8_t goal_mask);
+
+        // Move w to new_state and wake it if it is parked.
+        static void SetState(Writer *w, uint8_t new_state);
+
+        // Fill in link_newer for every writer between head and the first one
+        // whose link_newer is already set.
+        static void CreateMissingNewerLinks(Writer *head);
+
+        // Make the writer that joined right after last_writer (if any) the
+        // new leader.  The writers of the finished group are left untouched.
+        void AdvanceWriteQueue(Writer *last_writer);
+
+        // Hand the queue over and complete every follower of the group
+        // [leader, last_writer] with status.
+        void ExitAsBatchGroupLeader(Writer *leader, Writer *last_writer, Status status);
+
+        // Recompute the rate at which write_controller_ admits writes from the
+        // current compaction debt.  Returns false if writes need no delay,
+        // otherwise stores the main reason for the delay in *reason.
+        bool UpdateDelayedWriteRate(WriteStallReason *reason) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Recompute writes_delayed_ (and the delayed write rate) after the
+        // version changed.
+        void UpdateWriteStallState() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Sleep as long as write_controller_ requires for a write of num_bytes.
+        void DelayWrite(uint64_t num_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Gather the leader and the writers queued behind it into one write
+        // group, following the group commit options.  Sets *sync if the log
+        // has to be synced for some writer of the group.
+        WriteBatch *BuildBatchGroup(Writer *leader, Writer **last_writer, WriteBatch *tmp_batch, bool *sync);
+
+        // 返回最后一个已分配的序列号。流水线写入时，已写入日志但还未插入 memtable
+        // 的写入组所占用的序列号尚未通过 SetLastSequence() 发布。
+        SequenceNumber LastAllocatedSequence() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Apply a write group whose log record has already been written to
+        // mem, after every earlier group has been applied.  Hands the log
+        // over to the next group first (options_.enable_pipelined_write).
+        Status PipelinedInsertIntoMemTable(Writer *leader, Writer *last_writer, WriteBatch *write_batch,
+                                           MemTable *mem, bool parallel, Status status)
+        LOCKS_EXCLUDED(mutex_);
+
+        // Store the sequence number of every batch of the group [leader,
+        // last_writer] in the batch itself, so that each batch can be inserted
+        // into the memtable on its own (options_.allow_concurrent_memtable_write).
+        static void AssignGroupSequences(Writer *leader, Writer *last_writer, SequenceNumber first_sequence);
+
+        // Let the leader and every follower with a batch insert their own batch
+        // into mem at the same time, and wait until all of them are done.
+        Status ParallelInsertIntoMemTable(Writer *leader, Writer *last_writer, MemTable *mem);
+
+        // Follower side of ParallelInsertIntoMemTable().
+        static void InsertOwnBatch(Writer *w);
 
         void RecordBackgroundError(const Status &s);
 
@@ -164,7 +325,45 @@ namespace leveldb {
 
         Status OpenCompactionOutputFile(CompactionState *compact);
 
-        Status FinishCompactionOutputFile(CompactionState *compact, Iterator *input);
+        // Finish the current output file.  next_user_key is the first key of
+        // the next output file, or nullptr if this is the last one.
+        Status FinishCompactionOutputFile(CompactionState *compact, Iterator *input,
+                                          const Slice *next_user_key);
+
+        // Finish the current output file before next_key, unless next_key has
+        // the same user key as the last entry of the file.
+        Status MaybeFinishCompactionOutputFile(CompactionState *compact, const Slice &next_key,
+                                               Iterator *input);
+
+        // Read the range tombstones of the inputs of the compaction, and drop
+        // the inputs of "level+1" that one of them deletes entirely.
+        Status CollectRangeTombstones(CompactionState *compact);
+
+        // Add the parts of the range tombstones of the compaction that fall
+        // in the current output file, which ends before upper (if not nullptr).
+        void AddRangeTombstonesToOutput(CompactionState *compact, const Slice *upper);
+
+        // Whether some range tombstone of the compaction has not been written
+        // to an output file entirely.
+        bool HasRangeTombstonesLeft(CompactionState *compact);
+
+        // Add an entry to the current compaction output file, opening and
+        // closing output files as needed.
+        Status AddToCompactionOutput(CompactionState *compact, const Slice &key, const Slice &value,
+                                     Iterator *input);
+
+        // Combine the merge operand input is positioned at with the older
+        // entries of its user key, and add the result to the compaction
+        // output.  Leaves input positioned after the entries it consumed.
+        // REQUIRES: the operand is the newest entry of its user key that is
+        // visible to all snapshots.
+        Status CompactMergeOperands(CompactionState *compact, Iterator *input);
+
+        // Drop the single deletion at input together with the Put under it
+        // if that Put is the next entry, else output the deletion unless it
+        // is obsolete.  Leaves input positioned after the deletion.
+        // REQUIRES: the deletion is visible to all snapshots.
+        Status CompactSingleDeletion(CompactionState *compact, Iterator *input);
 
         Status InstallCompactionResults(CompactionState *compact) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -197,17 +396,36 @@ namespace leveldb {
         port::Mutex mutex_;
         std::atomic<bool> shutting_down_; // 关机
         port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
-        MemTable *mem_; // 原始内存数据
-        MemTable *imm_ GUARDED_BY(mutex_);  // Memtable 被压缩后的
-        std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+        MemTable *mem_; // 原始内存数据，只有写入队列的领导者会替换它（同时持有互斥锁）
+        // 等待被压缩的 memtable，最旧的在前
+        std::deque<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+        std::atomic<bool> has_imm_;         // So bg thread can detect non-empty imm_
+        // 与 mem_ 一样只有写入队列的领导者会替换日志
         WritableFile *logfile_;
         uint64_t logfile_number_ GUARDED_BY(mutex_);
         log::Writer *log_;
-        uint32_t seed_ GUARDED_BY(mutex_);  // 采样率
-
-        // Queue of writers.
-        std::deque<Writer *> writers_ GUARDED_BY(mutex_);
-        WriteBatch *tmp_batch_ GUARDED_BY(mutex_);
+        // 等待被新日志覆盖写入的过时日志文件编号，最旧的在前
+        std::deque<uint64_t> log_recycle_files_ GUARDED_BY(mutex_);
+        // 本实例以可回收格式创建的第一个日志文件编号，0 表示没有
+        uint64_t min_recyclable_log_number_ GUARDED_BY(mutex_);
+        std::atomic<uint32_t> seed_;  // 采样率
+
+        // 当前的 SuperVersion，持有一个引用
+        SuperVersion *super_version_ GUARDED_BY(mutex_);
+        // 每个线程缓存的 SuperVersion 引用，kSVInUse 表示线程正在使用它
+        ThreadLocalPtr local_sv_;
+
+        // Most recently queued writer; the writers form a list through
+        // Writer::link_older, ending at the current leader.
+        std::atomic<Writer *> newest_writer_;
+        WriteBatch *tmp_batch_;  // Only used by the leader of the writer queue
+
+        // Leaders of write groups whose log record is written and which are
+        // waiting to be applied to mem_, in sequence order.  Only used when
+        // options_.enable_pipelined_write is true.
+        std::deque<Writer *> memtable_writers_ GUARDED_BY(mutex_);
+        // Signalled when memtable_writers_ becomes empty.
+        port::CondVar memtable_drained_signal_ GUARDED_BY(mutex_);
 
         SnapshotList snapshots_ GUARDED_BY(mutex_);
 
@@ -224,8 +442,16 @@ namespace leveldb {
 
         // 在偏执模式下是否遇到后台错误？
         Status bg_error_ GUARDED_BY(mutex_);
+        std::atomic<bool> has_bg_error_;  // So the write leader can check bg_error_ without mutex_
+        // True if DelayWrite() may have to slow writes down; updated whenever
+        // the version changes.
+        std::atomic<bool> writes_delayed_;
 
         CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+        // 压缩跟不上时限制写入速率
+        WriteController write_controller_ GUARDED_BY(mutex_);
+        WriteStallStats stall_stats_[kNumWriteStallReasons] GUARDED_BY(mutex_);
     };
 
     /**
@@ -7,6 +7,8 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_context.h"
+#include "db/range_del_aggregator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -43,17 +45,24 @@ namespace leveldb {
             //     the exact entry that yields this->key(), this->value()
             // (2) When moving backwards, the internal iterator is positioned
             //     just before all entries whose user key == this->key().
+            // Except that when moving forward onto a key whose newest entry is a
+            // merge operand (merged_ is true), the internal iterator is past the
+            // entries that were merged into this->value(), like after a Next().
             enum Direction {
                 kForward, kReverse
             };
 
-            DBIter(DBImpl *db, const Comparator *cmp, Iterator *iter, SequenceNumber s, uint32_t seed)
+            DBIter(DBImpl *db, const Comparator *cmp, const MergeOperator *merge_operator, Iterator *iter,
+                   RangeDelAggregator *range_del, SequenceNumber s, uint32_t seed)
                     : db_(db),
                       user_comparator_(cmp),
+                      merge_operator_(merge_operator),
                       iter_(iter),
+                      range_del_(range_del),
                       sequence_(s),
                       direction_(kForward),
                       valid_(false),
+                      merged_(false),
                       rnd_(seed),
                       bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
@@ -61,18 +70,21 @@ namespace leveldb {
 
             DBIter &operator=(const DBIter &) = delete;
 
-            ~DBIter() override { delete iter_; }
+            ~DBIter() override {
+                delete iter_;
+                delete range_del_;
+            }
 
             bool Valid() const override { return valid_; }
 
             Slice key() const override {
                 assert(valid_);
-                return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+                return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key()) : saved_key_;
             }
 
             Slice value() const override {
                 assert(valid_);
-                return (direction_ == kForward) ? iter_->value() : saved_value_;
+                return (direction_ == kForward && !merged_) ? iter_->value() : saved_value_;
             }
 
             Status status() const override {
@@ -98,6 +110,10 @@ namespace leveldb {
 
             void FindPrevUserEntry();
 
+            // Merge the operand iter_ is positioned at with the older entries of
+            // its user key into saved_value_, leaving iter_ past them.
+            void MergeValuesNewToOld();
+
             bool ParseKey(ParsedInternalKey *key);
 
             inline void SaveKey(const Slice &k, std::string *dst) {
@@ -113,6 +129,16 @@ namespace leveldb {
                 }
             }
 
+            // The type of the entry, where single deletions and entries
+            // deleted by a range tombstone count as deletions.
+            ValueType EntryType(const ParsedInternalKey &ikey) {
+                if (ikey.type == kTypeSingleDeletion ||
+                    (range_del_ != nullptr && range_del_->ShouldDelete(ikey))) {
+                    return kTypeDeletion;
+                }
+                return ikey.type;
+            }
+
             // Picks the number of bytes that can be read until a compaction is scheduled.
             size_t RandomCompactionPeriod() {
                 return rnd_.Uniform(2 * config::kReadBytesPeriod);
@@ -120,13 +146,16 @@ namespace leveldb {
 
             DBImpl *db_;
             const Comparator *const user_comparator_;
+            const MergeOperator *const merge_operator_;
             Iterator *const iter_;
+            RangeDelAggregator *const range_del_;  // nullptr if there are no range tombstones
             SequenceNumber const sequence_;
             Status status_;
             std::string saved_key_;    // == current key when direction_==kReverse
-            std::string saved_value_;  // == current raw value when direction_==kReverse
+            std::string saved_value_;  // == current raw value when direction_==kReverse or merged_
             Direction direction_;
             bool valid_;
+            bool merged_;  // Whether saved_key_/saved_value_ hold the current merged entry
             Random rnd_;
             size_t bytes_until_read_sampling_;
         };
@@ -169,6 +198,16 @@ namespace leveldb {
                     return;
                 }
                 // saved_key_ already contains the key to skip past.
+            } else if (merged_) {
+                // saved_key_ already contains the key to skip past, and iter_ is
+                // already past the entries merged into the current value.
+                merged_ = false;
+                ClearSavedValue();
+                if (!iter_->Valid()) {
+                    valid_ = false;
+                    saved_key_.clear();
+                    return;
+                }
             } else {
                 // Store in saved_key_ the current key so we skip it below.
                 SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -193,7 +232,7 @@ namespace leveldb {
             do {
                 ParsedInternalKey ikey;
                 if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-                    switch (ikey.type) {
+                    switch (EntryType(ikey)) {
                         case kTypeDeletion:
                             // Arrange to skip all upcoming entries for this key since
                             // they are hidden by this deletion.
@@ -210,6 +249,21 @@ namespace leveldb {
                                 return;
                             }
                             break;
+                        case kTypeMerge:
+                            if (skipping &&
+                                user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+                                // Entry hidden
+                            } else {
+                                SaveKey(ikey.user_key, &saved_key_);
+                                MergeValuesNewToOld();
+                                return;
+                            }
+                            break;
+                        case kTypeRangeDeletion:
+                        case kTypeSingleDeletion:
+                            // Range tombstones are not yielded by iter_, and
+                            // EntryType() maps single deletions to deletions
+                            break;
                     }
                 }
                 iter_->Next();
@@ -218,14 +272,60 @@ namespace leveldb {
             valid_ = false;
         }
 
+        void DBIter::MergeValuesNewToOld() {
+            MergeContext merge_context;
+            merge_context.PushOlderOperand(iter_->value());
+            std::string base;
+            bool has_base = false;
+            for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+                ParsedInternalKey ikey;
+                if (!ParseKey(&ikey) || user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+                    break;
+                }
+                const ValueType type = EntryType(ikey);
+                if (type == kTypeMerge) {
+                    merge_context.PushOlderOperand(iter_->value());
+                    continue;
+                }
+                if (type == kTypeValue) {
+                    Slice raw_value = iter_->value();
+                    base.assign(raw_value.data(), raw_value.size());
+                    has_base = true;
+                }
+                // 更旧的条目被这个值或删除标记隐藏，留给 Next() 跳过
+                iter_->Next();
+                break;
+            }
+            Slice base_slice(base);
+            Status s = merge_context.Merge(merge_operator_, saved_key_, has_base ? &base_slice : nullptr,
+                                           &saved_value_);
+            if (!s.ok()) {
+                status_ = s;
+                valid_ = false;
+                merged_ = false;
+                return;
+            }
+            valid_ = true;
+            merged_ = true;
+        }
+
         void DBIter::Prev() {
             assert(valid_);
 
             if (direction_ == kForward) {  // Switch directions?
                 // iter_ is pointing at the current entry.  Scan backwards until
                 // the key changes so we can use the normal reverse scanning code.
-                assert(iter_->Valid());  // Otherwise valid_ would have been false
-                SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+                if (merged_) {
+                    // iter_ is past the current entry instead, and saved_key_
+                    // already holds its key.
+                    merged_ = false;
+                    if (!iter_->Valid()) {
+                        iter_->SeekToLast();
+                    }
+                } else {
+                    assert(iter_->Valid());  // Otherwise valid_ would have been false
+                    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+                }
                 while (true) {
                     iter_->Prev();
                     if (!iter_->Valid()) {
@@ -249,6 +349,10 @@ namespace leveldb {
             assert(direction_ == kReverse);
 
             ValueType value_type = kTypeDeletion;
+            // Operands newer than the value in saved_value_ (if has_base) or
+            // than the deletion, when value_type == kTypeMerge
+            MergeContext merge_context;
+            bool has_base = false;
             if (iter_->Valid()) {
                 do {
                     ParsedInternalKey ikey;
@@ -258,11 +362,22 @@ namespace leveldb {
                             // We encountered a non-deleted value in entries for previous keys,
                             break;
                         }
-                        value_type = ikey.type;
+                        const ValueType type = EntryType(ikey);
+                        if (type == kTypeMerge) {
+                            // 反向遍历时操作数从旧到新出现，之下的值（如果有）已在 saved_value_ 中
+                            value_type = kTypeMerge;
+                            SaveKey(ikey.user_key, &saved_key_);
+                            merge_context.PushNewerOperand(iter_->value());
+                        } else {
+                            value_type = type;
+                            // 这个值或删除标记之下的条目都被它隐藏
+                            merge_context.Clear();
+                            has_base = (value_type == kTypeValue);
+                        }
                         if (value_type == kTypeDeletion) {
                             saved_key_.clear();
                             ClearSavedValue();
-                        } else {
+                        } else if (value_type == kTypeValue) {
                             Slice raw_value = iter_->value();
                             if (saved_value_.capacity() > raw_value.size() + 1048576) {
                                 std::string empty;
@@ -276,6 +391,16 @@ namespace leveldb {
                 } while (iter_->Valid());
             }
 
+            if (value_type == kTypeMerge) {
+                Slice base(saved_value_);
+                Status s = merge_context.Merge(merge_operator_, saved_key_, has_base ? &base : nullptr,
+                                               &saved_value_);
+                if (!s.ok()) {
+                    status_ = s;
+                    value_type = kTypeDeletion;
+                }
+            }
+
             if (value_type == kTypeDeletion) {
                 // End
                 valid_ = false;
@@ -289,6 +414,7 @@ namespace leveldb {
 
         void DBIter::Seek(const Slice &target) {
             direction_ = kForward;
+            merged_ = false;
             ClearSavedValue();
             saved_key_.clear();
             AppendInternalKey(&saved_key_,
@@ -303,6 +429,7 @@ namespace leveldb {
 
         void DBIter::SeekToFirst() {
             direction_ = kForward;
+            merged_ = false;
             ClearSavedValue();
             iter_->SeekToFirst();
             if (iter_->Valid()) {
@@ -314,6 +441,7 @@ namespace leveldb {
 
         void DBIter::SeekToLast() {
             direction_ = kReverse;
+            merged_ = false;
             ClearSavedValue();
             iter_->SeekToLast();
             FindPrevUserEntry();
@@ -322,9 +450,9 @@ namespace leveldb {
     }  // anonymous namespace
 
     Iterator *NewDBIterator(DBImpl *db, const Comparator *user_key_comparator,
-                            Iterator *internal_iter, SequenceNumber sequence,
-                            uint32_t seed) {
-        return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                            const MergeOperator *merge_operator, Iterator *internal_iter,
+                            RangeDelAggregator *range_del, SequenceNumber sequence, uint32_t seed) {
+        return new DBIter(db, user_key_comparator, merge_operator, internal_iter, range_del, sequence, seed);
     }
 
 }  // namespace leveldb
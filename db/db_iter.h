@@ -14,12 +14,19 @@ namespace leveldb {
 
     class DBImpl;
 
+    class MergeOperator;
+
+    class RangeDelAggregator;
+
     // Return a new iterator that converts internal keys (yielded by
     // "*internal_iter") that were live at the specified "sequence" number
-    // into appropriate user keys.
+    // into appropriate user keys.  Merge operands are combined with the
+    // values under them by "merge_operator".  Entries deleted by the range
+    // tombstones in "*range_del" (nullptr if none) are skipped; the new
+    // iterator takes ownership of it.
     Iterator *NewDBIterator(DBImpl *db, const Comparator *user_key_comparator,
-                            Iterator *internal_iter, SequenceNumber sequence,
-                            uint32_t seed);
+                            const MergeOperator *merge_operator, Iterator *internal_iter,
+                            RangeDelAggregator *range_del, SequenceNumber sequence, uint32_t seed);
 
 }  // namespace leveldb
 
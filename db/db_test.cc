@@ -5,6 +5,7 @@
 #include "leveldb/db.h"
 
 #include <atomic>
+#include <memory>
 #include <string>
 
 #include "gtest/gtest.h"
@@ -15,9 +16,12 @@
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -120,6 +124,9 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of sstable/log Sync() calls.
+  AtomicCounter data_sync_counter_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -156,6 +163,7 @@ class SpecialEnv : public EnvWrapper {
         while (env_->delay_data_sync_.load(std::memory_order_acquire)) {
           DelayMilliseconds(100);
         }
+        env_->data_sync_counter_.Increment();
         return base_->Sync();
       }
     };
@@ -236,6 +244,9 @@ class DBTest : public testing::Test {
 
   DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    vector_rep_factory_ = NewVectorRepFactory();
+    hash_skiplist_rep_factory_ = NewHashSkipListRepFactory(2, 1000);
+    merge_operator_ = NewStringAppendOperator(',');
     dbname_ = testing::TempDir() + "db_test";
     DestroyDB(dbname_, Options());
     db_ = nullptr;
@@ -247,6 +258,9 @@ class DBTest : public testing::Test {
     DestroyDB(dbname_, Options());
     delete env_;
     delete filter_policy_;
+    delete vector_rep_factory_;
+    delete hash_skiplist_rep_factory_;
+    delete merge_operator_;
   }
 
   // Switch to a fresh database with the next option configuration to
@@ -265,6 +279,7 @@ class DBTest : public testing::Test {
   Options CurrentOptions() {
     Options options;
     options.reuse_logs = false;
+    options.merge_operator = merge_operator_;
     switch (option_config_) {
       case kReuse:
         options.reuse_logs = true;
@@ -275,6 +290,37 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kMemTableBloom:
+        options.memtable_bloom_bits_per_key = 10;
+        break;
+      case kVectorRep:
+        options.memtable_factory = vector_rep_factory_;
+        break;
+      case kHashSkipListRep:
+        options.memtable_factory = hash_skiplist_rep_factory_;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kMmapArena:
+        options.memtable_use_mmap = true;
+        options.arena_block_size = 64 << 10;
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kGroupCommit:
+        options.max_write_group_size = 4 << 10;
+        options.max_write_group_writers = 3;
+        options.write_group_linger_micros = 100;
+        options.merge_sync_writes = true;
+        break;
+      case kParallelCompression:
+        options.compression_parallel_threads = 3;
+        options.filter_policy = filter_policy_;
+        break;
       default:
         break;
     }
@@ -333,6 +379,43 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Look up "keys" with MultiGet() and return the results formatted like
+  // Get() and separated by commas.
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = nullptr,
+                       bool async_io = false) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    options.async_io = async_io;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(options, key_slices, &values, &statuses);
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
+  // Return the results of Get() for "keys" in the format of MultiGet().
+  std::string GetAll(const std::vector<std::string>& keys,
+                     const Snapshot* snapshot = nullptr) {
+    std::string result;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i > 0) result += ",";
+      result += Get(keys[i], snapshot);
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -389,6 +472,15 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeSingleDeletion:
+              result += "SDEL";
+              break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -417,6 +509,23 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Number of memtables written to level-0 since the DB was opened,
+  // including those flushed while recovering its logs.  Unlike the table
+  // file counts, not changed by compactions.
+  int NumLevel0Flushes() {
+    std::string log;
+    EXPECT_LEVELDB_OK(ReadFileToString(env_, InfoLogFileName(dbname_), &log));
+    int result = 0;
+    for (size_t pos = 0; (pos = log.find("Level-0 table #", pos)) !=
+                         std::string::npos;
+         pos++) {
+      if (log.compare(log.find(':', pos), 10, ": started\n") == 0) {
+        result++;
+      }
+    }
+    return result;
+  }
+
   // Return spread of files per level
   std::string FilesPerLevel() {
     std::string result;
@@ -497,6 +606,20 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  int CountLogFiles() {
+    std::vector<std::string> filenames;
+    EXPECT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    int count = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+        count++;
+      }
+    }
+    return count;
+  }
+
   bool DeleteAnSSTFile() {
     std::vector<std::string> filenames;
     EXPECT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
@@ -531,9 +654,26 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kMemTableBloom,
+    kVectorRep,
+    kHashSkipListRep,
+    kMmapArena,
+    kGroupCommit,
+    kParallelCompression,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
+  const MemTableRepFactory* vector_rep_factory_;
+  const MemTableRepFactory* hash_skiplist_rep_factory_;
+  const MergeOperator* merge_operator_;
   int option_config_;
 };
 
@@ -606,6 +746,47 @@ TEST_F(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetFromMultipleImmutableLayers) {
+  do {
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.max_write_buffer_number = 4;
+    Reopen(&options);
+
+    ASSERT_LEVELDB_OK(Put("foo", "v1"));
+
+    // Block sync calls so that no memtable finishes compacting.
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+    Put("k1", std::string(100000, 'x'));  // Fill memtable.
+    Put("k2", std::string(100000, 'y'));  // Retire first memtable.
+    ASSERT_LEVELDB_OK(Put("foo", "v2"));
+    Put("k3", std::string(100000, 'z'));  // Retire second memtable.
+    std::string num;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    ASSERT_EQ("2", num);
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    std::string keys;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      keys += iter->key().ToString() + ",";
+    }
+    ASSERT_EQ("foo,k1,k2,k3,", keys);
+    delete iter;
+    // Release sync calls.
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-mem-table", &num));
+    ASSERT_EQ("0", num);
+    ASSERT_EQ("v2", Get("foo"));
+    Reopen(&options);
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ(std::string(100000, 'z'), Get("k3"));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetFromVersions) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -625,6 +806,16 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetWriteStallStats) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-stats", &val));
+  ASSERT_NE(std::string::npos, val.find("l0-slowdown"));
+  ASSERT_NE(std::string::npos, val.find("memtable-limit"));
+  // Compaction keeps up with a single write.
+  ASSERT_NE(std::string::npos, val.find("Delayed write rate: 0 bytes/s"));
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -707,6 +898,35 @@ TEST_F(DBTest, GetLevel0Ordering) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetOverlappingLevel0Files) {
+  do {
+    // Keep the level-0 files below from being pushed to deeper levels
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("z", "vz"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("y", "vy"));
+    dbfull()->TEST_CompactMemTable();
+
+    // Level-0 files that nest, share a bound, and hold a single key
+    ASSERT_LEVELDB_OK(Put("c", "1"));
+    ASSERT_LEVELDB_OK(Put("m", "1"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("k", "2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("k", "3"));
+    ASSERT_LEVELDB_OK(Put("p", "3"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("3,1,1", FilesPerLevel());
+
+    std::vector<std::string> keys = {"a", "b", "c", "d", "k", "l",
+                                     "m", "n", "p", "q", "z"};
+    ASSERT_EQ("va,vb,1,NOT_FOUND,3,NOT_FOUND,1,NOT_FOUND,3,NOT_FOUND,vz",
+              GetAll(keys));
+    ASSERT_EQ(GetAll(keys), MultiGet(keys));
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetOrderedByLevels) {
   do {
     ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -734,6 +954,126 @@ TEST_F(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread the keys over a deeper level, level-0 files with overlapping
+    // ranges, and the memtable
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("x", "vx1"));
+    Compact("a", "x");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Put("m", "vm2"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Delete("a"));
+    ASSERT_LEVELDB_OK(Put("d", "vd3"));
+    ASSERT_LEVELDB_OK(Put("m", "vm3"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Put("x", "vx4"));
+
+    // Unsorted, with duplicates and missing keys
+    std::vector<std::string> keys = {"x", "a",  "m", "missing", "c",
+                                     "d", "zz", "c", "",        "m"};
+    ASSERT_EQ("vx4,NOT_FOUND,vm3,NOT_FOUND,vc2,vd3,NOT_FOUND,vc2,NOT_FOUND,vm3",
+              MultiGet(keys));
+    ASSERT_EQ(GetAll(keys), MultiGet(keys));
+    ASSERT_EQ(
+        "vx1,va1,vm2,NOT_FOUND,vc2,NOT_FOUND,NOT_FOUND,vc2,NOT_FOUND,vm2",
+        MultiGet(keys, snapshot));
+    ASSERT_EQ(GetAll(keys, snapshot), MultiGet(keys, snapshot));
+    ASSERT_EQ(GetAll(keys), MultiGet(keys, nullptr, true));
+    ASSERT_EQ("", MultiGet({}));
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+namespace {
+
+struct FlushReaderState {
+  DB* db;
+  int num_keys;
+  // Every key has been set to this generation or a later one.
+  std::atomic<int> written_gen;
+  std::atomic<bool> stop;
+  std::atomic<int> readers_started;
+  std::atomic<int> readers_done;
+};
+
+static std::string FlushReaderKey(int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return std::string(buf);
+}
+
+static void FlushReaderBody(void* arg) {
+  FlushReaderState* state = reinterpret_cast<FlushReaderState*>(arg);
+  Random rnd(301 + state->readers_started.fetch_add(1));
+  std::string value;
+  while (!state->stop.load(std::memory_order_acquire)) {
+    const int min_gen = state->written_gen.load(std::memory_order_acquire);
+    if (rnd.OneIn(20)) {
+      Iterator* iter = state->db->NewIterator(ReadOptions());
+      int count = 0;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_GE(std::stoi(iter->value().ToString()), min_gen);
+        count++;
+      }
+      ASSERT_LEVELDB_OK(iter->status());
+      ASSERT_EQ(state->num_keys, count);
+      delete iter;
+    } else {
+      const int key = rnd.Uniform(state->num_keys);
+      ASSERT_LEVELDB_OK(
+          state->db->Get(ReadOptions(), FlushReaderKey(key), &value));
+      ASSERT_GE(std::stoi(value), min_gen);
+    }
+  }
+  state->readers_done.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace
+
+// Reads do not take the DB mutex; check that they keep seeing every
+// completed write while memtables and versions are replaced under them.
+TEST_F(DBTest, ReadsDuringFlushAndCompaction) {
+  const int kReaders = 3;
+  const int kGenerations = 30;
+  FlushReaderState state;
+  state.db = db_;
+  state.num_keys = 200;
+  state.written_gen.store(0, std::memory_order_release);
+  state.stop.store(false, std::memory_order_release);
+  state.readers_started.store(0, std::memory_order_release);
+  state.readers_done.store(0, std::memory_order_release);
+  for (int i = 0; i < state.num_keys; i++) {
+    ASSERT_LEVELDB_OK(Put(FlushReaderKey(i), "0"));
+  }
+
+  for (int i = 0; i < kReaders; i++) {
+    env_->StartThread(FlushReaderBody, &state);
+  }
+  for (int gen = 1; gen <= kGenerations; gen++) {
+    for (int i = 0; i < state.num_keys; i++) {
+      ASSERT_LEVELDB_OK(Put(FlushReaderKey(i), std::to_string(gen)));
+    }
+    state.written_gen.store(gen, std::memory_order_release);
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    if (gen % 5 == 0) {
+      dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    }
+  }
+  state.stop.store(true, std::memory_order_release);
+  while (state.readers_done.load(std::memory_order_acquire) < kReaders) {
+    DelayMilliseconds(10);
+  }
+
+  // The exited readers released their cached state
+  ASSERT_EQ(std::to_string(kGenerations), Get(FlushReaderKey(0)));
+  Reopen();
+  ASSERT_EQ(std::to_string(kGenerations), Get(FlushReaderKey(state.num_keys - 1)));
+}
+
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -946,6 +1286,53 @@ TEST_F(DBTest, IterSmallAndLargeMix) {
   delete iter;
 }
 
+TEST_F(DBTest, IterKeysSharingPrefix) {
+  // Keys that memtable nodes summarize with the same 8-byte prefix, and
+  // short keys whose zero padding matches real zero bytes.
+  std::vector<std::string> keys = {
+      "",
+      std::string("\0", 1),
+      "a",
+      std::string("a\0", 2),
+      std::string("a\0\0\0\0\0\0\0\0", 9),
+      std::string("a\0\0\0\0\0\0\0\1", 9),
+      "abcdefgh",
+      "abcdefgh0",
+      "abcdefgh1",
+      "abcdefgi",
+      "\xff\xff\xff\xff\xff\xff\xff\xff",
+      "\xff\xff\xff\xff\xff\xff\xff\xff\xff",
+  };
+  do {
+    std::vector<std::string> shuffled = keys;
+    Random rnd(test::RandomSeed());
+    for (size_t i = shuffled.size() - 1; i > 0; i--) {
+      std::swap(shuffled[i], shuffled[rnd.Uniform(i + 1)]);
+    }
+    for (const std::string& key : shuffled) {
+      ASSERT_LEVELDB_OK(Put(key, "v" + key));
+    }
+    for (const std::string& key : keys) {
+      ASSERT_EQ("v" + key, Get(key));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(std::string("a\0\0", 3)));
+
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    size_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_LT(i, keys.size());
+      ASSERT_EQ(keys[i], iter->key().ToString());
+    }
+    ASSERT_EQ(keys.size(), i);
+    for (size_t j = 0; j < keys.size(); j++) {
+      iter->Seek(keys[j]);
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(keys[j], iter->key().ToString());
+    }
+    delete iter;
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, IterMultiWithDelete) {
   do {
     ASSERT_LEVELDB_OK(Put("a", "va"));
@@ -1077,6 +1464,539 @@ TEST_F(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST_F(DBTest, RecoverLargeLog) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000000;
+  Reopen(&options);
+  // Overwrite the same keys many times, so that the parts of the log that
+  // are replayed into different memtables overlap.
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(
+          Put(Key(i), Key(i) + std::string(1000, static_cast<char>('a' + round))));
+    }
+  }
+
+  // Replaying the 1MB log now spans many memtables.
+  options.write_buffer_size = 50000;
+  Reopen(&options);
+  ASSERT_GT(NumLevel0Flushes(), 1);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Key(i) + std::string(1000, 'j'), Get(Key(i)));
+  }
+  Reopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(Key(i) + std::string(1000, 'j'), Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, RecoverLargeLogFillsMemTables) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000000;
+  Reopen(&options);
+  // Small entries take more room in a memtable than in the log: at least
+  // their internal key and a skiplist node's pointers.
+  const int kEntries = 30000;
+  const size_t kMinMemTableBytesPerEntry = 9 + 8 + 10 + 3 + 16;
+  for (int i = 0; i < kEntries; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(10, 'v')));
+  }
+
+  // Memtables are cut when they are full, as at runtime, not when the log
+  // records replayed into them reach write_buffer_size.
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  ASSERT_GE(NumLevel0Flushes(),
+            static_cast<int>(kEntries * kMinMemTableBytesPerEntry /
+                             (options.write_buffer_size + 200)));
+  for (int i = 0; i < kEntries; i += 1000) {
+    ASSERT_EQ(std::string(10, 'v'), Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, RecoverWithCompressedLog) {
+  Options options = CurrentOptions();
+  options.wal_compression = kSnappyCompression;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("big1", std::string(200000, '1')));
+  ASSERT_LEVELDB_OK(Put("small2", "v2"));
+  Reopen(&options);
+  ASSERT_EQ(std::string(200000, '1'), Get("big1"));
+  ASSERT_EQ("v2", Get("small2"));
+
+  // Logs written either way can be recovered with either setting.
+  ASSERT_LEVELDB_OK(Put("small3", "v3"));
+  options.wal_compression = kNoCompression;
+  Reopen(&options);
+  ASSERT_EQ("v3", Get("small3"));
+  ASSERT_LEVELDB_OK(Put("small4", "v4"));
+  options.wal_compression = kSnappyCompression;
+  Reopen(&options);
+  ASSERT_EQ(std::string(200000, '1'), Get("big1"));
+  ASSERT_EQ("v4", Get("small4"));
+}
+
+TEST_F(DBTest, DisableWAL) {
+  WriteOptions no_wal;
+  no_wal.disable_wal = true;
+  ASSERT_LEVELDB_OK(db_->Put(no_wal, "foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  ASSERT_EQ("v1", Get("foo"));
+
+  // Only the logged write survives a reopen.
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+
+  ASSERT_LEVELDB_OK(db_->Put(no_wal, "foo", "v3"));
+  ASSERT_LEVELDB_OK(db_->FlushMemTable());
+  Reopen();
+  ASSERT_EQ("v3", Get("foo"));
+
+  WriteOptions sync_no_wal = no_wal;
+  sync_no_wal.sync = true;
+  ASSERT_TRUE(db_->Put(sync_no_wal, "foo", "v4").IsInvalidArgument());
+  ASSERT_EQ("v3", Get("foo"));
+}
+
+TEST_F(DBTest, WriteTruncatedBatch) {
+  WriteBatch batch;
+  batch.Put("foo", "v1");
+  WriteBatch truncated(batch.Data().substr(0, 5));
+  ASSERT_TRUE(db_->Write(WriteOptions(), &truncated).IsCorruption());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+}
+
+TEST_F(DBTest, SyncWAL) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(db_->SyncWAL());
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  Reopen();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+}
+
+TEST_F(DBTest, MemTableBloomFilter) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.memtable_bloom_bits_per_key = 10;
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(Put("bar", "v2"));
+  ASSERT_LEVELDB_OK(Delete("bar"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+  ASSERT_EQ("NOT_FOUND", Get("baz"));
+
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  ASSERT_EQ("NOT_FOUND", Get(Key(1000)));
+
+  // Lookups through the immutable memtable: the deletion must still hide
+  // the table entry for "foo".
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Delete("foo"));
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put("k1", std::string(100000, 'x')));  // Fill memtable
+  ASSERT_LEVELDB_OK(Put("k2", std::string(100000, 'y')));  // Trigger compaction
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v", Get(Key(1)));
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+}
+
+TEST_F(DBTest, Merge) {
+  do {
+    // Operands on top of nothing, a value and a deletion
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "1"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "2"));
+    ASSERT_LEVELDB_OK(Put("b", "x"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "1"));
+    ASSERT_LEVELDB_OK(Put("c", "x"));
+    ASSERT_LEVELDB_OK(Delete("c"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "c", "1"));
+    ASSERT_EQ("1,2", Get("a"));
+    ASSERT_EQ("x,1", Get("b"));
+    ASSERT_EQ("1", Get("c"));
+    ASSERT_EQ("(a->1,2)(b->x,1)(c->1)", Contents());
+
+    // Operands spread over the memtable and tables
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "3"));
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "2"));
+    ASSERT_LEVELDB_OK(Put("c", "y"));
+    ASSERT_EQ("1,2,3", Get("a"));
+    ASSERT_EQ("x,1,2", Get("b"));
+    ASSERT_EQ("y", Get("c"));
+    ASSERT_EQ("(a->1,2,3)(b->x,1,2)(c->y)", Contents());
+    ASSERT_EQ("1,2", Get("a", snapshot));
+    ASSERT_EQ("x,1", Get("b", snapshot));
+
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "3"));
+    ASSERT_EQ("x,1,2,3", Get("b"));
+    ASSERT_EQ("x,1", Get("b", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen();
+    ASSERT_EQ("1,2,3", Get("a"));
+    ASSERT_EQ("x,1,2,3", Get("b"));
+    ASSERT_EQ("(a->1,2,3)(b->x,1,2,3)(c->y)", Contents());
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->1,2,3)(b->x,1,2,3)(c->y)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MergeIterDirections) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "2"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "d", "1"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->1,2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->1,2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->1,2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->va");
+  iter->Seek("d");
+  ASSERT_EQ(IterStatus(iter), "d->1");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c->vc");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d->1");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+}
+
+TEST_F(DBTest, MergeCompaction) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  ASSERT_LEVELDB_OK(Put("a", "begin"));
+  ASSERT_LEVELDB_OK(Put("z", "end"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m1"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m2"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to level last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(m2), MERGE(m1), v1 ]");
+  Slice z("z");
+  dbfull()->TEST_CompactRange(last - 2, nullptr, &z);
+  // The value under the operands is in a level we are not compacting, so
+  // the operands stay.
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(m2), MERGE(m1), v1 ]");
+  ASSERT_EQ("v1,m1,m2", Get("foo"));
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  // Compacting with the value merges the operands into it.
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v1,m1,m2 ]");
+  ASSERT_EQ("v1,m1,m2", Get("foo"));
+
+  // A snapshot keeps the operands it can see apart from newer ones.
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m3"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "m4"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(m4), v1,m1,m2,m3 ]");
+  ASSERT_EQ("v1,m1,m2,m3", Get("foo", snapshot));
+  ASSERT_EQ("v1,m1,m2,m3,m4", Get("foo"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Operands over nothing are merged at the base level.
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "new", "n1"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("new"), "[ n1 ]");
+}
+
+TEST_F(DBTest, MergeCounter) {
+  std::unique_ptr<const MergeOperator> add(NewUInt64AddOperator());
+  Options options = CurrentOptions();
+  options.merge_operator = add.get();
+  Reopen(&options);
+  std::string one;
+  PutFixed64(&one, 1);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "counter", one));
+    if (i % 30 == 0) {
+      ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  std::string value;
+  ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "counter", &value));
+  ASSERT_EQ(8, value.size());
+  ASSERT_EQ(100, DecodeFixed64(value.data()));
+
+  // A malformed operand makes reads of the key fail.
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "counter", "bad"));
+  ASSERT_TRUE(db_->Get(ReadOptions(), "counter", &value).IsCorruption());
+  Close();
+}
+
+TEST_F(DBTest, MergeWithoutOperator) {
+  Options options = CurrentOptions();
+  options.merge_operator = nullptr;
+  Reopen(&options);
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "foo", "v").IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+
+  // Operands written with an operator cannot be read without one.
+  Options with_operator = CurrentOptions();
+  Reopen(&with_operator);
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "foo", "v"));
+  Reopen(&options);
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "foo", &value).IsInvalidArgument());
+}
+
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(d->vd)", Contents());
+    ASSERT_EQ("vb", Get("b", snapshot));
+
+    // Writes after the range deletion are visible
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+
+    // The tombstone keeps hiding older entries from tables
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vb", Get("b", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+
+    Reopen();
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+
+    // Empty and inverted ranges
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+    ASSERT_TRUE(db_->DeleteRange(WriteOptions(), "z", "a").IsInvalidArgument());
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeRecovery) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  Reopen();  // Replays the range deletion from the log
+  ASSERT_EQ("(c->vc)", Contents());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  Reopen();
+  ASSERT_EQ("(c->vc)", Contents());
+}
+
+TEST_F(DBTest, DeleteRangeCompaction) {
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+  }
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v", Get(Key(50)));
+
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(10), Key(90)));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  // The snapshot keeps the deleted entries alive
+  ASSERT_EQ("[ v ]", AllEntriesFor(Key(50)));
+  ASSERT_EQ("v", Get(Key(50), snapshot));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Compact the last level too, where the tombstone is now
+  dbfull()->TEST_CompactRange(config::kMaxMemCompactLevel, nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(50)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+  ASSERT_EQ("v", Get(Key(9)));
+  ASSERT_EQ("v", Get(Key(90)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(20, count);
+
+  // Entries written after the deletion are kept
+  ASSERT_LEVELDB_OK(Put(Key(50), "v2"));
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("v2", Get(Key(50)));
+}
+
+TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 16 << 20;  // Flush all the keys to one table
+  Reopen(&options);
+  Random rnd(301);
+  for (int i = 0; i < 800; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 10000)));
+  }
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(last));
+  dbfull()->TEST_CompactRange(last, nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(last + 1), 2);
+
+  // Delete everything but the first and last keys
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), Key(1), Key(799)));
+  ASSERT_LEVELDB_OK(Put(Key(0), "first"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(last));
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+
+  dbfull()->TEST_CompactRange(last, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(last));
+  // Only the files holding the first and last keys remain
+  ASSERT_LE(NumTableFilesAtLevel(last + 1), 2);
+  ASSERT_EQ("first", Get(Key(0)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+  ASSERT_NE("NOT_FOUND", Get(Key(799)));
+}
+
+TEST_F(DBTest, DeleteRangeMerge) {
+  ASSERT_LEVELDB_OK(Put("a", "x"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // At the last level
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+  ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_EQ("2", Get("a"));
+  ASSERT_EQ("(a->2)", Contents());
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("2", Get("a"));
+  ASSERT_EQ("(a->2)", Contents());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("[ 2 ]", AllEntriesFor("a"));
+  ASSERT_EQ("2", Get("a"));
+}
+
+TEST_F(DBTest, SingleDelete) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->SingleDelete(WriteOptions(), "a"));
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("va", Get("a", snapshot));
+    ASSERT_EQ("(b->vb)", Contents());
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("(b->vb)", Contents());
+    db_->ReleaseSnapshot(snapshot);
+
+    // The key can be written again after its deletion
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_EQ("va2", Get("a"));
+    Reopen();
+    ASSERT_EQ("(a->va2)(b->vb)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, SingleDeleteCompaction) {
+  // Place a table at the level under kMaxMemCompactLevel, so that deletions
+  // in the range ["a", "z"] are not at the base level.
+  const int last = config::kMaxMemCompactLevel;
+  ASSERT_LEVELDB_OK(Put("a", "begin"));
+  ASSERT_LEVELDB_OK(Put("z", "end"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(last, nullptr, nullptr);
+  ASSERT_EQ(1, NumTableFilesAtLevel(last + 1));
+
+  ASSERT_LEVELDB_OK(Put("m", "v"));
+  ASSERT_LEVELDB_OK(Put("n", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(last));
+  ASSERT_LEVELDB_OK(db_->SingleDelete(WriteOptions(), "m"));
+  ASSERT_LEVELDB_OK(Delete("n"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(last - 1));
+  ASSERT_EQ("[ SDEL, v ]", AllEntriesFor("m"));
+  ASSERT_EQ("[ DEL, v ]", AllEntriesFor("n"));
+
+  // The single deletion cancels out with the Put under it, while the
+  // deletion has to stay until it reaches the base level.
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor("m"));
+  ASSERT_EQ("[ DEL ]", AllEntriesFor("n"));
+  ASSERT_EQ("NOT_FOUND", Get("m"));
+  ASSERT_EQ("NOT_FOUND", Get("n"));
+
+  // A snapshot between the Put and the deletion keeps both
+  ASSERT_LEVELDB_OK(Put("p", "v"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(db_->SingleDelete(WriteOptions(), "p"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("[ SDEL, v ]", AllEntriesFor("p"));
+  ASSERT_EQ("v", Get("p", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(last + 1, nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor("p"));
+}
+
+TEST_F(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.recycle_log_file_num = 2;
+  options.write_buffer_size = 10000;
+  // Old records left in a recycled log must not be reported as corruption.
+  options.paranoid_checks = true;
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + (i % 26))));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  // The current log plus the obsolete logs kept for recycling.
+  ASSERT_GE(CountLogFiles(), 2);
+  ASSERT_LE(CountLogFiles(), 3);
+
+  // The current log has been written over an older, longer one.
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + (i % 26)), Get(Key(i)));
+  }
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_LEVELDB_OK(Put("foo", "v2"));
+  Reopen(&options);
+  ASSERT_EQ("v2", Get("foo"));
+}
+
 TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;  // Large write buffer
@@ -1330,6 +2250,10 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // FillLevels() leaves enough level-0 files to trigger a compaction.  Run
+    // it now, or it may still be pending, and keep the hidden value, while
+    // the snapshot below is held.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1758,6 +2682,59 @@ TEST_F(DBTest, NonWritableFileSystem) {
   env_->non_writable_.store(false, std::memory_order_release);
 }
 
+TEST_F(DBTest, GroupCommitSyncWrites) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_group_linger_micros = 2000;
+  options.merge_sync_writes = true;
+  Reopen(&options);
+
+  static const int kThreads = 4;
+  static const int kWritesPerThread = 50;
+  struct Args {
+    DB* db;
+    int id;
+    std::atomic<bool> done;
+  };
+  Args args[kThreads];
+  env_->data_sync_counter_.Reset();
+  for (int id = 0; id < kThreads; id++) {
+    args[id].db = db_;
+    args[id].id = id;
+    args[id].done.store(false, std::memory_order_release);
+    env_->StartThread(
+        [](void* arg) {
+          Args* a = reinterpret_cast<Args*>(arg);
+          WriteOptions write_options;
+          for (int i = 0; i < kWritesPerThread; i++) {
+            // Every other thread writes without sync, and joins the groups
+            // of the sync writes
+            write_options.sync = (a->id % 2 == 0);
+            char key[100];
+            std::snprintf(key, sizeof(key), "%d.%d", a->id, i);
+            ASSERT_LEVELDB_OK(a->db->Put(write_options, key, "v"));
+          }
+          a->done.store(true, std::memory_order_release);
+        },
+        &args[id]);
+  }
+  for (int id = 0; id < kThreads; id++) {
+    while (!args[id].done.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+
+  for (int id = 0; id < kThreads; id++) {
+    for (int i = 0; i < kWritesPerThread; i++) {
+      ASSERT_EQ("v", Get(std::to_string(id) + "." + std::to_string(i)));
+    }
+  }
+  // The sync writes share their fsyncs
+  const int sync_writes = kThreads / 2 * kWritesPerThread;
+  ASSERT_GT(env_->data_sync_counter_.Read(), 0);
+  ASSERT_LT(env_->data_sync_counter_.Read(), sync_writes);
+}
+
 TEST_F(DBTest, WriteSyncError) {
   // Check that log sync errors cause the DB to disallow future writes.
 
@@ -2065,13 +3042,33 @@ class ModelDB : public DB {
     class Handler : public WriteBatch::Handler {
      public:
       KVMap* map_;
+      const MergeOperator* merge_operator_;
       void Put(const Slice& key, const Slice& value) override {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
+      void Merge(const Slice& key, const Slice& value) override {
+        std::vector<Slice> operands = {value};
+        auto iter = map_->find(key.ToString());
+        Slice existing;
+        if (iter != map_->end()) {
+          existing = iter->second;
+        }
+        std::string result;
+        ASSERT_TRUE(merge_operator_->FullMerge(
+            key, iter != map_->end() ? &existing : nullptr, operands, &result));
+        (*map_)[key.ToString()] = result;
+      }
     };
     Handler handler;
     handler.map_ = &map_;
+    handler.merge_operator_ = options_.merge_operator;
     return batch->Iterate(&handler);
   }
 
@@ -2199,11 +3196,18 @@ TEST_F(DBTest, Randomized) {
             // Periodically re-use the same key from the previous iter, so
             // we have multiple entries in the write batch for the same key
           }
-          if (rnd.OneIn(2)) {
+          const int op = rnd.Uniform(3);
+          if (rnd.OneIn(20)) {
+            // A small range of keys starting at k
+            b.DeleteRange(k, k + RandomKey(&rnd));
+          } else if (op == 0) {
             v = RandomString(&rnd, rnd.Uniform(10));
             b.Put(k, v);
-          } else {
+          } else if (op == 1) {
             b.Delete(k);
+          } else {
+            v = RandomString(&rnd, rnd.Uniform(10));
+            b.Merge(k, v);
           }
         }
         ASSERT_LEVELDB_OK(model.Write(WriteOptions(), &b));
@@ -2213,6 +3217,13 @@ TEST_F(DBTest, Randomized) {
       if ((step % 100) == 0) {
         ASSERT_TRUE(CompareIterators(step, &model, db_, nullptr, nullptr));
         ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+        std::vector<std::string> keys;
+        for (int i = 0; i < 20; i++) {
+          keys.push_back(RandomKey(&rnd));
+        }
+        ASSERT_EQ(GetAll(keys), MultiGet(keys));
+        ASSERT_EQ(GetAll(keys, db_snap), MultiGet(keys, db_snap));
+        ASSERT_EQ(GetAll(keys), MultiGet(keys, nullptr, true));
         // Save a snapshot from each DB this time that we'll use next
         // time we compare things, to make sure the current state is
         // preserved with the snapshot
@@ -57,7 +57,13 @@ namespace leveldb {
         /** 删除的操作会标记为 kTypeDeletion */
         kTypeDeletion = 0x0,
         /** 插入的数据会将其设置为 kTypeValue */
-        kTypeValue = 0x1
+        kTypeValue = 0x1,
+        /** DB::Merge() 写入的操作数会标记为 kTypeMerge，读取时再与之下的值合并 */
+        kTypeMerge = 0x2,
+        /** DB::DeleteRange() 写入的范围删除标记，只出现在 memtable 的范围删除表和 table 的范围删除块中 */
+        kTypeRangeDeletion = 0x3,
+        /** DB::SingleDelete() 写入的删除标记，压缩时与它之下唯一的一次插入相互抵消 */
+        kTypeSingleDeletion = 0x4
     };
     // kValueTypeForSeek defines the ValueType that should be passed when
     // constructing a ParsedInternalKey object for seeking to a particular
@@ -65,7 +71,7 @@ namespace leveldb {
     // and the value type is embedded as the low 8 bits in the sequence
     // number in internal keys, we need to use the highest-numbered
     // ValueType, not the lowest).
-    static const ValueType kValueTypeForSeek = kTypeValue;
+    static const ValueType kValueTypeForSeek = kTypeSingleDeletion;
 
     typedef uint64_t SequenceNumber;
 
@@ -175,6 +181,8 @@ namespace leveldb {
 
         void Clear() { rep_.clear(); }
 
+        bool empty() const { return rep_.empty(); }
+
         std::string DebugString() const;
     };
 
@@ -192,7 +200,7 @@ namespace leveldb {
         result->sequence = num >> 8;
         result->type = static_cast<ValueType>(c);
         result->user_key = Slice(internal_key.data(), n - 8);
-        return (c <= static_cast<uint8_t>(kTypeValue));
+        return (c <= static_cast<uint8_t>(kTypeSingleDeletion));
     }
 
 // A helper class useful for DBImpl::Get()
@@ -217,6 +225,9 @@ namespace leveldb {
         // Return the user key
         Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+        // Return the sequence number the key was looked up at
+        SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
     private:
         // We construct a char array of the form:
         //    klength  varint32               <-- start_
@@ -60,6 +60,9 @@ TEST(FormatTest, InternalKey_EncodeDecode) {
     for (int s = 0; s < sizeof(seq) / sizeof(seq[0]); s++) {
       TestKey(keys[k], seq[s], kTypeValue);
       TestKey("hello", 1, kTypeDeletion);
+      TestKey("hello", 1, kTypeMerge);
+      TestKey("hello", 1, kTypeRangeDeletion);
+      TestKey("hello", 1, kTypeSingleDeletion);
     }
   }
 }
@@ -88,6 +88,28 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void Merge(const Slice& key, const Slice& value) override {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    std::string r = "  delete range '";
+    AppendEscapedStringTo(&r, begin_key);
+    r += "' .. '";
+    AppendEscapedStringTo(&r, end_key);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  void SingleDelete(const Slice& key) override {
+    std::string r = "  single del '";
+    AppendEscapedStringTo(&r, key);
+    r += "'\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -167,43 +189,53 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
 
   ReadOptions ro;
   ro.fill_cache = false;
-  Iterator* iter = table->NewIterator(ro);
+  // The entries of the table, then its range deletions
+  Iterator* iters[2] = {table->NewIterator(ro),
+                        table->NewRangeTombstoneIterator()};
   std::string r;
-  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-    r.clear();
-    ParsedInternalKey key;
-    if (!ParseInternalKey(iter->key(), &key)) {
-      r = "badkey '";
-      AppendEscapedStringTo(&r, iter->key());
-      r += "' => '";
-      AppendEscapedStringTo(&r, iter->value());
-      r += "'\n";
-      dst->Append(r);
-    } else {
-      r = "'";
-      AppendEscapedStringTo(&r, key.user_key);
-      r += "' @ ";
-      AppendNumberTo(&r, key.sequence);
-      r += " : ";
-      if (key.type == kTypeDeletion) {
-        r += "del";
-      } else if (key.type == kTypeValue) {
-        r += "val";
+  for (Iterator* iter : iters) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      r.clear();
+      ParsedInternalKey key;
+      if (!ParseInternalKey(iter->key(), &key)) {
+        r = "badkey '";
+        AppendEscapedStringTo(&r, iter->key());
+        r += "' => '";
+        AppendEscapedStringTo(&r, iter->value());
+        r += "'\n";
+        dst->Append(r);
       } else {
-        AppendNumberTo(&r, key.type);
+        r = "'";
+        AppendEscapedStringTo(&r, key.user_key);
+        r += "' @ ";
+        AppendNumberTo(&r, key.sequence);
+        r += " : ";
+        if (key.type == kTypeDeletion) {
+          r += "del";
+        } else if (key.type == kTypeValue) {
+          r += "val";
+        } else if (key.type == kTypeMerge) {
+          r += "merge";
+        } else if (key.type == kTypeRangeDeletion) {
+          r += "range del";
+        } else if (key.type == kTypeSingleDeletion) {
+          r += "single del";
+        } else {
+          AppendNumberTo(&r, key.type);
+        }
+        r += " => '";
+        AppendEscapedStringTo(&r, iter->value());
+        r += "'\n";
+        dst->Append(r);
       }
-      r += " => '";
-      AppendEscapedStringTo(&r, iter->value());
-      r += "'\n";
-      dst->Append(r);
     }
-  }
-  s = iter->status();
-  if (!s.ok()) {
-    dst->Append("iterator error: " + s.ToString() + "\n");
+    s = iter->status();
+    if (!s.ok()) {
+      dst->Append("iterator error: " + s.ToString() + "\n");
+    }
+    delete iter;
   }
 
-  delete iter;
   delete table;
   delete file;
   return Status::OK();
@@ -24,9 +24,30 @@ namespace leveldb {
             /** 记录的内容的起始位置不在本 block，结束位置也不在本 block */
             kMiddleType = 3,
             /** 记录的内容起始位置不在本 block，但结束位置在本 block */
-            kLastType = 4
+            kLastType = 4,
+
+            // Same as kFullType and kFirstType, for a record whose payload is
+            // compressed.  The remaining fragments of such a record use
+            // kMiddleType and kLastType.  A compressed payload is the output of
+            // the codec followed by one byte holding its CompressionType.
+            kCompressedFullType = 5,
+            kCompressedFirstType = 6,
+
+            // Recyclable variants of the types above, used by log files that
+            // may be written over an obsolete log file.  Their header also
+            // holds the low 32 bits of the log number, so that records left
+            // over from the file's previous use can be told apart.
+            kRecyclableFullType = 7,
+            kRecyclableFirstType = 8,
+            kRecyclableMiddleType = 9,
+            kRecyclableLastType = 10,
+            kRecyclableCompressedFullType = 11,
+            kRecyclableCompressedFirstType = 12
         };
-        static const int kMaxRecordType = kLastType;
+        static const int kMaxRecordType = kRecyclableCompressedFirstType;
+
+        /** kRecyclableXXXType == kXXXType + kRecyclableTypeOffset */
+        static const int kRecyclableTypeOffset = kRecyclableFullType - kFullType;
 
         /** 字节，32KB，一个块的大小 */
         static const int kBlockSize = 32768;
@@ -50,6 +71,17 @@ namespace leveldb {
          */
         static const int kHeaderSize = 4 + 2 + 1;
 
+        /**
+         * 可回收格式的头： 11 B
+         * |---------------------------------------------------------|
+         * |    4     |  2   |  1  |      4      |      content       |
+         * |---------------------------------------------------------|
+         *   checksum  length  type   log number        data
+         *
+         * checksum 覆盖 type、log number 及 data
+         */
+        static const int kRecyclableHeaderSize = kHeaderSize + 4;
+
     }  // namespace log
 }  // namespace leveldb
 
@@ -7,6 +7,8 @@
 #include <stdio.h>
 
 #include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -15,7 +17,8 @@ namespace leveldb {
 
         Reader::Reporter::~Reporter() = default;
 
-        Reader::Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t initial_offset)
+        Reader::Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t initial_offset,
+                       uint64_t log_number)
                 : file_(file),
                   reporter_(reporter),
                   checksum_(checksum),
@@ -25,7 +28,12 @@ namespace leveldb {
                   last_record_offset_(0),
                   end_of_buffer_offset_(0),
                   initial_offset_(initial_offset),
-                  resyncing_(initial_offset > 0) {}
+                  resyncing_(initial_offset > 0),
+                  log_number_(static_cast<uint32_t>(log_number)),
+                  recyclable_(false),
+                  last_header_size_(kHeaderSize),
+                  pending_drop_bytes_(0),
+                  pending_drop_reason_(nullptr) {}
 
         Reader::~Reader() { delete[] backing_store_; }
 
@@ -41,6 +49,7 @@ namespace leveldb {
             // 如果发现文件指针落在这个 7bytes 的尾巴上，那么直接跳过这个 block
             // -6, -5, -4, -3, -2, -1
             // 这里代码写成：
+            // （可回收格式的尾巴可达 10 字节，但其中不会有记录开始，从这里开始读也只会跳过它）
             if (offset_in_block > kBlockSize - 6) {
                 block_start_location += kBlockSize;
             }
@@ -75,6 +84,8 @@ namespace leveldb {
             scratch->clear();
             record->clear();
             bool in_fragmented_record = false;
+            // Whether the fragments collected in *scratch form a compressed record
+            bool compressed_record = false;
             // Record offset of the logical record that we're reading 0 is a dummy value to make compilers happy
             uint64_t prospective_record_offset = 0;
 
@@ -86,7 +97,7 @@ namespace leveldb {
                 // internal buffer. Calculate the offset of the next physical record now
                 // that it has returned, properly accounting for its header size.
                 uint64_t physical_record_offset =
-                        end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+                        end_of_buffer_offset_ - buffer_.size() - last_header_size_ - fragment.size();
 
                 if (resyncing_) {
                     if (record_type == kMiddleType) {
@@ -101,6 +112,7 @@ namespace leveldb {
 
                 switch (record_type) {
                     case kFullType:
+                    case kCompressedFullType:
                         if (in_fragmented_record) {
                             // Handle bug in earlier versions of log::Writer where
                             // it could emit an empty kFirstType record at the tail end
@@ -112,11 +124,20 @@ namespace leveldb {
                         }
                         prospective_record_offset = physical_record_offset;
                         scratch->clear();
-                        *record = fragment;
+                        in_fragmented_record = false;
+                        if (record_type == kCompressedFullType) {
+                            if (!UncompressRecord(fragment, record)) {
+                                ReportCorruption(fragment.size(), "bad compressed record");
+                                break;
+                            }
+                        } else {
+                            *record = fragment;
+                        }
                         last_record_offset_ = prospective_record_offset;
                         return true;
 
                     case kFirstType:
+                    case kCompressedFirstType:
                         if (in_fragmented_record) {
                             // Handle bug in earlier versions of log::Writer where
                             // it could emit an empty kFirstType record at the tail end
@@ -129,6 +150,7 @@ namespace leveldb {
                         prospective_record_offset = physical_record_offset;
                         scratch->assign(fragment.data(), fragment.size());
                         in_fragmented_record = true;
+                        compressed_record = (record_type == kCompressedFirstType);
                         break;
 
                     case kMiddleType:
@@ -146,7 +168,16 @@ namespace leveldb {
                                              "missing start of fragmented record(2)");
                         } else {
                             scratch->append(fragment.data(), fragment.size());
-                            *record = Slice(*scratch);
+                            in_fragmented_record = false;
+                            if (compressed_record) {
+                                if (!UncompressRecord(Slice(*scratch), record)) {
+                                    ReportCorruption(scratch->size(), "bad compressed record");
+                                    scratch->clear();
+                                    break;
+                                }
+                            } else {
+                                *record = Slice(*scratch);
+                            }
                             last_record_offset_ = prospective_record_offset;
                             return true;
                         }
@@ -161,9 +192,24 @@ namespace leveldb {
                         }
                         return false;
 
+                    case kOldRecord:
+                        // The rest of the file is left over from the log that
+                        // used it before; treat it like the end of the file.
+                        // Anything dropped since the last good record was part
+                        // of that stale tail, not a corruption.
+                        pending_drop_bytes_ = 0;
+                        if (in_fragmented_record) {
+                            scratch->clear();
+                        }
+                        return false;
+
                     case kBadRecord:
                         if (in_fragmented_record) {
-                            ReportCorruption(scratch->size(), "error in middle of record");
+                            if (recyclable_) {
+                                DeferCorruption(scratch->size(), "error in middle of record");
+                            } else {
+                                ReportCorruption(scratch->size(), "error in middle of record");
+                            }
                             in_fragmented_record = false;
                             scratch->clear();
                         }
@@ -186,10 +232,55 @@ namespace leveldb {
 
         uint64_t Reader::LastRecordOffset() { return last_record_offset_; }
 
+        bool Reader::UncompressRecord(const Slice &payload, Slice *record) {
+            if (payload.empty()) {
+                return false;
+            }
+            // The codec is recorded in the last byte of the payload.
+            const char *data = payload.data();
+            const size_t n = payload.size() - 1;
+            switch (data[n]) {
+                case kSnappyCompression: {
+                    size_t ulength = 0;
+                    if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+                        return false;
+                    }
+                    uncompressed_.resize(ulength);
+                    if (!port::Snappy_Uncompress(data, n, &uncompressed_[0])) {
+                        return false;
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
+            *record = Slice(uncompressed_);
+            return true;
+        }
+
         void Reader::ReportCorruption(uint64_t bytes, const char *reason) {
             ReportDrop(bytes, Status::Corruption(reason));
         }
 
+        void Reader::DeferCorruption(uint64_t bytes, const char *reason) {
+            if (end_of_buffer_offset_ - buffer_.size() - bytes >= initial_offset_) {
+                if (pending_drop_bytes_ == 0) {
+                    pending_drop_reason_ = reason;
+                }
+                pending_drop_bytes_ += bytes;
+            }
+        }
+
+        void Reader::ReportDeferredCorruption() {
+            if (pending_drop_bytes_ > 0) {
+                if (reporter_ != nullptr) {
+                    reporter_->Corruption(static_cast<size_t>(pending_drop_bytes_),
+                                          Status::Corruption(pending_drop_reason_));
+                }
+                pending_drop_bytes_ = 0;
+            }
+        }
+
         void Reader::ReportDrop(uint64_t bytes, const Status &reason) {
             if (reporter_ != nullptr && end_of_buffer_offset_ - buffer_.size() - bytes >= initial_offset_) {
                 reporter_->Corruption(static_cast<size_t>(bytes), reason);
@@ -229,11 +320,26 @@ namespace leveldb {
                 const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
                 const unsigned int type = header[6];
                 const uint32_t length = a | (b << 8);
-                if (kHeaderSize + length > buffer_.size()) {
+                int header_size = kHeaderSize;
+                if (type >= kRecyclableFullType && type <= kRecyclableCompressedFirstType) {
+                    header_size = kRecyclableHeaderSize;
+                }
+                // 只有日志号不同才说明读到了上一个日志留下的数据，先于长度检查判断，
+                // 这样旧记录的头不会被当成长度错误
+                if (header_size == kRecyclableHeaderSize && buffer_.size() >= kRecyclableHeaderSize &&
+                    log_number_ != 0 && DecodeFixed32(header + kHeaderSize) != log_number_) {
+                    buffer_.clear();
+                    return kOldRecord;
+                }
+                if (header_size + length > buffer_.size()) {
                     size_t drop_size = buffer_.size();
                     buffer_.clear();
                     if (!eof_) {
-                        ReportCorruption(drop_size, "bad record length");
+                        if (recyclable_) {
+                            DeferCorruption(drop_size, "bad record length");
+                        } else {
+                            ReportCorruption(drop_size, "bad record length");
+                        }
                         return kBadRecord;
                     }
                     // If the end of the file has been reached without reading |length| bytes
@@ -250,10 +356,21 @@ namespace leveldb {
                     return kBadRecord;
                 }
 
+                unsigned int result_type = type;
+                if (header_size == kRecyclableHeaderSize) {
+                    result_type = type - kRecyclableTypeOffset;
+                } else if (recyclable_) {
+                    // A recycled file never mixes in legacy records
+                    size_t drop_size = buffer_.size();
+                    buffer_.clear();
+                    DeferCorruption(drop_size, "legacy record in recycled log");
+                    return kBadRecord;
+                }
+
                 // Check crc
                 if (checksum_) {
                     uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-                    uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+                    uint32_t actual_crc = crc32c::Value(header + 6, header_size - 6 + length);
                     if (actual_crc != expected_crc) {
                         // Drop the rest of the buffer since "length" itself may have
                         // been corrupted and if we trust it, we could find some
@@ -261,22 +378,34 @@ namespace leveldb {
                         // like a valid log record.
                         size_t drop_size = buffer_.size();
                         buffer_.clear();
-                        ReportCorruption(drop_size, "checksum mismatch");
+                        if (recyclable_) {
+                            DeferCorruption(drop_size, "checksum mismatch");
+                        } else {
+                            ReportCorruption(drop_size, "checksum mismatch");
+                        }
                         return kBadRecord;
                     }
                 }
 
-                buffer_.remove_prefix(kHeaderSize + length);
+                if (header_size == kRecyclableHeaderSize) {
+                    // Without a known log number, trust the first valid record
+                    log_number_ = DecodeFixed32(header + kHeaderSize);
+                    recyclable_ = true;
+                    // 后面还有本日志的记录，之前丢弃的字节确实是损坏
+                    ReportDeferredCorruption();
+                }
+                buffer_.remove_prefix(header_size + length);
+                last_header_size_ = header_size;
 
                 // Skip physical record that started before initial_offset_
-                if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+                if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
                     initial_offset_) {
                     result->clear();
                     return kBadRecord;
                 }
 
-                *result = Slice(header + kHeaderSize, length);
-                return type;
+                *result = Slice(header + header_size, length);
+                return result_type;
             }
         }
 
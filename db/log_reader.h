@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "db/log_format.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
@@ -39,7 +41,14 @@ namespace leveldb {
             //
             // The Reader will start reading at the first record located at physical
             // position >= initial_offset within the file.
-            Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t initial_offset);
+            //
+            // "log_number" is the number of the log file being read.  A file
+            // written in the recyclable format may end with records left over
+            // from an earlier log that used the same file; reading stops at the
+            // first record whose log number differs.  If "log_number" is 0, the
+            // log number of the first recyclable record is trusted instead.
+            Reader(SequentialFile *file, Reporter *reporter, bool checksum, uint64_t initial_offset,
+                   uint64_t log_number = 0);
 
             Reader(const Reader &) = delete;
 
@@ -59,16 +68,26 @@ namespace leveldb {
             // Undefined before the first call to ReadRecord.
             uint64_t LastRecordOffset();
 
+            // Returns true if the records read so far were written in the
+            // recyclable format.  Such a file may hold stale data past its
+            // last record, so it must not be appended to.
+            bool IsRecyclableFormat() const { return recyclable_; }
+
         private:
             // Extend record types with the following special values
             enum {
                 kEof = kMaxRecordType + 1,
                 // Returned whenever we find an invalid physical record.
                 // Currently there are three situations in which this happens:
-                // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
+                // * The record has an invalid CRC (ReadPhysicalRecord reports a drop,
+                //   or defers it in a recycled log)
                 // * The record is a 0-length record (No drop is reported)
                 // * The record is below constructor's initial_offset (No drop is reported)
-                kBadRecord = kMaxRecordType + 2
+                kBadRecord = kMaxRecordType + 2,
+                // Returned when we reach a record of an earlier log that used
+                // the same (recycled) file, i.e. a header with another log
+                // number.  The log ends there.
+                kOldRecord = kMaxRecordType + 3
             };
 
             // Skips all blocks that are completely before "initial_offset_".
@@ -79,12 +98,23 @@ namespace leveldb {
             // Return type, or one of the preceding special values
             unsigned int ReadPhysicalRecord(Slice *result);
 
+            // Uncompress the payload of a compressed record into uncompressed_
+            // and point *record at it.  Returns false if the payload is corrupt.
+            bool UncompressRecord(const Slice &payload, Slice *record);
+
             // Reports dropped bytes to the reporter.
             // buffer_ must be updated to remove the dropped bytes prior to invocation.
             void ReportCorruption(uint64_t bytes, const char *reason);
 
             void ReportDrop(uint64_t bytes, const Status &reason);
 
+            // Like ReportCorruption, but for bytes dropped from a recycled log:
+            // holds them back until ReportDeferredCorruption() confirms that
+            // more of this log follows.
+            void DeferCorruption(uint64_t bytes, const char *reason);
+
+            void ReportDeferredCorruption();
+
             SequentialFile *const file_;
             Reporter *const reporter_;
             bool const checksum_;
@@ -104,6 +134,23 @@ namespace leveldb {
             // particular, a run of kMiddleType and kLastType records can be silently
             // skipped in this mode
             bool resyncing_;
+
+            // Low 32 bits of the log number expected in recyclable headers
+            uint32_t log_number_;
+            // True once a valid recyclable record has been read.  From then on
+            // only a record with another log number marks the end of the log.
+            bool recyclable_;
+            // Header size of the last record returned by ReadPhysicalRecord
+            int last_header_size_;
+            // Bytes dropped from a recycled log since its last valid record,
+            // and why the first of them was dropped.  They are reported once
+            // another record of this log follows, and forgotten if the log
+            // ends first: a torn tail over stale data looks the same.
+            uint64_t pending_drop_bytes_;
+            const char *pending_drop_reason_;
+
+            // Contents of the last compressed record returned by ReadRecord.
+            std::string uncompressed_;
         };
 
     }  // namespace log
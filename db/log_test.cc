@@ -6,6 +6,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
@@ -54,6 +55,22 @@ class LogTest : public testing::Test {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  void UseCompression(CompressionType compression) {
+    delete writer_;
+    writer_ = new Writer(&dest_, dest_.contents_.size(), compression);
+  }
+
+  // Write the log numbered "log_number" in the recyclable format over
+  // whatever has been written so far, as if the file were recycled.
+  void RecycleAs(uint64_t log_number) {
+    delete writer_;
+    delete reader_;
+    dest_.offset_ = 0;
+    writer_ = new Writer(&dest_, kNoCompression, log_number);
+    reader_ = new Reader(&source_, &report_, true /*checksum*/,
+                         0 /*initial_offset*/, log_number);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -165,11 +182,13 @@ class LogTest : public testing::Test {
     Status Flush() override { return Status::OK(); }
     Status Sync() override { return Status::OK(); }
     Status Append(const Slice& slice) override {
-      contents_.append(slice.data(), slice.size());
+      contents_.replace(offset_, slice.size(), slice.data(), slice.size());
+      offset_ += slice.size();
       return Status::OK();
     }
 
     std::string contents_;
+    size_t offset_ = 0;  // Where the next Append() writes
   };
 
   class StringSource : public SequentialFile {
@@ -514,6 +533,149 @@ TEST_F(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2 * kBlockSize);
 }
 
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
+// Runs of random characters: compressible, but not to nearly nothing.
+static std::string RunsString(size_t n, Random* rnd) {
+  std::string result;
+  while (result.size() < n) {
+    result.append(4 + rnd->Uniform(5), static_cast<char>(' ' + rnd->Uniform(95)));
+  }
+  result.resize(n);
+  return result;
+}
+
+TEST_F(LogTest, CompressedReadWrite) {
+  if (!SnappyCompressionSupported()) {
+    fprintf(stderr, "skipping compression tests\n");
+    return;
+  }
+  Random rnd(301);
+  const std::string runs = RunsString(200000, &rnd);
+  UseCompression(kSnappyCompression);
+  Write("foo");  // Too small to be worth compressing
+  Write("");
+  Write(std::string(100000, 'b'));
+  Write(runs);  // Still spans several blocks once compressed
+  Write(std::string(1000, 'z'));
+  ASSERT_GT(WrittenBytes(), 2 * kBlockSize);
+  ASSERT_LT(WrittenBytes(), runs.size());
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(std::string(100000, 'b'), Read());
+  ASSERT_EQ(runs, Read());
+  ASSERT_EQ(std::string(1000, 'z'), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, CompressedAppendToUncompressed) {
+  if (!SnappyCompressionSupported()) {
+    fprintf(stderr, "skipping compression tests\n");
+    return;
+  }
+  Write(std::string(1000, 'f'));
+  UseCompression(kSnappyCompression);
+  Write(std::string(1000, 'b'));
+  ASSERT_EQ(std::string(1000, 'f'), Read());
+  ASSERT_EQ(std::string(1000, 'b'), Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST_F(LogTest, BadCompressedRecord) {
+  if (!SnappyCompressionSupported()) {
+    fprintf(stderr, "skipping compression tests\n");
+    return;
+  }
+  UseCompression(kSnappyCompression);
+  Write(std::string(1000, 'f'));
+  ASSERT_LT(WrittenBytes(), kHeaderSize + 1000);  // Stored compressed
+  // The codec is stored in the last byte of the payload.
+  const int length = static_cast<int>(WrittenBytes()) - kHeaderSize;
+  SetByte(kHeaderSize + length - 1, 0x7f);
+  FixChecksum(0, length);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(length, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("bad compressed record"));
+}
+
+TEST_F(LogTest, RecyclableReadWrite) {
+  RecycleAs(7);
+  Write("foo");
+  Write("");
+  Write(BigString("bar", 100000));
+  Write("xxxx");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(BigString("bar", 100000), Read());
+  ASSERT_EQ("xxxx", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecyclableBlockTrailer) {
+  RecycleAs(7);
+  // Leave room for a legacy header, but not for a recyclable one.
+  const int n = kBlockSize - kRecyclableHeaderSize - 8;
+  Write(BigString("foo", n));
+  Write("bar");
+  ASSERT_EQ(kBlockSize + kRecyclableHeaderSize + 3, WrittenBytes());
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST_F(LogTest, RecycledLogStopsAtOldRecords) {
+  RecycleAs(7);
+  Write(BigString("old", 100000));
+  Write("stale");
+  RecycleAs(8);
+  Write("new");
+  Write(BigString("new", 2 * kBlockSize));
+  ASSERT_EQ("new", Read());
+  ASSERT_EQ(BigString("new", 2 * kBlockSize), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecycledLogWithoutNewRecords) {
+  RecycleAs(7);
+  Write("stale");
+  Write(BigString("stale", 100000));
+  RecycleAs(8);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST_F(LogTest, RecycledLogReportsCorruption) {
+  RecycleAs(7);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  Write("baz");
+  // Corrupt the payload of the first record.  The rest of its block is
+  // dropped, but the log goes on, so the drop must still be reported.
+  IncrementByte(kRecyclableHeaderSize, 1);
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_LE(kBlockSize, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+TEST_F(LogTest, RecycledLogTornTail) {
+  RecycleAs(7);
+  Write("foo");
+  Write("bar");
+  // A torn last record over the end of the file is not a corruption.
+  IncrementByte(WrittenBytes() - 1, 1);
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
 TEST_F(LogTest, ReadStart) { CheckInitialOffsetRecord(0, 0); }
 
 TEST_F(LogTest, ReadSecondOneOff) { CheckInitialOffsetRecord(1, 1); }
@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -20,12 +21,21 @@ namespace leveldb {
             }
         }
 
-        Writer::Writer(WritableFile *dest) : dest_(dest), block_offset_(0) {
+        Writer::Writer(WritableFile *dest, CompressionType compression, uint64_t recycle_log_number)
+                : dest_(dest),
+                  block_offset_(0),
+                  log_number_(static_cast<uint32_t>(recycle_log_number)),
+                  header_size_(recycle_log_number != 0 ? kRecyclableHeaderSize : kHeaderSize),
+                  compression_(compression) {
             InitTypeCrc(type_crc_);
         }
 
-        Writer::Writer(WritableFile *dest, uint64_t dest_length)
-                : dest_(dest), block_offset_(dest_length % kBlockSize) {
+        Writer::Writer(WritableFile *dest, uint64_t dest_length, CompressionType compression)
+                : dest_(dest),
+                  block_offset_(dest_length % kBlockSize),
+                  log_number_(0),
+                  header_size_(kHeaderSize),
+                  compression_(compression) {
             InitTypeCrc(type_crc_);
         }
 
@@ -39,6 +49,32 @@ namespace leveldb {
          * @return
          */
         Status Writer::AddRecord(const Slice &slice) {
+            if (compression_ != kNoCompression && CompressRecord(slice)) {
+                return EmitRecord(Slice(compressed_), true);
+            }
+            return EmitRecord(slice, false);
+        }
+
+        bool Writer::CompressRecord(const Slice &slice) {
+            switch (compression_) {
+                case kSnappyCompression:
+                    if (!port::Snappy_Compress(slice.data(), slice.size(), &compressed_)) {
+                        return false;  // Snappy not supported
+                    }
+                    break;
+                default:
+                    return false;
+            }
+            // Same rule as for table blocks: keep the record uncompressed
+            // unless compression saves at least 12.5%.
+            if (compressed_.size() + 1 >= slice.size() - (slice.size() / 8u)) {
+                return false;
+            }
+            compressed_.push_back(static_cast<char>(compression_));
+            return true;
+        }
+
+        Status Writer::EmitRecord(const Slice &slice, bool compressed) {
             const char *ptr = slice.data();
             size_t left = slice.size();
 
@@ -51,22 +87,22 @@ namespace leveldb {
                 const int leftover = kBlockSize - block_offset_;
 
                 assert(leftover >= 0); // 表示块中还有空间
-                if (leftover < kHeaderSize) { // 如果当前块的大小小于块头所需要的空间
-                    // leftover 大于0，表示当前块中还有空间，但不到 7 字节
+                if (leftover < header_size_) { // 如果当前块的大小小于块头所需要的空间
+                    // leftover 大于0，表示当前块中还有空间，但放不下一个头
                     if (leftover > 0) {
-                        // 如果当前 block 剩下的空间已经不足 7 字节
-                        static_assert(kHeaderSize == 7, "");
+                        // 如果当前 block 剩下的空间已经不足一个头（7 或 11 字节）
+                        static_assert(kRecyclableHeaderSize == 11, "");
                         // 通过 x00 填完剩余空间
-                        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+                        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", leftover));
                     }
                     block_offset_ = 0;
                 }
 
                 // 确保块中的数据全被使用上
-                assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+                assert(kBlockSize - block_offset_ - header_size_ >= 0);
 
                 // 除去已经使用的和头占用的空间后，剩余的空间
-                const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+                const size_t avail = kBlockSize - block_offset_ - header_size_;
                 // 碎片的长度，如果长度超出块的大小，那大小以块的大小为准。
                 // 如果碎片长度小于快的大小，那大小以碎片的大小为准。
                 const size_t fragment_length = (left < avail) ? left : avail;
@@ -77,10 +113,10 @@ namespace leveldb {
                 const bool end = (left == fragment_length);
                 if (begin && end) {
                     /** 当前记录的开始和结束都在当前 block，则为 kFullType */
-                    type = kFullType;
+                    type = compressed ? kCompressedFullType : kFullType;
                 } else if (begin) {
                     /** 当前记录的开始字段在当前 block，则为kFirstType */
-                    type = kFirstType;
+                    type = compressed ? kCompressedFirstType : kFirstType;
                 } else if (end) {
                     /** 当前记录的结束位置在当前 block，则为kLastType */
                     type = kLastType;
@@ -89,6 +125,10 @@ namespace leveldb {
                     type = kMiddleType;
                 }
 
+                if (header_size_ == kRecyclableHeaderSize) {
+                    type = static_cast<RecordType>(type + kRecyclableTypeOffset);
+                }
+
                 s = EmitPhysicalRecord(type, ptr, fragment_length);
                 ptr += fragment_length; // 表示
                 left -= fragment_length;
@@ -108,12 +148,12 @@ namespace leveldb {
             // 必须容纳两个字节
             assert(length <= 0xffff);
             // 这里是限制，确保数据永远不会超过一个 block 的大小
-            assert(block_offset_ + kHeaderSize + length <= kBlockSize);
+            assert(block_offset_ + header_size_ + length <= kBlockSize);
 
             // LevelDB 是一种小端写磁盘的情况
             // LevelDB 使用的是小端字节序存储，低位字节排放在内存的低地址端
             // buf前面那个int是用来存放crc32的。
-            char buf[kHeaderSize];
+            char buf[kRecyclableHeaderSize];
             // 写入长度: 这里先写入低8位
             buf[4] = static_cast<char>(length & 0xff);
             // 再写入高8位
@@ -121,13 +161,18 @@ namespace leveldb {
             // 再写入类型
             buf[6] = static_cast<char>(t);
 
-            // 计算记录类型和有效负载的 crc
-            uint32_t crc = crc32c::Extend(type_crc_[t], ptr, length);
+            // 计算记录类型（及日志编号）和有效负载的 crc
+            uint32_t crc = type_crc_[t];
+            if (header_size_ == kRecyclableHeaderSize) {
+                EncodeFixed32(buf + kHeaderSize, log_number_);
+                crc = crc32c::Extend(crc, buf + kHeaderSize, 4);
+            }
+            crc = crc32c::Extend(crc, ptr, length);
             crc = crc32c::Mask(crc); // 调成存储空间
             EncodeFixed32(buf, crc);
 
             // 写入 Header
-            Status s = dest_->Append(Slice(buf, kHeaderSize));
+            Status s = dest_->Append(Slice(buf, header_size_));
             if (s.ok()) {
                 // 写入 内容
                 s = dest_->Append(Slice(ptr, length));
@@ -137,7 +182,7 @@ namespace leveldb {
                 }
             }
             // 在一个 block 里面的写入位置往前移。
-            block_offset_ += kHeaderSize + length;
+            block_offset_ += header_size_ + length;
             return s;
         }
 
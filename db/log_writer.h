@@ -7,7 +7,10 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -22,12 +25,18 @@ namespace leveldb {
             // 创建一个将数据附加到 "*dest" 的编写器。
             // "*dest" must be initially empty.
             // "*dest" must remain live while this Writer is in use.
-            explicit Writer(WritableFile *dest);
+            // Records are compressed with "compression" when that saves
+            // enough space.
+            // If "recycle_log_number" is non-zero, records are written in the
+            // recyclable format tagged with that log number, which lets "*dest"
+            // be an obsolete log file that is being written over.
+            explicit Writer(WritableFile *dest, CompressionType compression = kNoCompression,
+                            uint64_t recycle_log_number = 0);
 
             // Create a writer that will append data to "*dest".
             // "*dest" must have initial length "dest_length".
             // "*dest" must remain live while this Writer is in use.
-            Writer(WritableFile *dest, uint64_t dest_length);
+            Writer(WritableFile *dest, uint64_t dest_length, CompressionType compression = kNoCompression);
 
             Writer(const Writer &) = delete;
 
@@ -38,10 +47,20 @@ namespace leveldb {
             Status AddRecord(const Slice &slice);
 
         private:
+            // Compress "slice" into compressed_.  Returns false if that is not
+            // worth it, in which case the record is written as is.
+            bool CompressRecord(const Slice &slice);
+
+            Status EmitRecord(const Slice &slice, bool compressed);
+
             Status EmitPhysicalRecord(RecordType type, const char *ptr, size_t length);
 
             WritableFile *dest_;
             int block_offset_;  // 当前在块中的偏移量
+            const uint32_t log_number_;  // 可回收格式下写入头部的日志编号，0 表示旧格式
+            const int header_size_;
+            const CompressionType compression_;
+            std::string compressed_;  // 压缩后的记录，跨调用复用以减少分配
 
             // crc32c values for all supported record types.  These are
             // pre-computed to reduce the overhead of computing the crc of the
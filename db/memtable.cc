@@ -4,6 +4,8 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_del_aggregator.h"
+#include "db/skiplist_rep.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -18,18 +20,50 @@ namespace leveldb {
         return Slice(p, len);
     }
 
+    // 估算布隆过滤器的键数时假设每个条目平均占用的 arena 字节数。
+    // 条目更小时过滤器会自行增长，只是误判率略高。
+    static const size_t kBloomBytesPerEntry = 64;
+
+    static DynamicBloom *NewBloom(Arena *arena, int bits_per_key, size_t expected_size) {
+        if (bits_per_key <= 0) {
+            return nullptr;
+        }
+        const size_t expected_keys = expected_size / kBloomBytesPerEntry;
+        return new DynamicBloom(arena, bits_per_key, expected_keys > 1024 ? expected_keys : 1024);
+    }
+
     /**
      * 内存表
      * @param comparator
      */
-    MemTable::MemTable(const InternalKeyComparator &comparator) :
+    MemTable::MemTable(const InternalKeyComparator &comparator) : MemTable(comparator, Options()) {}
+
+    MemTable::MemTable(const InternalKeyComparator &comparator, const Options &options) :
             comparator_(comparator),
             refs_(0),
-            table_(comparator_, &arena_) {}
+            arena_(options.arena_block_size, options.memtable_use_mmap ? options.write_buffer_size : 0),
+            // 默认表示直接以具体的 KeyComparator 实例化，使跳表的比较是静态调用
+            table_(options.memtable_factory != nullptr
+                   ? options.memtable_factory->CreateMemTableRep(comparator_, &arena_)
+                   : new SkipListRep<KeyComparator>(comparator_, &arena_)),
+            range_del_table_(new SkipListRep<KeyComparator>(comparator_, &arena_)),
+            has_range_deletions_(false),
+            bloom_(NewBloom(&arena_, options.memtable_bloom_bits_per_key, options.write_buffer_size)),
+            merge_operator_(options.merge_operator) {}
+
+    MemTable::~MemTable() {
+        assert(refs_ == 0);
+        delete table_;
+        delete range_del_table_;
+        delete bloom_;
+    }
 
-    MemTable::~MemTable() { assert(refs_ == 0); }
+    size_t MemTable::ApproximateMemoryUsage() {
+        return arena_.MemoryUsage() + table_->ApproximateMemoryUsage() + range_del_table_->ApproximateMemoryUsage();
+    }
 
-    size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+    MemTable::KeyComparator::KeyComparator(const InternalKeyComparator &c)
+            : comparator(c), bytewise(c.user_comparator() == BytewiseComparator()) {}
 
     int MemTable::KeyComparator::operator()(const char *aptr, const char *bptr) const {
         // Internal keys are encoded as length-prefixed strings.
@@ -38,6 +72,25 @@ namespace leveldb {
         return comparator.Compare(a, b);
     }
 
+    Slice MemTable::KeyComparator::UserKey(const char *entry) const {
+        return ExtractUserKey(GetLengthPrefixedSlice(entry));
+    }
+
+    uint64_t MemTable::KeyComparator::KeyPrefix(const char *entry) const {
+        if (!bytewise) {
+            return 0;
+        }
+        // 用户键的前 8 个字节按大端序拼成整数，不足 8 字节补 0。
+        // 补 0 可能让不同的键得到相同的前缀，但前缀不同时顺序一定与键相同。
+        const Slice user_key = UserKey(entry);
+        const size_t n = user_key.size() < 8 ? user_key.size() : 8;
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < n; i++) {
+            prefix |= static_cast<uint64_t>(static_cast<uint8_t>(user_key[i])) << (56 - 8 * i);
+        }
+        return prefix;
+    }
+
     // Encode a suitable internal key target for "target" and return it.
     // Uses *scratch as scratch space, and the returned pointer will point
     // into this scratch space.
@@ -50,44 +103,51 @@ namespace leveldb {
 
     class MemTableIterator : public Iterator {
     public:
-        explicit MemTableIterator(MemTable::Table *table) : iter_(table) {}
+        explicit MemTableIterator(MemTableRep *table) : iter_(table->NewIterator()) {}
 
         MemTableIterator(const MemTableIterator &) = delete;
 
         MemTableIterator &operator=(const MemTableIterator &) = delete;
 
-        ~MemTableIterator() override = default;
+        ~MemTableIterator() override { delete iter_; }
 
-        bool Valid() const override { return iter_.Valid(); }
+        bool Valid() const override { return iter_->Valid(); }
 
-        void Seek(const Slice &k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
+        void Seek(const Slice &k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
 
-        void SeekToFirst() override { iter_.SeekToFirst(); }
+        void SeekToFirst() override { iter_->SeekToFirst(); }
 
-        void SeekToLast() override { iter_.SeekToLast(); }
+        void SeekToLast() override { iter_->SeekToLast(); }
 
-        void Next() override { iter_.Next(); }
+        void Next() override { iter_->Next(); }
 
-        void Prev() override { iter_.Prev(); }
+        void Prev() override { iter_->Prev(); }
 
-        Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+        Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
 
         Slice value() const override {
-            Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+            Slice key_slice = GetLengthPrefixedSlice(iter_->key());
             return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
         }
 
         Status status() const override { return Status::OK(); }
 
     private:
-        MemTable::Table::Iterator iter_;
+        MemTableRep::Iterator *const iter_;
         std::string tmp_;  // For passing to EncodeKey
     };
 
     /**
      * @return
      */
-    Iterator *MemTable::NewIterator() { return new MemTableIterator(&table_); }
+    Iterator *MemTable::NewIterator() { return new MemTableIterator(table_); }
+
+    Iterator *MemTable::NewRangeTombstoneIterator() {
+        if (!has_range_deletions_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return new MemTableIterator(range_del_table_);
+    }
 
     /**
      * @param s
@@ -95,20 +155,25 @@ namespace leveldb {
      * @param key
      * @param value
      */
-    void MemTable::Add(SequenceNumber s, ValueType type, const Slice &key, const Slice &value) {
+    void MemTable::Add(SequenceNumber s, ValueType type, const Slice &key, const Slice &value,
+                       bool concurrent) {
         // 条目的格式是以下内容的串联
         // Format of an entry is concatenation of:
         //  key_size     : varint32 of internal_key.size()
         //  key bytes    : char[internal_key.size()]
         //  value_size   : varint32 of value.size()
         //  value bytes  : char[value.size()]
+        if (type == kTypeRangeDeletion &&
+            comparator_.comparator.user_comparator()->Compare(key, value) >= 0) {
+            return;  // 空范围不删除任何键
+        }
         size_t key_size = key.size();
         size_t val_size = value.size();
         size_t internal_key_size = key_size + 8; // 内部秘钥大小
         // 编码长度
         const size_t encoded_len =
                 VarintLength(internal_key_size) + internal_key_size + VarintLength(val_size) + val_size;
-        char *buf = arena_.Allocate(encoded_len);
+        char *buf = concurrent ? arena_.AllocateConcurrently(encoded_len) : arena_.Allocate(encoded_len);
         char *p = EncodeVarint32(buf, internal_key_size);
         // 给 key 开辟一块内存
         memcpy(p, key.data(), key_size);
@@ -119,14 +184,42 @@ namespace leveldb {
         // 开辟内存
         memcpy(p, value.data(), val_size);
         assert(p + val_size == buf + encoded_len);
-        table_.Insert(buf);
+        if (type == kTypeRangeDeletion) {
+            if (concurrent) {
+                range_del_table_->InsertConcurrently(buf);
+            } else {
+                range_del_table_->Insert(buf);
+            }
+            has_range_deletions_.store(true, std::memory_order_release);
+            return;
+        }
+        // 先更新过滤器，使读者看到条目时也能看到它的键
+        if (bloom_ != nullptr) {
+            bloom_->Add(key, concurrent);
+        }
+        if (concurrent) {
+            table_->InsertConcurrently(buf);
+        } else {
+            table_->Insert(buf);
+        }
     }
 
-    bool MemTable::Get(const LookupKey &key, std::string *value, Status *s) {
+    bool MemTable::Get(const LookupKey &key, std::string *value, Status *s, MergeContext *merge_context,
+                       SequenceNumber *max_covering_tombstone_seq) {
+        if (has_range_deletions_.load(std::memory_order_acquire)) {
+            MemTableIterator iter(range_del_table_);
+            const SequenceNumber seq = MaxCoveringTombstoneSeq(&iter, comparator_.comparator.user_comparator(),
+                                                               key.user_key(), key.sequence());
+            if (seq > *max_covering_tombstone_seq) {
+                *max_covering_tombstone_seq = seq;
+            }
+        }
+        if (bloom_ != nullptr && !bloom_->MayContain(key.user_key())) {
+            return false;
+        }
         Slice memkey = key.memtable_key();
-        Table::Iterator iter(&table_);
-        iter.Seek(memkey.data());
-        if (iter.Valid()) {
+        const char *entry = table_->Lookup(memkey.data());
+        while (entry != nullptr) {
             // entry format is:
             //    klength  varint32
             //    userkey  char[klength]
@@ -134,27 +227,56 @@ namespace leveldb {
             //    vlength  varint32
             //    value    char[vlength]
             // Check that it belongs to same user key.  We do not check the
-            // sequence number since the Seek() call above should have skipped
+            // sequence number since the Lookup() call above should have skipped
             // all entries with overly large sequence numbers.
-            const char *entry = iter.key();
             uint32_t key_length;
             const char *key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
             if (comparator_.comparator.user_comparator()->Compare(
-                    Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-                // Correct user key
-                const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-                switch (static_cast<ValueType>(tag & 0xff)) {
-                    case kTypeValue: {
-                        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+                    Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+                break;
+            }
+            // Correct user key
+            const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+            ValueType type = static_cast<ValueType>(tag & 0xff);
+            if ((tag >> 8) < *max_covering_tombstone_seq) {
+                // 被更新的范围删除覆盖
+                type = kTypeDeletion;
+            }
+            switch (type) {
+                case kTypeValue: {
+                    Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+                    if (merge_context->empty()) {
                         value->assign(v.data(), v.size());
-                        return true;
+                    } else {
+                        *s = merge_context->Merge(merge_operator_, key.user_key(), &v, value);
                     }
-                    case kTypeDeletion:
+                    return true;
+                }
+                case kTypeDeletion:
+                case kTypeSingleDeletion:
+                    if (merge_context->empty()) {
                         *s = Status::NotFound(Slice());
-                        return true;
+                    } else {
+                        *s = merge_context->Merge(merge_operator_, key.user_key(), nullptr, value);
+                    }
+                    return true;
+                case kTypeMerge: {
+                    merge_context->PushOlderOperand(GetLengthPrefixedSlice(key_ptr + key_length));
+                    const SequenceNumber seq = tag >> 8;
+                    if (seq == 0) {
+                        return false;
+                    }
+                    // 用 Lookup() 而不是迭代器找同一用户键下更旧的条目，这样所有表示都只需要点查
+                    LookupKey older(key.user_key(), seq - 1);
+                    entry = table_->Lookup(older.memtable_key().data());
+                    break;
                 }
+                default:
+                    *s = Status::Corruption("unknown value type in memtable for ", key.user_key());
+                    return true;
             }
         }
+        // 没有找到，或者只找到了合并操作数：调用方继续在更旧的数据中查找
         return false;
     }
 
@@ -5,12 +5,16 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/merge_context.h"
 #include "leveldb/db.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/options.h"
 #include "util/arena.h"
+#include "util/dynamic_bloom.h"
 
 namespace leveldb {
 
@@ -23,6 +27,10 @@ namespace leveldb {
         // MemTables 被引用计数。初始引用计数为零，并且调用方必须至少调用一次 Ref()。
         explicit MemTable(const InternalKeyComparator &comparator);
 
+        // A memtable set up by the memtable options in options (representation,
+        // bloom filter, arena), sized for about options.write_buffer_size bytes.
+        MemTable(const InternalKeyComparator &comparator, const Options &options);
+
         MemTable(const MemTable &) = delete;
 
         MemTable &operator=(const MemTable &) = delete;
@@ -43,6 +51,10 @@ namespace leveldb {
         // data structure. It is safe to call when MemTable is being modified.
         size_t ApproximateMemoryUsage();
 
+        // Returns the number of bytes of the arena mapped with mmap(), which
+        // ApproximateMemoryUsage() includes (see Options::memtable_use_mmap).
+        size_t MappedBytes() const { return arena_.MappedBytes(); }
+
         // Return an iterator that yields the contents of the memtable.
         //
         // The caller must ensure that the underlying MemTable remains live
@@ -51,38 +63,71 @@ namespace leveldb {
         // db/format.{h,cc} module.
         Iterator *NewIterator();
 
+        // Return an iterator over the range tombstones of the memtable, or
+        // nullptr if it has none.  Entries are encoded like the ones of
+        // NewIterator(): the internal key of the start of the range, then
+        // its end.  Same lifetime requirements as NewIterator().
+        Iterator *NewRangeTombstoneIterator();
+
         // Add an entry into memtable that maps key to value at the
         // specified sequence number and with the specified type.
-        // Typically value will be empty if type==kTypeDeletion.
-        void Add(SequenceNumber seq, ValueType type, const Slice &key, const Slice &value);
+        // Typically value will be empty if type==kTypeDeletion.  For
+        // type==kTypeRangeDeletion, key and value are the start and the end
+        // of the deleted range.
+        //
+        // If concurrent is true, other threads may be adding entries with
+        // concurrent == true at the same time.  Calls with concurrent == false
+        // require external synchronization against all other Add() calls.
+        void Add(SequenceNumber seq, ValueType type, const Slice &key, const Slice &value,
+                 bool concurrent = false);
 
         // If memtable contains a value for key, store it in *value and return true.
         // If memtable contains a deletion for key, store a NotFound() error
         // in *status and return true.
         // Else, return false.
-        bool Get(const LookupKey &key, std::string *value, Status *s);
+        //
+        // Merge operands met on the way are added to *merge_context, and are
+        // combined with the value or deletion if one is found.  If only merge
+        // operands are found, returns false so that the caller looks for the
+        // value under them in older data.
+        //
+        // *max_covering_tombstone_seq is raised to the largest sequence number
+        // of the visible range tombstones covering the key; entries older than
+        // it count as deleted.
+        bool Get(const LookupKey &key, std::string *value, Status *s, MergeContext *merge_context,
+                 SequenceNumber *max_covering_tombstone_seq);
 
     private:
         friend class MemTableIterator;
 
         friend class MemTableBackwardIterator;
 
-        struct KeyComparator {
+        // final：默认表示以它实例化跳表，比较不经过虚函数
+        struct KeyComparator final : public MemTableRep::KeyComparator {
             const InternalKeyComparator comparator;
+            // 只有按字节比较用户键时，用户键的前 8 个字节才是保序的摘要
+            const bool bytewise;
 
-            explicit KeyComparator(const InternalKeyComparator &c) : comparator(c) {}
+            explicit KeyComparator(const InternalKeyComparator &c);
 
-            int operator()(const char *a, const char *b) const;
-        };
+            int operator()(const char *a, const char *b) const override;
 
-        typedef SkipList<const char *, KeyComparator> Table;
+            Slice UserKey(const char *entry) const override;
+
+            uint64_t KeyPrefix(const char *entry) const override;
+        };
 
         ~MemTable();  // Private since only Unref() should be used to delete it
 
         KeyComparator comparator_;
         int refs_;
         Arena arena_;
-        Table table_;
+        MemTableRep *const table_;
+        // 范围删除单独存放，避免点查和迭代在其中穿行
+        MemTableRep *const range_del_table_;
+        std::atomic<bool> has_range_deletions_;
+        DynamicBloom *const bloom_;  // nullptr if disabled
+        const MergeOperator *const merge_operator_;
     };
 
 }  // namespace leveldb
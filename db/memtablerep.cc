@@ -0,0 +1,294 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "db/skiplist_rep.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+    MemTableRep::KeyComparator::~KeyComparator() = default;
+
+    MemTableRep::Iterator::~Iterator() = default;
+
+    MemTableRep::~MemTableRep() = default;
+
+    void MemTableRep::InsertConcurrently(const char *entry) {
+        // 工厂不支持并发插入时不会调用到这里
+        assert(false);
+        Insert(entry);
+    }
+
+    MemTableRepFactory::~MemTableRepFactory() = default;
+
+    namespace {
+
+        class SkipListRepFactory : public MemTableRepFactory {
+        public:
+            const char *Name() const override { return "leveldb.SkipListRep"; }
+
+            MemTableRep *CreateMemTableRep(const MemTableRep::KeyComparator &cmp,
+                                           Allocator *allocator) const override {
+                // 这里只知道比较器的基类，比较要经过虚函数；MemTable 的默认表示不经过工厂
+                return new SkipListRep<MemTableRep::KeyComparator>(cmp, allocator);
+            }
+
+            bool IsInsertConcurrentlySupported() const override { return true; }
+        };
+
+        typedef std::vector<const char *> EntryVector;
+
+        // 遍历一份排好序、之后不再修改的条目快照
+        class SortedVectorIterator : public MemTableRep::Iterator {
+        public:
+            SortedVectorIterator(std::shared_ptr<const EntryVector> entries, const MemTableRep::KeyComparator &cmp)
+                    : entries_(std::move(entries)), cmp_(cmp), pos_(entries_->size()) {}
+
+            bool Valid() const override { return pos_ < entries_->size(); }
+
+            const char *key() const override {
+                assert(Valid());
+                return (*entries_)[pos_];
+            }
+
+            void Next() override {
+                assert(Valid());
+                pos_++;
+            }
+
+            void Prev() override {
+                assert(Valid());
+                pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+            }
+
+            void Seek(const char *target) override {
+                auto iter = std::lower_bound(entries_->begin(), entries_->end(), target,
+                                             [this](const char *a, const char *b) { return cmp_(a, b) < 0; });
+                pos_ = iter - entries_->begin();
+            }
+
+            void SeekToFirst() override { pos_ = 0; }
+
+            void SeekToLast() override { pos_ = entries_->empty() ? 0 : entries_->size() - 1; }
+
+        private:
+            const std::shared_ptr<const EntryVector> entries_;
+            const MemTableRep::KeyComparator &cmp_;
+            size_t pos_;  // == entries_->size() when not valid
+        };
+
+        // 插入时只追加到数组末尾，读取时才排序。
+        // 已排好序的前缀会保留下来，之后只需排序新追加的部分再归并。
+        class VectorRep : public MemTableRep {
+        public:
+            VectorRep(const KeyComparator &cmp, size_t reserved_count) : cmp_(cmp), sorted_count_(0), memory_usage_(0) {
+                entries_.reserve(reserved_count);
+                memory_usage_.store(entries_.capacity() * sizeof(const char *), std::memory_order_relaxed);
+            }
+
+            void Insert(const char *entry) override {
+                MutexLock l(&mutex_);
+                entries_.push_back(entry);
+                memory_usage_.store(entries_.capacity() * sizeof(const char *), std::memory_order_relaxed);
+            }
+
+            void InsertConcurrently(const char *entry) override { Insert(entry); }
+
+            const char *Lookup(const char *target) override {
+                MutexLock l(&mutex_);
+                SortLocked();
+                auto iter = std::lower_bound(entries_.begin(), entries_.end(), target,
+                                             [this](const char *a, const char *b) { return cmp_(a, b) < 0; });
+                return iter == entries_.end() ? nullptr : *iter;
+            }
+
+            // 迭代器拿到的是快照，所以之后的插入不会影响它。没有新插入时多个迭代器共享同一份快照。
+            Iterator *NewIterator() override {
+                MutexLock l(&mutex_);
+                SortLocked();
+                if (snapshot_ == nullptr || snapshot_->size() != entries_.size()) {
+                    snapshot_ = std::make_shared<const EntryVector>(entries_);
+                }
+                return new SortedVectorIterator(snapshot_, cmp_);
+            }
+
+            size_t ApproximateMemoryUsage() override { return memory_usage_.load(std::memory_order_relaxed); }
+
+        private:
+            void SortLocked() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+                if (sorted_count_ == entries_.size()) {
+                    return;
+                }
+                auto less = [this](const char *a, const char *b) { return cmp_(a, b) < 0; };
+                auto mid = entries_.begin() + sorted_count_;
+                std::sort(mid, entries_.end(), less);
+                std::inplace_merge(entries_.begin(), mid, entries_.end(), less);
+                sorted_count_ = entries_.size();
+            }
+
+            const KeyComparator &cmp_;
+            port::Mutex mutex_;
+            EntryVector entries_ GUARDED_BY(mutex_);
+            size_t sorted_count_ GUARDED_BY(mutex_);  // entries_ 中已排序的前缀长度
+            std::shared_ptr<const EntryVector> snapshot_ GUARDED_BY(mutex_);
+            std::atomic<size_t> memory_usage_;
+        };
+
+        class VectorRepFactory : public MemTableRepFactory {
+        public:
+            explicit VectorRepFactory(size_t reserved_count) : reserved_count_(reserved_count) {}
+
+            const char *Name() const override { return "leveldb.VectorRep"; }
+
+            MemTableRep *CreateMemTableRep(const MemTableRep::KeyComparator &cmp,
+                                           Allocator * /*allocator*/) const override {
+                return new VectorRep(cmp, reserved_count_);
+            }
+
+            bool IsInsertConcurrentlySupported() const override { return true; }
+
+        private:
+            const size_t reserved_count_;
+        };
+
+        // 按用户键的前缀把条目散列到多个桶中，每个桶是一个跳表，桶在第一次插入时才创建。
+        // 点查只需搜索一个桶；完整遍历时把所有桶的条目收集起来排序。
+        class HashSkipListRep : public MemTableRep {
+        public:
+            HashSkipListRep(const KeyComparator &cmp, Allocator *arena, size_t prefix_length, size_t bucket_count)
+                    : cmp_(cmp),
+                      arena_(arena),
+                      prefix_length_(prefix_length),
+                      bucket_count_(bucket_count),
+                      buckets_(reinterpret_cast<std::atomic<Bucket *> *>(
+                                       arena->AllocateAligned(sizeof(std::atomic<Bucket *>) * bucket_count))),
+                      num_entries_(0) {
+                for (size_t i = 0; i < bucket_count_; i++) {
+                    new(&buckets_[i]) std::atomic<Bucket *>(nullptr);
+                }
+            }
+
+            ~HashSkipListRep() override {
+                // 桶和条目的内存都属于 arena，这里只需析构
+                for (size_t i = 0; i < bucket_count_; i++) {
+                    Bucket *bucket = buckets_[i].load(std::memory_order_relaxed);
+                    if (bucket != nullptr) {
+                        bucket->~Bucket();
+                    }
+                }
+            }
+
+            void Insert(const char *entry) override {
+                std::atomic<Bucket *> *slot = Slot(cmp_.UserKey(entry));
+                Bucket *bucket = slot->load(std::memory_order_relaxed);
+                if (bucket == nullptr) {
+                    bucket = new(arena_->AllocateAligned(sizeof(Bucket))) Bucket(cmp_, arena_);
+                    // release: 读者看到桶时桶已初始化完毕
+                    slot->store(bucket, std::memory_order_release);
+                }
+                bucket->Insert(entry);
+                num_entries_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void InsertConcurrently(const char *entry) override {
+                std::atomic<Bucket *> *slot = Slot(cmp_.UserKey(entry));
+                Bucket *bucket = slot->load(std::memory_order_acquire);
+                if (bucket == nullptr) {
+                    Bucket *created =
+                            new(arena_->AllocateAlignedConcurrently(sizeof(Bucket))) Bucket(cmp_, arena_, true);
+                    if (slot->compare_exchange_strong(bucket, created, std::memory_order_acq_rel)) {
+                        bucket = created;
+                    } else {
+                        // 另一个线程先创建了这个桶，我们的桶留在 arena 中不再使用
+                        created->~Bucket();
+                    }
+                }
+                bucket->InsertConcurrently(entry);
+                num_entries_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            const char *Lookup(const char *target) override {
+                const Bucket *bucket = Slot(cmp_.UserKey(target))->load(std::memory_order_acquire);
+                if (bucket == nullptr) {
+                    return nullptr;
+                }
+                Bucket::Iterator iter(bucket);
+                iter.Seek(target);
+                return iter.Valid() ? iter.key() : nullptr;
+            }
+
+            Iterator *NewIterator() override {
+                auto entries = std::make_shared<EntryVector>();
+                entries->reserve(num_entries_.load(std::memory_order_relaxed));
+                for (size_t i = 0; i < bucket_count_; i++) {
+                    const Bucket *bucket = buckets_[i].load(std::memory_order_acquire);
+                    if (bucket == nullptr) {
+                        continue;
+                    }
+                    Bucket::Iterator iter(bucket);
+                    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+                        entries->push_back(iter.key());
+                    }
+                }
+                std::sort(entries->begin(), entries->end(),
+                          [this](const char *a, const char *b) { return cmp_(a, b) < 0; });
+                return new SortedVectorIterator(std::move(entries), cmp_);
+            }
+
+        private:
+            typedef SkipList<const char *, const KeyComparator &> Bucket;
+
+            std::atomic<Bucket *> *Slot(const Slice &user_key) const {
+                const size_t n = std::min(user_key.size(), prefix_length_);
+                return &buckets_[Hash(user_key.data(), n, 0) % bucket_count_];
+            }
+
+            const KeyComparator &cmp_;
+            Allocator *const arena_;
+            const size_t prefix_length_;
+            const size_t bucket_count_;
+            std::atomic<Bucket *> *const buckets_;
+            std::atomic<size_t> num_entries_;  // 只用于预留遍历时的空间
+        };
+
+        class HashSkipListRepFactory : public MemTableRepFactory {
+        public:
+            HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+                    : prefix_length_(prefix_length), bucket_count_(bucket_count > 0 ? bucket_count : 1) {}
+
+            const char *Name() const override { return "leveldb.HashSkipListRep"; }
+
+            MemTableRep *CreateMemTableRep(const MemTableRep::KeyComparator &cmp,
+                                           Allocator *allocator) const override {
+                return new HashSkipListRep(cmp, allocator, prefix_length_, bucket_count_);
+            }
+
+            bool IsInsertConcurrentlySupported() const override { return true; }
+
+        private:
+            const size_t prefix_length_;
+            const size_t bucket_count_;
+        };
+
+    }  // namespace
+
+    MemTableRepFactory *NewSkipListRepFactory() { return new SkipListRepFactory; }
+
+    MemTableRepFactory *NewVectorRepFactory(size_t reserved_count) { return new VectorRepFactory(reserved_count); }
+
+    MemTableRepFactory *NewHashSkipListRepFactory(size_t prefix_length, size_t bucket_count) {
+        return new HashSkipListRepFactory(prefix_length, bucket_count);
+    }
+
+}  // namespace leveldb
@@ -0,0 +1,200 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/memtablerep.h"
+
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/arena.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+    // Entries are NUL-terminated strings, and the whole entry is the user key.
+    class StringComparator : public MemTableRep::KeyComparator {
+    public:
+        int operator()(const char *a, const char *b) const override { return strcmp(a, b); }
+
+        Slice UserKey(const char *entry) const override { return Slice(entry); }
+    };
+
+    class MemTableRepTest : public testing::Test {
+    public:
+        MemTableRepTest() {
+            factories_.emplace_back(NewSkipListRepFactory());
+            factories_.emplace_back(NewVectorRepFactory(16));
+            factories_.emplace_back(NewHashSkipListRepFactory(1, 7));
+        }
+
+        // Return an entry allocated from arena.
+        static const char *NewEntry(Arena *arena, const std::string &key) {
+            char *entry = arena->Allocate(key.size() + 1);
+            memcpy(entry, key.c_str(), key.size() + 1);
+            return entry;
+        }
+
+        static std::string Key(int i) {
+            char buf[100];
+            snprintf(buf, sizeof(buf), "%c%06d", 'a' + i % 26, i);
+            return buf;
+        }
+
+        std::vector<std::unique_ptr<MemTableRepFactory>> factories_;
+        StringComparator cmp_;
+    };
+
+    TEST_F(MemTableRepTest, Empty) {
+        for (const auto &factory : factories_) {
+            Arena arena;
+            std::unique_ptr<MemTableRep> rep(factory->CreateMemTableRep(cmp_, &arena));
+            ASSERT_EQ(nullptr, rep->Lookup("foo")) << factory->Name();
+            std::unique_ptr<MemTableRep::Iterator> iter(rep->NewIterator());
+            ASSERT_TRUE(!iter->Valid());
+            iter->SeekToFirst();
+            ASSERT_TRUE(!iter->Valid());
+            iter->Seek("foo");
+            ASSERT_TRUE(!iter->Valid());
+            iter->SeekToLast();
+            ASSERT_TRUE(!iter->Valid());
+        }
+    }
+
+    TEST_F(MemTableRepTest, InsertAndLookup) {
+        const int N = 2000;
+        for (const auto &factory : factories_) {
+            Random rnd(301);
+            std::set<std::string> keys;
+            Arena arena;
+            std::unique_ptr<MemTableRep> rep(factory->CreateMemTableRep(cmp_, &arena));
+            for (int i = 0; i < N; i++) {
+                std::string key = Key(rnd.Uniform(5000));
+                if (keys.insert(key).second) {
+                    rep->Insert(NewEntry(&arena, key));
+                }
+            }
+
+            for (int i = 0; i < 5000; i++) {
+                const std::string key = Key(i);
+                const char *entry = rep->Lookup(key.c_str());
+                if (keys.count(key)) {
+                    ASSERT_TRUE(entry != nullptr) << factory->Name() << " " << key;
+                    ASSERT_EQ(key, entry);
+                } else {
+                    ASSERT_TRUE(entry == nullptr || key != entry) << factory->Name() << " " << key;
+                }
+            }
+
+            // Forward iteration
+            std::unique_ptr<MemTableRep::Iterator> iter(rep->NewIterator());
+            iter->SeekToFirst();
+            for (const std::string &key : keys) {
+                ASSERT_TRUE(iter->Valid()) << factory->Name();
+                ASSERT_EQ(key, iter->key());
+                iter->Next();
+            }
+            ASSERT_TRUE(!iter->Valid());
+
+            // Backward iteration
+            iter->SeekToLast();
+            for (auto it = keys.rbegin(); it != keys.rend(); ++it) {
+                ASSERT_TRUE(iter->Valid()) << factory->Name();
+                ASSERT_EQ(*it, iter->key());
+                iter->Prev();
+            }
+            ASSERT_TRUE(!iter->Valid());
+
+            // Seek
+            for (int i = 0; i < 100; i++) {
+                const std::string target = Key(rnd.Uniform(5000));
+                iter->Seek(target.c_str());
+                auto it = keys.lower_bound(target);
+                if (it == keys.end()) {
+                    ASSERT_TRUE(!iter->Valid());
+                } else {
+                    ASSERT_TRUE(iter->Valid());
+                    ASSERT_EQ(*it, iter->key());
+                }
+            }
+        }
+    }
+
+    TEST_F(MemTableRepTest, IteratorSurvivesInserts) {
+        for (const auto &factory : factories_) {
+            Arena arena;
+            std::unique_ptr<MemTableRep> rep(factory->CreateMemTableRep(cmp_, &arena));
+            for (int i = 0; i < 100; i += 2) {
+                rep->Insert(NewEntry(&arena, Key(i)));
+            }
+            std::unique_ptr<MemTableRep::Iterator> iter(rep->NewIterator());
+            for (int i = 1; i < 100; i += 2) {
+                rep->Insert(NewEntry(&arena, Key(i)));
+            }
+
+            // The iterator sees at least the entries inserted before it, in
+            // order, whatever the inserts made after it.
+            std::string prev;
+            int count = 0;
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                ASSERT_LT(prev, iter->key()) << factory->Name();
+                prev = iter->key();
+                count++;
+            }
+            ASSERT_GE(count, 50) << factory->Name();
+
+            std::unique_ptr<MemTableRep::Iterator> all(rep->NewIterator());
+            count = 0;
+            for (all->SeekToFirst(); all->Valid(); all->Next()) {
+                count++;
+            }
+            ASSERT_EQ(100, count) << factory->Name();
+        }
+    }
+
+    TEST_F(MemTableRepTest, ConcurrentInsert) {
+        const int kThreads = 4;
+        const int kPerThread = 2000;
+        for (const auto &factory : factories_) {
+            ASSERT_TRUE(factory->IsInsertConcurrentlySupported());
+            Arena arena;
+            std::unique_ptr<MemTableRep> rep(factory->CreateMemTableRep(cmp_, &arena));
+            std::vector<std::vector<const char *>> entries(kThreads);
+            for (int t = 0; t < kThreads; t++) {
+                for (int i = 0; i < kPerThread; i++) {
+                    entries[t].push_back(NewEntry(&arena, Key(i * kThreads + t)));
+                }
+            }
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < kThreads; t++) {
+                threads.emplace_back([&rep, &entries, t]() {
+                    for (const char *entry : entries[t]) {
+                        rep->InsertConcurrently(entry);
+                    }
+                });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+
+            for (int i = 0; i < kThreads * kPerThread; i++) {
+                const std::string key = Key(i);
+                const char *entry = rep->Lookup(key.c_str());
+                ASSERT_TRUE(entry != nullptr) << factory->Name() << " " << key;
+                ASSERT_EQ(key, entry);
+            }
+        }
+    }
+
+}  // namespace leveldb
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_context.h"
+
+#include <vector>
+
+namespace leveldb {
+
+    Status MergeContext::Merge(const MergeOperator *merge_operator, const Slice &user_key, const Slice *base,
+                               std::string *value) const {
+        if (merge_operator == nullptr) {
+            return Status::InvalidArgument("merge operand found but Options::merge_operator is not set",
+                                           user_key);
+        }
+        // 合并操作符要求操作数按写入顺序（从旧到新）排列
+        std::vector<Slice> operands;
+        operands.reserve(operands_.size());
+        for (auto iter = operands_.rbegin(); iter != operands_.rend(); ++iter) {
+            operands.emplace_back(*iter);
+        }
+        std::string result;
+        if (!merge_operator->FullMerge(user_key, base, operands, &result)) {
+            return Status::Corruption("merge operator failed for ", user_key);
+        }
+        value->swap(result);
+        return Status::OK();
+    }
+
+}  // namespace leveldb
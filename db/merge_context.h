@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+#define STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+
+#include <deque>
+#include <string>
+
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    // The merge operands of one user key collected so far by a read or a
+    // compaction, until it reaches the value they were written on top of.
+    class MergeContext {
+    public:
+        MergeContext() = default;
+
+        MergeContext(const MergeContext &) = delete;
+
+        MergeContext &operator=(const MergeContext &) = delete;
+
+        bool empty() const { return operands_.empty(); }
+
+        size_t size() const { return operands_.size(); }
+
+        // operand(0) is the newest operand.
+        const std::string &operand(size_t i) const { return operands_[i]; }
+
+        void Clear() { operands_.clear(); }
+
+        // Add an operand older than all operands added so far.
+        void PushOlderOperand(const Slice &operand) {
+            operands_.emplace_back(operand.data(), operand.size());
+        }
+
+        // Add an operand newer than all operands added so far.
+        void PushNewerOperand(const Slice &operand) {
+            operands_.emplace_front(operand.data(), operand.size());
+        }
+
+        // Combine the operands with *base (nullptr if the key has no value
+        // under them) and store the result in *value.
+        Status Merge(const MergeOperator *merge_operator, const Slice &user_key, const Slice *base,
+                     std::string *value) const;
+
+    private:
+        // 从新到旧排列，读取和压缩都是从新到旧遇到操作数的
+        std::deque<std::string> operands_;
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
@@ -0,0 +1,150 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del_aggregator.h"
+
+#include <algorithm>
+#include <queue>
+#include <set>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+    bool RangeTombstone::DecodeFrom(const Slice &key, const Slice &value) {
+        ParsedInternalKey ikey;
+        if (!ParseInternalKey(key, &ikey)) {
+            return false;
+        }
+        start.assign(ikey.user_key.data(), ikey.user_key.size());
+        end.assign(value.data(), value.size());
+        seq = ikey.sequence;
+        return true;
+    }
+
+    SequenceNumber MaxCoveringTombstoneSeq(Iterator *iter, const Comparator *ucmp, const Slice &user_key,
+                                           SequenceNumber snapshot) {
+        SequenceNumber result = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            ParsedInternalKey ikey;
+            if (!ParseInternalKey(iter->key(), &ikey)) {
+                continue;
+            }
+            if (ucmp->Compare(ikey.user_key, user_key) > 0) {
+                // 之后的范围都从 user_key 之后开始
+                break;
+            }
+            if (ikey.sequence > result && ikey.sequence <= snapshot && ucmp->Compare(user_key, iter->value()) < 0) {
+                result = ikey.sequence;
+            }
+        }
+        return result;
+    }
+
+    void ExtendBoundsForTombstone(const Comparator *ucmp, const Slice &start, const Slice &end,
+                                  InternalKey *smallest, InternalKey *largest) {
+        // 起点与文件中最小的用户键相同时保留原边界，它已经包含这个用户键
+        if (smallest->empty() || ucmp->Compare(start, smallest->user_key()) < 0) {
+            *smallest = InternalKey(start, kMaxSequenceNumber, kValueTypeForSeek);
+        }
+        if (largest->empty() || ucmp->Compare(end, largest->user_key()) > 0) {
+            *largest = InternalKey(end, kMaxSequenceNumber, kValueTypeForSeek);
+        }
+    }
+
+    RangeDelAggregator::RangeDelAggregator(const Comparator *ucmp, SequenceNumber snapshot)
+            : ucmp_(ucmp), snapshot_(snapshot), fragments_valid_(true) {}
+
+    Status RangeDelAggregator::AddTombstones(Iterator *iter) {
+        Status s;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            RangeTombstone tombstone;
+            if (!tombstone.DecodeFrom(iter->key(), iter->value())) {
+                s = Status::Corruption("corrupted range tombstone key");
+                break;
+            }
+            AddTombstone(tombstone);
+        }
+        if (s.ok()) {
+            s = iter->status();
+        }
+        delete iter;
+        return s;
+    }
+
+    void RangeDelAggregator::AddTombstone(const RangeTombstone &tombstone) {
+        if (tombstone.seq > snapshot_ || ucmp_->Compare(tombstone.start, tombstone.end) >= 0) {
+            return;
+        }
+        tombstones_.push_back(tombstone);
+        fragments_valid_ = false;
+    }
+
+    SequenceNumber RangeDelAggregator::MaxCoveringSeq(const Slice &user_key) {
+        if (tombstones_.empty()) {
+            return 0;
+        }
+        if (!fragments_valid_) {
+            BuildFragments();
+        }
+        // 找到最后一个起点不大于 user_key 的片段
+        auto iter = std::upper_bound(fragments_.begin(), fragments_.end(), user_key,
+                                     [this](const Slice &key, const Fragment &f) {
+                                         return ucmp_->Compare(key, f.start) < 0;
+                                     });
+        if (iter == fragments_.begin()) {
+            return 0;
+        }
+        return (iter - 1)->seq;
+    }
+
+    void RangeDelAggregator::BuildFragments() {
+        // 按起点和终点把所有范围切成互不重叠的片段，每个片段记录覆盖它的最大序列号
+        std::vector<const RangeTombstone *> by_start;
+        std::vector<Slice> boundaries;
+        by_start.reserve(tombstones_.size());
+        boundaries.reserve(2 * tombstones_.size());
+        for (const RangeTombstone &t : tombstones_) {
+            by_start.push_back(&t);
+            boundaries.emplace_back(t.start);
+            boundaries.emplace_back(t.end);
+        }
+        auto slice_less = [this](const Slice &a, const Slice &b) { return ucmp_->Compare(a, b) < 0; };
+        std::sort(by_start.begin(), by_start.end(), [this](const RangeTombstone *a, const RangeTombstone *b) {
+            return ucmp_->Compare(a->start, b->start) < 0;
+        });
+        std::sort(boundaries.begin(), boundaries.end(), slice_less);
+        boundaries.erase(std::unique(boundaries.begin(), boundaries.end(),
+                                     [this](const Slice &a, const Slice &b) { return ucmp_->Compare(a, b) == 0; }),
+                         boundaries.end());
+
+        // 当前覆盖着扫描位置的范围：按终点排列的小根堆，以及它们的序列号
+        auto end_greater = [this](const RangeTombstone *a, const RangeTombstone *b) {
+            return ucmp_->Compare(a->end, b->end) > 0;
+        };
+        std::priority_queue<const RangeTombstone *, std::vector<const RangeTombstone *>, decltype(end_greater)>
+                active(end_greater);
+        std::multiset<SequenceNumber> active_seqs;
+
+        fragments_.clear();
+        size_t next = 0;
+        for (const Slice &boundary : boundaries) {
+            while (!active.empty() && ucmp_->Compare(active.top()->end, boundary) <= 0) {
+                active_seqs.erase(active_seqs.find(active.top()->seq));
+                active.pop();
+            }
+            while (next < by_start.size() && ucmp_->Compare(by_start[next]->start, boundary) <= 0) {
+                active.push(by_start[next]);
+                active_seqs.insert(by_start[next]->seq);
+                next++;
+            }
+            const SequenceNumber seq = active_seqs.empty() ? 0 : *active_seqs.rbegin();
+            if (fragments_.empty() || fragments_.back().seq != seq) {
+                fragments_.push_back(Fragment{boundary.ToString(), seq});
+            }
+        }
+        fragments_valid_ = true;
+    }
+
+}  // namespace leveldb
@@ -0,0 +1,96 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_AGGREGATOR_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_AGGREGATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+    // A range tombstone written by DB::DeleteRange(): it deletes the user
+    // keys in [start, end) written before sequence number seq.  Memtables and
+    // tables store it as an entry from the internal key
+    // (start, seq, kTypeRangeDeletion) to end.
+    struct RangeTombstone {
+        RangeTombstone() : seq(0) {}
+
+        RangeTombstone(const Slice &start, const Slice &end, SequenceNumber seq)
+                : start(start.ToString()), end(end.ToString()), seq(seq) {}
+
+        // Decode a range tombstone entry.  Returns false if key is not a
+        // valid internal key.
+        bool DecodeFrom(const Slice &key, const Slice &value);
+
+        std::string start;
+        std::string end;
+        SequenceNumber seq;
+    };
+
+    // Return the largest sequence number at or below snapshot of the range
+    // tombstones in *iter that cover user_key, or 0 if none of them does.
+    // Scans the tombstones that start at or before user_key, which is cheap
+    // for the few tombstones a memtable or a table usually holds.
+    SequenceNumber MaxCoveringTombstoneSeq(Iterator *iter, const Comparator *ucmp, const Slice &user_key,
+                                           SequenceNumber snapshot);
+
+    // Widen the bounds of a file to the user keys [start, end) of a range
+    // tombstone it holds.  *smallest and *largest are empty if the file has
+    // no other entries yet.  The bound at end is the smallest internal key
+    // of end, so that the file does not claim the entries of end itself.
+    void ExtendBoundsForTombstone(const Comparator *ucmp, const Slice &start, const Slice &end,
+                                  InternalKey *smallest, InternalKey *largest);
+
+    // The range tombstones a DB iterator or a compaction has to apply, with
+    // a lookup of the tombstones covering a user key in logarithmic time.
+    class RangeDelAggregator {
+    public:
+        // Only tombstones at or below snapshot are kept.
+        RangeDelAggregator(const Comparator *ucmp, SequenceNumber snapshot);
+
+        RangeDelAggregator(const RangeDelAggregator &) = delete;
+
+        RangeDelAggregator &operator=(const RangeDelAggregator &) = delete;
+
+        // Add the tombstones yielded by *iter and delete it.
+        Status AddTombstones(Iterator *iter);
+
+        void AddTombstone(const RangeTombstone &tombstone);
+
+        bool empty() const { return tombstones_.empty(); }
+
+        // The tombstones added so far, in the order they were added.
+        const std::vector<RangeTombstone> &tombstones() const { return tombstones_; }
+
+        // Return the largest sequence number of the tombstones covering
+        // user_key, or 0 if none of them does.
+        SequenceNumber MaxCoveringSeq(const Slice &user_key);
+
+        // Whether the entry is deleted by a newer tombstone.
+        bool ShouldDelete(const ParsedInternalKey &ikey) { return MaxCoveringSeq(ikey.user_key) > ikey.sequence; }
+
+    private:
+        // Keys from start up to the start of the next fragment are covered by
+        // tombstones of sequence numbers up to seq (0 if not covered at all).
+        struct Fragment {
+            std::string start;
+            SequenceNumber seq;
+        };
+
+        void BuildFragments();
+
+        const Comparator *const ucmp_;
+        const SequenceNumber snapshot_;
+        std::vector<RangeTombstone> tombstones_;
+        std::vector<Fragment> fragments_;  // Sorted by start, rebuilt lazily
+        bool fragments_valid_;
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_AGGREGATOR_H_
@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del_aggregator.h"
+
+#include <vector>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/comparator.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+    static ParsedInternalKey Entry(const Slice &user_key, SequenceNumber seq) {
+        return ParsedInternalKey(user_key, seq, kTypeValue);
+    }
+
+    static SequenceNumber SequenceOf(const InternalKey &key) {
+        ParsedInternalKey parsed;
+        EXPECT_TRUE(ParseInternalKey(key.Encode(), &parsed));
+        return parsed.sequence;
+    }
+
+    TEST(RangeDelAggregatorTest, Empty) {
+        RangeDelAggregator agg(BytewiseComparator(), kMaxSequenceNumber);
+        ASSERT_TRUE(agg.empty());
+        ASSERT_EQ(0, agg.MaxCoveringSeq("a"));
+        ASSERT_TRUE(!agg.ShouldDelete(Entry("a", 1)));
+
+        // Empty and inverted ranges are ignored
+        agg.AddTombstone(RangeTombstone("b", "b", 5));
+        agg.AddTombstone(RangeTombstone("c", "b", 5));
+        ASSERT_TRUE(agg.empty());
+    }
+
+    TEST(RangeDelAggregatorTest, Overlapping) {
+        RangeDelAggregator agg(BytewiseComparator(), kMaxSequenceNumber);
+        agg.AddTombstone(RangeTombstone("b", "f", 10));
+        agg.AddTombstone(RangeTombstone("d", "h", 20));
+        agg.AddTombstone(RangeTombstone("e", "g", 5));
+
+        ASSERT_EQ(0, agg.MaxCoveringSeq("a"));
+        ASSERT_EQ(10, agg.MaxCoveringSeq("b"));
+        ASSERT_EQ(10, agg.MaxCoveringSeq("c"));
+        ASSERT_EQ(20, agg.MaxCoveringSeq("d"));
+        ASSERT_EQ(20, agg.MaxCoveringSeq("f"));
+        ASSERT_EQ(20, agg.MaxCoveringSeq("gz"));
+        ASSERT_EQ(0, agg.MaxCoveringSeq("h"));
+        ASSERT_EQ(0, agg.MaxCoveringSeq("z"));
+
+        ASSERT_TRUE(agg.ShouldDelete(Entry("c", 9)));
+        ASSERT_TRUE(!agg.ShouldDelete(Entry("c", 10)));
+        ASSERT_TRUE(!agg.ShouldDelete(Entry("c", 11)));
+
+        // Fragments are rebuilt after more tombstones are added
+        agg.AddTombstone(RangeTombstone("a", "c", 30));
+        ASSERT_EQ(30, agg.MaxCoveringSeq("a"));
+        ASSERT_EQ(30, agg.MaxCoveringSeq("b"));
+        ASSERT_EQ(10, agg.MaxCoveringSeq("c"));
+    }
+
+    TEST(RangeDelAggregatorTest, Snapshot) {
+        RangeDelAggregator agg(BytewiseComparator(), 15);
+        agg.AddTombstone(RangeTombstone("a", "z", 10));
+        agg.AddTombstone(RangeTombstone("a", "z", 20));
+        ASSERT_EQ(1, agg.tombstones().size());
+        ASSERT_EQ(10, agg.MaxCoveringSeq("m"));
+    }
+
+    TEST(RangeDelAggregatorTest, ExtendBounds) {
+        const Comparator *ucmp = BytewiseComparator();
+        InternalKey smallest, largest;
+        ExtendBoundsForTombstone(ucmp, "c", "f", &smallest, &largest);
+        ASSERT_EQ("c", smallest.user_key().ToString());
+        ASSERT_EQ("f", largest.user_key().ToString());
+
+        smallest = InternalKey("b", 7, kTypeValue);
+        largest = InternalKey("g", 7, kTypeValue);
+        ExtendBoundsForTombstone(ucmp, "b", "g", &smallest, &largest);
+        ASSERT_EQ(7, SequenceOf(smallest));
+        ASSERT_EQ(7, SequenceOf(largest));
+
+        ExtendBoundsForTombstone(ucmp, "a", "h", &smallest, &largest);
+        ASSERT_EQ("a", smallest.user_key().ToString());
+        ASSERT_EQ("h", largest.user_key().ToString());
+        ASSERT_EQ(kMaxSequenceNumber, SequenceOf(largest));
+    }
+
+    // Compare the fragments against a brute-force scan of the tombstones.
+    TEST(RangeDelAggregatorTest, Randomized) {
+        Random rnd(301);
+        for (int run = 0; run < 20; run++) {
+            RangeDelAggregator agg(BytewiseComparator(), kMaxSequenceNumber);
+            std::vector<RangeTombstone> all;
+            const int n = 1 + rnd.Uniform(30);
+            for (int i = 0; i < n; i++) {
+                std::string start(1, static_cast<char>('a' + rnd.Uniform(26)));
+                std::string end(1, static_cast<char>('a' + rnd.Uniform(26)));
+                RangeTombstone t(start, end, 1 + rnd.Uniform(100));
+                agg.AddTombstone(t);
+                all.push_back(t);
+            }
+            for (char c = 'a' - 1; c <= 'z' + 1; c++) {
+                const std::string key(1, c);
+                SequenceNumber expected = 0;
+                for (const RangeTombstone &t : all) {
+                    if (t.start <= key && key < t.end && t.seq > expected) {
+                        expected = t.seq;
+                    }
+                }
+                ASSERT_EQ(expected, agg.MaxCoveringSeq(key)) << key;
+            }
+        }
+    }
+
+}  // namespace leveldb
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -28,6 +28,7 @@
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_del_aggregator.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
@@ -171,13 +172,13 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false /*do not checksum*/,
-                       0 /*initial_offset*/);
+                       0 /*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
+    MemTable* mem = new MemTable(icmp_, options_);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -203,8 +204,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -281,6 +285,32 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Range tombstones widen the bounds of the table.
+    iter = table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                   t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      RangeTombstone tombstone;
+      if (!tombstone.DecodeFrom(iter->key(), iter->value())) {
+        Log(options_.info_log, "Table #%llu: unparsable range tombstone %s",
+            (unsigned long long)t.meta.number,
+            EscapeString(iter->key()).c_str());
+        continue;
+      }
+
+      counter++;
+      ExtendBoundsForTombstone(icmp_.user_comparator(), tombstone.start,
+                               tombstone.end, &t.meta.smallest,
+                               &t.meta.largest);
+      t.meta.has_range_deletions = true;
+      if (tombstone.seq > t.max_sequence) {
+        t.max_sequence = tombstone.seq;
+      }
+    }
+    if (status.ok() && !iter->status().ok()) {
+      status = iter->status();
+    }
+    delete iter;
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +342,13 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                   t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->AddRangeTombstone(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -369,7 +406,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_deletions);
     }
 
     // fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
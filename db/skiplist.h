@@ -19,14 +19,21 @@
 #include <atomic>
 #include <cassert>
 #include <cstdlib>
+#include <functional>
+#include <thread>
 
+#include "leveldb/allocator.h"
 #include "util/arena.h"
 #include "util/random.h"
 
 namespace leveldb {
 
-    class Arena;
-
+    // Comparator 需要提供两个方法：
+    //   int operator()(const Key &a, const Key &b) const;  三路比较
+    //   uint64_t KeyPrefix(const Key &key) const;
+    // KeyPrefix() 是保序的摘要：KeyPrefix(a) < KeyPrefix(b) 必须意味着 a < b。
+    // 节点把它保存在 next_[] 旁边，这样搜索时的大多数比较不用解引用 key 就能决定。
+    // 对所有 key 返回同一个值就相当于关闭这个优化。
     template<typename Key, class Comparator>
     class SkipList {
     private:
@@ -37,7 +44,12 @@ namespace leveldb {
          * 创建一个新的 SkipList 对象，该对象将使用 "cmp" 比较 key，并使用 "*arena" 分配内存。在舞台上分配的对象必须在跳
          * 过列表对象的生存期内保持分配状态。
          */
-        explicit SkipList(Comparator cmp, Arena *arena);
+        explicit SkipList(Comparator cmp, Allocator *arena);
+
+        // Like the above, but if concurrent is true the list's own memory is
+        // allocated thread-safely, so the list can be created while other
+        // threads are inserting concurrently into lists that share the arena.
+        SkipList(Comparator cmp, Allocator *arena, bool concurrent);
 
         SkipList(const SkipList &) = delete;
 
@@ -47,6 +59,13 @@ namespace leveldb {
         // 要求：Key 不能相同。
         void Insert(const Key &key);
 
+        // Like Insert(), but safe to call from several threads at the same
+        // time: new nodes are linked in with compare-and-swap, so concurrent
+        // inserters need no external synchronization.
+        // REQUIRES: nothing that compares equal to key is currently in the list.
+        // REQUIRES: Insert() is not running at the same time.
+        void InsertConcurrently(const Key &key);
+
         // 如果列表中与键比较相等的条目，则返回 true
         bool Contains(const Key &key) const;
 
@@ -99,21 +118,32 @@ namespace leveldb {
             return max_height_.load(std::memory_order_relaxed);
         }
 
-        Node *NewNode(const Key &key, int height);
+        Node *NewNode(const Key &key, uint64_t prefix, int height);
+
+        Node *NewNodeConcurrently(const Key &key, uint64_t prefix, int height);
 
         int RandomHeight();
 
+        // RandomHeight() for concurrent inserters, which must not share rnd_.
+        int RandomHeightConcurrently();
+
         bool Equal(const Key &a, const Key &b) const { return (compare_(a, b) == 0); }
 
-        // Return true if key is greater than the data stored in "n"
-        bool KeyIsAfterNode(const Key &key, Node *n) const;
+        // Return true if key is greater than the data stored in "n".
+        // prefix is compare_.KeyPrefix(key).
+        bool KeyIsAfterNode(const Key &key, uint64_t prefix, Node *n) const;
 
         // Return the earliest node that comes at or after key.
         // Return nullptr if there is no such node.
         //
         // If prev is non-null, fills prev[level] with pointer to previous
         // node at "level" for every level in [0..max_height_-1].
-        Node *FindGreaterOrEqual(const Key &key, Node **prev) const;
+        Node *FindGreaterOrEqual(const Key &key, uint64_t prefix, Node **prev) const;
+
+        // Starting at "before", which must sort before key, find the nodes
+        // that key falls between at "level" and store them in *prev, *next.
+        void FindSpliceForLevel(const Key &key, uint64_t prefix, Node *before, int level,
+                                Node **prev, Node **next) const;
 
         // Return the latest node with a key < key.
         // Return head_ if there is no such node.
@@ -125,25 +155,39 @@ namespace leveldb {
 
         // Immutable after construction
         Comparator const compare_;
-        Arena *const arena_;  // Arena used for allocations of nodes
+        Allocator *const arena_;  // Used for allocations of nodes
 
         Node *const head_;
 
-        // Modified only by Insert().  Read racily by readers, but stale
-        // values are ok.
+        // Modified only by Insert() and InsertConcurrently().  Read racily by
+        // readers, but stale values are ok.
         std::atomic<int> max_height_;  // Height of the entire list
 
         // Read/written only by Insert().
         Random rnd_;
+
+        // Read/written only by Insert(): where the previous Insert() linked
+        // its node.  hint_prev_[i] is the last node at level i that is not
+        // after that node (the node itself for the levels it spans).  If the
+        // next key falls right after that node, hint_prev_ is also its splice
+        // and the top-down search can be skipped.
+        Node *hint_prev_[kMaxHeight];
+
+        // Set by InsertConcurrently(), whose nodes hint_prev_ does not know
+        // about; cleared by the next full search in Insert().
+        std::atomic<bool> hint_stale_;
     };
 
     // Implementation details follow
     template<typename Key, class Comparator>
     struct SkipList<Key, Comparator>::Node {
-        explicit Node(const Key &k) : key(k) {}
+        Node(const Key &k, uint64_t p) : key(k), prefix(p) {}
 
         Key const key;
 
+        // compare_.KeyPrefix(key)，与 next_[] 在同一缓存行
+        uint64_t const prefix;
+
         // Accessors/mutators for links.  Wrapped in methods so we can
         // add the appropriate barriers as necessary.
         Node *Next(int n) {
@@ -172,15 +216,31 @@ namespace leveldb {
             next_[n].store(x, std::memory_order_relaxed);
         }
 
+        // Publish x as the successor at level n if the current successor is
+        // still "expected".  Release semantics as in SetNext().
+        bool CASNext(int n, Node *expected, Node *x) {
+            assert(n >= 0);
+            return next_[n].compare_exchange_strong(expected, x, std::memory_order_release,
+                                                    std::memory_order_relaxed);
+        }
+
     private:
         // 长度等于节点高度的数组。 next_ [0] 是最低级别的链接。
         std::atomic<Node *> next_[1];
     };
 
     template<typename Key, class Comparator>
-    typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::NewNode(const Key &key, int height) {
+    typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::NewNode(const Key &key, uint64_t prefix, int height) {
         char *const node_memory = arena_->AllocateAligned(sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1));
-        return new(node_memory) Node(key);
+        return new(node_memory) Node(key, prefix);
+    }
+
+    template<typename Key, class Comparator>
+    typename SkipList<Key, Comparator>::Node *
+    SkipList<Key, Comparator>::NewNodeConcurrently(const Key &key, uint64_t prefix, int height) {
+        char *const node_memory =
+                arena_->AllocateAlignedConcurrently(sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1));
+        return new(node_memory) Node(key, prefix);
     }
 
     template<typename Key, class Comparator>
@@ -219,7 +279,7 @@ namespace leveldb {
 
     template<typename Key, class Comparator>
     inline void SkipList<Key, Comparator>::Iterator::Seek(const Key &target) {
-        node_ = list_->FindGreaterOrEqual(target, nullptr);
+        node_ = list_->FindGreaterOrEqual(target, list_->compare_.KeyPrefix(target), nullptr);
     }
 
     template<typename Key, class Comparator>
@@ -249,9 +309,28 @@ namespace leveldb {
     }
 
     template<typename Key, class Comparator>
-    bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key &key, Node *n) const {
+    int SkipList<Key, Comparator>::RandomHeightConcurrently() {
+        static const unsigned int kBranching = 4;
+        static thread_local Random rnd(
+                static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+        int height = 1;
+        while (height < kMaxHeight && ((rnd.Next() % kBranching) == 0)) {
+            height++;
+        }
+        return height;
+    }
+
+    template<typename Key, class Comparator>
+    inline bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key &key, uint64_t prefix, Node *n) const {
         // null n is considered infinite
-        return (n != nullptr) && (compare_(n->key, key) < 0);
+        if (n == nullptr) {
+            return false;
+        }
+        // 前缀不同时不用访问 n->key 就能得出结果
+        if (n->prefix != prefix) {
+            return n->prefix < prefix;
+        }
+        return compare_(n->key, key) < 0;
     }
 
     /**
@@ -264,12 +343,12 @@ namespace leveldb {
      */
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
-    SkipList<Key, Comparator>::FindGreaterOrEqual(const Key &key, Node **prev) const {
+    SkipList<Key, Comparator>::FindGreaterOrEqual(const Key &key, uint64_t prefix, Node **prev) const {
         Node *x = head_;
         int level = GetMaxHeight() - 1;
         while (true) {
             Node *next = x->Next(level);
-            if (KeyIsAfterNode(key, next)) {
+            if (KeyIsAfterNode(key, prefix, next)) {
                 // 继续在这个 list 中搜索
                 x = next;
             } else {
@@ -284,15 +363,31 @@ namespace leveldb {
         }
     }
 
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::FindSpliceForLevel(const Key &key, uint64_t prefix, Node *before, int level,
+                                                       Node **prev, Node **next) const {
+        while (true) {
+            Node *after = before->Next(level);
+            if (KeyIsAfterNode(key, prefix, after)) {
+                before = after;
+            } else {
+                *prev = before;
+                *next = after;
+                return;
+            }
+        }
+    }
+
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
     SkipList<Key, Comparator>::FindLessThan(const Key &key) const {
+        const uint64_t prefix = compare_.KeyPrefix(key);
         Node *x = head_;
         int level = GetMaxHeight() - 1;
         while (true) {
             assert(x == head_ || compare_(x->key, key) < 0);
             Node *next = x->Next(level);
-            if (next == nullptr || compare_(next->key, key) >= 0) {
+            if (!KeyIsAfterNode(key, prefix, next)) {
                 if (level == 0) {
                     return x;
                 } else {
@@ -326,14 +421,21 @@ namespace leveldb {
     }
 
     template<typename Key, class Comparator>
-    SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena *arena)
+    SkipList<Key, Comparator>::SkipList(Comparator cmp, Allocator *arena)
+            : SkipList(cmp, arena, false) {}
+
+    template<typename Key, class Comparator>
+    SkipList<Key, Comparator>::SkipList(Comparator cmp, Allocator *arena, bool concurrent)
             : compare_(cmp),
               arena_(arena),
-              head_(NewNode(0 /* any key will do */, kMaxHeight)),
+              head_(concurrent ? NewNodeConcurrently(0 /* any key will do */, 0, kMaxHeight)
+                               : NewNode(0 /* any key will do */, 0, kMaxHeight)),
               max_height_(1),
-              rnd_(0xdeadbeef) {
+              rnd_(0xdeadbeef),
+              hint_stale_(false) {
         for (int i = 0; i < kMaxHeight; i++) {
             head_->SetNext(i, nullptr);
+            hint_prev_[i] = head_;
         }
     }
 
@@ -347,17 +449,32 @@ namespace leveldb {
     void SkipList<Key, Comparator>::Insert(const Key &key) {
         // TODO(opt): We can use a barrier-free variant of FindGreaterOrEqual()
         // 这里是因为 Insert() 是外部同步的
+        const uint64_t prefix = compare_.KeyPrefix(key);
         Node *prev[kMaxHeight];
-        Node *x = FindGreaterOrEqual(key, prev);
+        Node *x;
+        Node *const last = hint_prev_[0];
+        if (!hint_stale_.load(std::memory_order_relaxed) &&
+            (last == head_ || KeyIsAfterNode(key, prefix, last)) &&
+            !KeyIsAfterNode(key, prefix, last->NoBarrier_Next(0))) {
+            // key 紧跟在上一次插入的节点之后（顺序写入的常见情况）：
+            // 任何层上都没有节点位于两者之间，上次的 splice 直接可用
+            x = last->NoBarrier_Next(0);
+            for (int i = 0; i < kMaxHeight; i++) {
+                prev[i] = hint_prev_[i];
+            }
+        } else {
+            x = FindGreaterOrEqual(key, prefix, prev);
+            for (int i = GetMaxHeight(); i < kMaxHeight; i++) {
+                prev[i] = head_;
+            }
+            hint_stale_.store(false, std::memory_order_relaxed);
+        }
 
         // 这个 SkipList 数据结构不允许重复插入
         assert(x == nullptr || !Equal(key, x->key));
 
         int height = RandomHeight();
         if (height > GetMaxHeight()) {
-            for (int i = GetMaxHeight(); i < height; i++) {
-                prev[i] = head_;
-            }
             // It is ok to mutate max_height_ without any synchronization
             // with concurrent readers.  A concurrent reader that observes
             // the new value of max_height_ will see either the old value of
@@ -368,17 +485,63 @@ namespace leveldb {
             max_height_.store(height, std::memory_order_relaxed);
         }
 
-        x = NewNode(key, height);
+        x = NewNode(key, prefix, height);
         for (int i = 0; i < height; i++) {
             // NoBarrier_SetNext() suffices since we will add a barrier when we publish a pointer to "x" in prev[i].
             x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
             prev[i]->SetNext(i, x);
         }
+        for (int i = 0; i < kMaxHeight; i++) {
+            hint_prev_[i] = (i < height) ? x : prev[i];
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::InsertConcurrently(const Key &key) {
+        // Insert() 不会与这里同时运行，它之后能通过外部同步看到这个标记
+        hint_stale_.store(true, std::memory_order_relaxed);
+        const int height = RandomHeightConcurrently();
+        int max_height = GetMaxHeight();
+        while (height > max_height) {
+            // Readers cope with a max_height_ that is ahead of the links from
+            // head_, see the comment in Insert().
+            if (max_height_.compare_exchange_weak(max_height, height, std::memory_order_relaxed)) {
+                max_height = height;
+                break;
+            }
+        }
+
+        const uint64_t prefix = compare_.KeyPrefix(key);
+        Node *prev[kMaxHeight];
+        Node *next[kMaxHeight];
+        Node *before = head_;
+        for (int level = max_height - 1; level >= 0; level--) {
+            FindSpliceForLevel(key, prefix, before, level, &prev[level], &next[level]);
+            before = prev[level];
+        }
+
+        // 这个 SkipList 数据结构不允许重复插入
+        assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+        // Link bottom-up, so the node is in the list (level 0) before it is
+        // reachable through any express lane.  If another thread linked a node
+        // between prev[i] and next[i] in the meantime, search again from prev[i]:
+        // nodes are never removed, so prev[i] still sorts before key.
+        Node *x = NewNodeConcurrently(key, prefix, height);
+        for (int i = 0; i < height; i++) {
+            while (true) {
+                x->NoBarrier_SetNext(i, next[i]);
+                if (prev[i]->CASNext(i, next[i], x)) {
+                    break;
+                }
+                FindSpliceForLevel(key, prefix, prev[i], i, &prev[i], &next[i]);
+            }
+        }
     }
 
     template<typename Key, class Comparator>
     bool SkipList<Key, Comparator>::Contains(const Key &key) const {
-        Node *x = FindGreaterOrEqual(key, nullptr);
+        Node *x = FindGreaterOrEqual(key, compare_.KeyPrefix(key), nullptr);
         if (x != nullptr && Equal(key, x->key)) {
             return true;
         } else {
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_SKIPLIST_REP_H_
+#define STORAGE_LEVELDB_DB_SKIPLIST_REP_H_
+
+#include "db/skiplist.h"
+#include "leveldb/memtablerep.h"
+
+namespace leveldb {
+
+    // 默认的表示：所有条目放在一个跳表中。
+    //
+    // Comparator 是 MemTableRep::KeyComparator 或它的子类。用 final 的具体子类实例化时，
+    // 跳表每次比较节点都是静态调用（可以内联），而不是经过虚函数。
+    template<class Comparator>
+    class SkipListRep : public MemTableRep {
+    public:
+        SkipListRep(const Comparator &cmp, Allocator *allocator) : list_(cmp, allocator) {}
+
+        void Insert(const char *entry) override { list_.Insert(entry); }
+
+        void InsertConcurrently(const char *entry) override { list_.InsertConcurrently(entry); }
+
+        const char *Lookup(const char *target) override {
+            typename List::Iterator iter(&list_);
+            iter.Seek(target);
+            return iter.Valid() ? iter.key() : nullptr;
+        }
+
+        MemTableRep::Iterator *NewIterator() override { return new Iterator(&list_); }
+
+    private:
+        typedef SkipList<const char *, const Comparator &> List;
+
+        class Iterator : public MemTableRep::Iterator {
+        public:
+            explicit Iterator(const List *list) : iter_(list) {}
+
+            bool Valid() const override { return iter_.Valid(); }
+
+            const char *key() const override { return iter_.key(); }
+
+            void Next() override { iter_.Next(); }
+
+            void Prev() override { iter_.Prev(); }
+
+            void Seek(const char *target) override { iter_.Seek(target); }
+
+            void SeekToFirst() override { iter_.SeekToFirst(); }
+
+            void SeekToLast() override { iter_.SeekToLast(); }
+
+        private:
+            typename List::Iterator iter_;
+        };
+
+        List list_;
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SKIPLIST_REP_H_
@@ -30,6 +30,10 @@ namespace leveldb {
                 return 0;
             }
         }
+
+        // Coarse on purpose, so that searches go through both the prefix
+        // shortcut and the full comparison.
+        uint64_t KeyPrefix(const Key &key) const { return key >> 8; }
     };
 
     TEST(SkipTest, Empty) {
@@ -125,6 +129,52 @@ namespace leveldb {
         }
     }
 
+    // Insert() reuses the previous insert position when keys arrive in
+    // ascending order; check that every pattern still links all levels right.
+    TEST(SkipTest, InsertHint) {
+        std::set<Key> keys;
+        Arena arena;
+        Comparator cmp;
+        SkipList<Key, Comparator> list(cmp, &arena);
+        auto insert = [&](Key key, bool concurrently) {
+            ASSERT_TRUE(keys.insert(key).second);
+            if (concurrently) {
+                list.InsertConcurrently(key);
+            } else {
+                list.Insert(key);
+            }
+        };
+        // Ascending at the end of the list
+        for (Key k = 1000; k < 3000; k += 10) insert(k, false);
+        // Ascending into a gap, the hint applies from the second key on
+        for (Key k = 1001; k < 1010; k++) insert(k, false);
+        // Descending, never hinted
+        for (Key k = 999; k >= 500; k--) insert(k, false);
+        // Ascending runs that jump over existing keys
+        for (Key k = 1011; k < 3000; k += 20) insert(k, false);
+        // Nodes the hint does not know about, then ascending again
+        for (Key k = 3000; k < 3100; k += 2) insert(k, true);
+        for (Key k = 3001; k < 3100; k += 2) insert(k, false);
+        for (Key k = 5000; k < 6000; k++) insert(k, false);
+
+        SkipList<Key, Comparator>::Iterator iter(&list);
+        iter.SeekToFirst();
+        for (Key key : keys) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(key, iter.key());
+            iter.Next();
+        }
+        ASSERT_TRUE(!iter.Valid());
+        // Seek() goes through the upper levels
+        for (Key key : keys) {
+            ASSERT_TRUE(list.Contains(key)) << key;
+            iter.Seek(key);
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(key, iter.key());
+        }
+        ASSERT_TRUE(!list.Contains(4000));
+    }
+
     // We want to make sure that with a single writer and multiple
     // concurrent readers (with no synchronization other than when a
     // reader's iterator is created), the reader always observes all the
@@ -374,6 +424,70 @@ namespace leveldb {
 
     TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+    // Several threads call InsertConcurrently() on the same list at once.
+    namespace {
+
+        struct ConcurrentInsertState {
+            ConcurrentInsertState() : list(cmp, &arena), done(0) {}
+
+            Arena arena;
+            Comparator cmp;
+            SkipList<Key, Comparator> list;
+            std::atomic<int> done;
+        };
+
+        struct ConcurrentInserter {
+            ConcurrentInsertState *state;
+            int id;
+        };
+
+        static const int kInserters = 4;
+        static const int kKeysPerInserter = 20000;
+
+        static void ConcurrentInsert(void *arg) {
+            ConcurrentInserter *inserter = reinterpret_cast<ConcurrentInserter *>(arg);
+            // Interleave the keys of all inserters to maximize CAS conflicts.
+            for (int i = 0; i < kKeysPerInserter; i++) {
+                inserter->state->list.InsertConcurrently(static_cast<Key>(i) * kInserters + inserter->id);
+            }
+            inserter->state->done.fetch_add(1, std::memory_order_release);
+        }
+
+    }  // namespace
+
+    TEST(SkipTest, InsertConcurrently) {
+        ConcurrentInsertState state;
+        ConcurrentInserter inserters[kInserters];
+        for (int id = 0; id < kInserters; id++) {
+            inserters[id].state = &state;
+            inserters[id].id = id;
+            Env::Default()->StartThread(ConcurrentInsert, &inserters[id]);
+        }
+
+        // Readers must always observe a sorted list while inserts are running.
+        while (state.done.load(std::memory_order_acquire) < kInserters) {
+            SkipList<Key, Comparator>::Iterator iter(&state.list);
+            iter.SeekToFirst();
+            if (iter.Valid()) {
+                Key prev = iter.key();
+                for (iter.Next(); iter.Valid(); iter.Next()) {
+                    ASSERT_LT(prev, iter.key());
+                    prev = iter.key();
+                }
+            }
+        }
+
+        SkipList<Key, Comparator>::Iterator iter(&state.list);
+        iter.SeekToFirst();
+        for (Key k = 0; k < static_cast<Key>(kInserters) * kKeysPerInserter; k++) {
+            ASSERT_TRUE(iter.Valid());
+            ASSERT_EQ(k, iter.key());
+            ASSERT_TRUE(state.list.Contains(k));
+            iter.Next();
+        }
+        ASSERT_TRUE(!iter.Valid());
+    }
+
 }  // namespace leveldb
 
 int main(int argc, char **argv) {
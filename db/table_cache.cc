@@ -95,6 +95,25 @@ namespace leveldb {
         return result;
     }
 
+    Iterator *TableCache::NewRangeTombstoneIterator(uint64_t file_number, uint64_t file_size) {
+        Cache::Handle *handle = nullptr;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (!s.ok()) {
+            return NewErrorIterator(s);
+        }
+
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        Iterator *result = table->NewRangeTombstoneIterator();
+        if (!result->status().ok()) {
+            // 不缓存范围删除读取失败的表，使临时错误在下次打开时可以恢复
+            cache_->Release(handle);
+            Evict(file_number);
+            return result;
+        }
+        result->RegisterCleanup(&UnrefEntry, cache_, handle);
+        return result;
+    }
+
     Status TableCache::Get(const ReadOptions &options, uint64_t file_number,
                            uint64_t file_size, const Slice &k, void *arg,
                            void (*handle_result)(void *, const Slice &,
@@ -109,6 +128,42 @@ namespace leveldb {
         return s;
     }
 
+    void TableCache::MultiGet(const ReadOptions &options, std::vector<FileLookups> *files,
+                              void (*handle_result)(void *, const Slice &, const Slice &)) {
+        std::vector<Cache::Handle *> handles(files->size(), nullptr);
+        std::vector<Table::MultiGetState *> states(files->size(), nullptr);
+        std::vector<ReadRequest> reads;
+        for (size_t i = 0; i < files->size(); i++) {
+            FileLookups &lookups = (*files)[i];
+            Status s = FindTable(lookups.file_number, lookups.file_size, &handles[i]);
+            if (s.ok()) {
+                Table *t = reinterpret_cast<TableAndFile *>(cache_->Value(handles[i]))->table;
+                states[i] = t->PrepareMultiGet(options, lookups.keys, &reads);
+            } else {
+                handles[i] = nullptr;
+                lookups.statuses.assign(lookups.keys.size(), s);
+            }
+        }
+
+        if (options.async_io) {
+            env_->MultiRead(reads.data(), reads.size());
+        } else {
+            for (ReadRequest &req : reads) {
+                req.status = req.file->Read(req.offset, req.n, &req.result, req.scratch);
+            }
+        }
+
+        for (size_t i = 0; i < files->size(); i++) {
+            if (handles[i] != nullptr) {
+                FileLookups &lookups = (*files)[i];
+                Table *t = reinterpret_cast<TableAndFile *>(cache_->Value(handles[i]))->table;
+                t->FinishMultiGet(states[i], reads, lookups.keys, lookups.args, handle_result,
+                                  &lookups.statuses);
+                cache_->Release(handles[i]);
+            }
+        }
+    }
+
     void TableCache::Evict(uint64_t file_number) {
         char buf[sizeof(file_number)];
         EncodeFixed64(buf, file_number);
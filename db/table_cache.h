@@ -10,6 +10,7 @@
 #include <stdint.h>
 
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
@@ -36,12 +37,32 @@ namespace leveldb {
         Iterator *NewIterator(const ReadOptions &options, uint64_t file_number,
                               uint64_t file_size, Table **tableptr = nullptr);
 
+        // Return an iterator over the range tombstones of the specified file
+        // (see Table::NewRangeTombstoneIterator()).
+        Iterator *NewRangeTombstoneIterator(uint64_t file_number, uint64_t file_size);
+
         // If a seek to internal key "k" in specified file finds an entry,
         // call (*handle_result)(arg, found_key, found_value).
         Status Get(const ReadOptions &options, uint64_t file_number,
                    uint64_t file_size, const Slice &k, void *arg,
                    void (*handle_result)(void *, const Slice &, const Slice &));
 
+        // The lookups of a MultiGet() call in one file.
+        struct FileLookups {
+            uint64_t file_number;
+            uint64_t file_size;
+            std::vector<Slice> keys;  // Sorted
+            std::vector<void *> args;
+            std::vector<Status> statuses;
+        };
+
+        // For each lookup of each file of "*files", do what Get() would with
+        // the same file, key and arg, and store its status.  The data block
+        // reads of all the files are performed together, and concurrently
+        // through Env::MultiRead() if options.async_io is set.
+        void MultiGet(const ReadOptions &options, std::vector<FileLookups> *files,
+                      void (*handle_result)(void *, const Slice &, const Slice &));
+
         // Evict any entry for the specified file number
         void Evict(uint64_t file_number);
 
@@ -22,7 +22,9 @@ namespace leveldb {
         kDeletedFile = 6,
         kNewFile = 7,
         /** 8 用于大型参考 */
-        kPrevLogNumber = 9
+        kPrevLogNumber = 9,
+        /** 与 kNewFile 相同，但文件中有范围删除 */
+        kNewFileWithRangeDeletions = 10
     };
 
     void VersionEdit::Clear() {
@@ -80,7 +82,7 @@ namespace leveldb {
 
         for (size_t i = 0; i < new_files_.size(); i++) {
             const FileMetaData &f = new_files_[i].second;
-            PutVarint32(dst, kNewFile);
+            PutVarint32(dst, f.has_range_deletions ? kNewFileWithRangeDeletions : kNewFile);
             PutVarint32(dst, new_files_[i].first);  // level
             PutVarint64(dst, f.number);
             PutVarint64(dst, f.file_size);
@@ -183,10 +185,12 @@ namespace leveldb {
                     break;
 
                 case kNewFile:
+                case kNewFileWithRangeDeletions:
                     if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
                         GetVarint64(&input, &f.file_size) &&
                         GetInternalKey(&input, &f.smallest) &&
                         GetInternalKey(&input, &f.largest)) {
+                        f.has_range_deletions = (tag == kNewFileWithRangeDeletions);
                         new_files_.push_back(std::make_pair(level, f));
                     } else {
                         msg = "new-file entry";
@@ -257,6 +261,9 @@ namespace leveldb {
             r.append(f.smallest.DebugString());
             r.append(" .. ");
             r.append(f.largest.DebugString());
+            if (f.has_range_deletions) {
+                r.append(" (range deletions)");
+            }
         }
         r.append("\n}\n");
         return r;
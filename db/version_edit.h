@@ -16,7 +16,7 @@ namespace leveldb {
     class VersionSet;
 
     struct FileMetaData {
-        FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+        FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0), has_range_deletions(false) {}
 
         int refs;
         int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +24,7 @@ namespace leveldb {
         uint64_t file_size;    // File size in bytes
         InternalKey smallest;  // Smallest internal key served by table
         InternalKey largest;   // Largest internal key served by table
+        bool has_range_deletions;  // Whether the table holds range tombstones
     };
 
     class VersionEdit {
@@ -71,12 +72,14 @@ namespace leveldb {
         // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
         // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
         void AddFile(int level, uint64_t file, uint64_t file_size,
-                     const InternalKey &smallest, const InternalKey &largest) {
+                     const InternalKey &smallest, const InternalKey &largest,
+                     bool has_range_deletions = false) {
             FileMetaData f;
             f.number = file;
             f.file_size = file_size;
             f.smallest = smallest;
             f.largest = largest;
+            f.has_range_deletions = has_range_deletions;
             new_files_.push_back(std::make_pair(level, f));
         }
 
@@ -12,6 +12,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_del_aggregator.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -267,12 +269,16 @@ namespace leveldb {
             kFound,
             kDeleted,
             kCorrupt,
+            kMerge,  // Found a merge operand; the value is in older entries
         };
         struct Saver {
             SaverState state;
             const Comparator *ucmp;
             Slice user_key;
             std::string *value;
+            MergeContext *merge_context;
+            SequenceNumber merge_sequence;  // Sequence of the last merge operand
+            SequenceNumber *max_covering_tombstone_seq;  // Older entries are deleted
         };
     }  // namespace
     static void SaveValue(void *arg, const Slice &ikey, const Slice &v) {
@@ -282,9 +288,28 @@ namespace leveldb {
             s->state = kCorrupt;
         } else {
             if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-                s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-                if (s->state == kFound) {
-                    s->value->assign(v.data(), v.size());
+                ValueType type = parsed_key.type;
+                if (parsed_key.sequence < *s->max_covering_tombstone_seq) {
+                    type = kTypeDeletion;
+                }
+                switch (type) {
+                    case kTypeValue:
+                        s->state = kFound;
+                        s->value->assign(v.data(), v.size());
+                        break;
+                    case kTypeDeletion:
+                    case kTypeSingleDeletion:
+                        s->state = kDeleted;
+                        break;
+                    case kTypeMerge:
+                        s->state = kMerge;
+                        s->merge_context->PushOlderOperand(v);
+                        s->merge_sequence = parsed_key.sequence;
+                        break;
+                    case kTypeRangeDeletion:
+                        // Range tombstones are not stored with the point entries
+                        s->state = kCorrupt;
+                        break;
                 }
             }
         }
@@ -299,19 +324,10 @@ namespace leveldb {
         const Comparator *ucmp = vset_->icmp_.user_comparator();
 
         // Search level-0 in order from newest to oldest.
-        std::vector<FileMetaData *> tmp;
-        tmp.reserve(files_[0].size());
-        for (uint32_t i = 0; i < files_[0].size(); i++) {
-            FileMetaData *f = files_[0][i];
-            if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
-                ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
-                tmp.push_back(f);
-            }
-        }
-        if (!tmp.empty()) {
-            std::sort(tmp.begin(), tmp.end(), NewestFirst);
-            for (uint32_t i = 0; i < tmp.size(); i++) {
-                if (!(*func)(arg, 0, tmp[i])) {
+        const int range = FindLevel0Range(user_key);
+        if (range >= 0) {
+            for (uint32_t i = level0_range_start_[range]; i < level0_range_start_[range + 1]; i++) {
+                if (!(*func)(arg, 0, level0_range_files_[i])) {
                     return;
                 }
             }
@@ -337,81 +353,325 @@ namespace leveldb {
         }
     }
 
-    Status Version::Get(const ReadOptions &options, const LookupKey &k, std::string *value, GetStats *stats) {
-        stats->seek_file = nullptr;
-        stats->seek_file_level = -1;
+    void Version::BuildLevel0Index() {
+        const Comparator *ucmp = vset_->icmp_.user_comparator();
+        level0_newest_first_ = files_[0];
+        std::sort(level0_newest_first_.begin(), level0_newest_first_.end(), NewestFirst);
+
+        level0_bounds_.clear();
+        for (FileMetaData *f : files_[0]) {
+            level0_bounds_.push_back(f->smallest.user_key());
+            level0_bounds_.push_back(f->largest.user_key());
+        }
+        std::sort(level0_bounds_.begin(), level0_bounds_.end(), [ucmp](const Slice &a, const Slice &b) {
+            return ucmp->Compare(a, b) < 0;
+        });
+        level0_bounds_.erase(std::unique(level0_bounds_.begin(), level0_bounds_.end(),
+                                         [ucmp](const Slice &a, const Slice &b) {
+                                             return ucmp->Compare(a, b) == 0;
+                                         }),
+                             level0_bounds_.end());
+
+        // Every file starts and ends at a bound, so a file overlaps all keys
+        // between two adjacent bounds iff it overlaps both of them.
+        level0_range_start_.clear();
+        level0_range_files_.clear();
+        for (const Slice &bound : level0_bounds_) {
+            level0_range_start_.push_back(level0_range_files_.size());
+            for (FileMetaData *f : level0_newest_first_) {
+                if (ucmp->Compare(f->smallest.user_key(), bound) <= 0 &&
+                    ucmp->Compare(f->largest.user_key(), bound) >= 0) {
+                    level0_range_files_.push_back(f);
+                }
+            }
+            level0_range_start_.push_back(level0_range_files_.size());
+            for (FileMetaData *f : level0_newest_first_) {
+                if (ucmp->Compare(f->smallest.user_key(), bound) <= 0 &&
+                    ucmp->Compare(f->largest.user_key(), bound) > 0) {
+                    level0_range_files_.push_back(f);
+                }
+            }
+        }
+        level0_range_start_.push_back(level0_range_files_.size());
+    }
 
-        struct State {
-            Saver saver;
-            GetStats *stats;
-            const ReadOptions *options;
-            Slice ikey;
-            FileMetaData *last_file_read;
-            int last_file_read_level;
+    int Version::FindLevel0Range(const Slice &user_key) const {
+        // Binary search for the first bound after user_key
+        const Comparator *ucmp = vset_->icmp_.user_comparator();
+        uint32_t left = 0;
+        uint32_t right = level0_bounds_.size();
+        bool equal = false;
+        while (left < right) {
+            uint32_t mid = (left + right) / 2;
+            const int r = ucmp->Compare(level0_bounds_[mid], user_key);
+            if (r <= 0) {
+                equal = (r == 0);
+                left = mid + 1;
+            } else {
+                right = mid;
+            }
+        }
+        if (left == 0) {
+            return -1;  // Before the first level-0 file
+        }
+        return 2 * (left - 1) + (equal ? 0 : 1);
+    }
 
-            VersionSet *vset;
-            Status s;
-            bool found;
+    // The lookup of one key, shared by Get() and MultiGet().
+    struct Version::GetState {
+        Saver saver;
+        GetStats *stats;
+        const ReadOptions *options;
+        Slice ikey;
+        SequenceNumber snapshot;
+        FileMetaData *last_file_read;
+        int last_file_read_level;
+
+        VersionSet *vset;
+        const MergeOperator *merge_operator;
+        Status s;
+        bool found;
+        bool done;  // No more files need to be looked at
+
+        void Init(VersionSet *vs, const ReadOptions &opts, const LookupKey &k, std::string *value,
+                  GetStats *st, MergeContext *merge_context, SequenceNumber *max_covering_tombstone_seq) {
+            stats = st;
+            stats->seek_file = nullptr;
+            stats->seek_file_level = -1;
+            found = false;
+            done = false;
+            last_file_read = nullptr;
+            last_file_read_level = -1;
+
+            options = &opts;
+            ikey = k.internal_key();
+            snapshot = k.sequence();
+            vset = vs;
+            merge_operator = vset->options_->merge_operator;
+
+            saver.state = kNotFound;
+            saver.ucmp = vset->icmp_.user_comparator();
+            saver.user_key = k.user_key();
+            saver.value = value;
+            saver.merge_context = merge_context;
+            saver.merge_sequence = 0;
+            saver.max_covering_tombstone_seq = max_covering_tombstone_seq;
+        }
+
+        // Prepare to look for the key in "f".  Returns false if the lookup
+        // failed.
+        bool StartFile(int level, FileMetaData *f) {
+            if (stats->seek_file == nullptr && last_file_read != nullptr) {
+                // We have had more than one seek for this read.  Charge the 1st file.
+                stats->seek_file = last_file_read;
+                stats->seek_file_level = last_file_read_level;
+            }
 
-            static bool Match(void *arg, int level, FileMetaData *f) {
-                State *state = reinterpret_cast<State *>(arg);
+            last_file_read = f;
+            last_file_read_level = level;
 
-                if (state->stats->seek_file == nullptr &&
-                    state->last_file_read != nullptr) {
-                    // We have had more than one seek for this read.  Charge the 1st file.
-                    state->stats->seek_file = state->last_file_read;
-                    state->stats->seek_file_level = state->last_file_read_level;
+            if (f->has_range_deletions) {
+                Iterator *iter = vset->table_cache_->NewRangeTombstoneIterator(f->number, f->file_size);
+                const SequenceNumber seq = MaxCoveringTombstoneSeq(iter, saver.ucmp, saver.user_key, snapshot);
+                s = iter->status();
+                delete iter;
+                if (!s.ok()) {
+                    found = true;
+                    return false;
+                }
+                if (seq > *saver.max_covering_tombstone_seq) {
+                    *saver.max_covering_tombstone_seq = seq;
                 }
+            }
 
-                state->last_file_read = f;
-                state->last_file_read_level = level;
+            saver.state = kNotFound;
+            return true;
+        }
 
-                state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                          f->file_size, state->ikey,
-                                                          &state->saver, SaveValue);
-                if (!state->s.ok()) {
-                    state->found = true;
+        // Handle the outcome "s" of seeking to the key in "f".  Returns true
+        // if older files must be searched as well.
+        bool FinishFile(FileMetaData *f) {
+            while (s.ok() && saver.state == kMerge && saver.merge_sequence > 0) {
+                // 同一文件中可能还有这个用户键更旧的条目
+                LookupKey older(saver.user_key, saver.merge_sequence - 1);
+                saver.state = kNotFound;
+                s = vset->table_cache_->Get(*options, f->number, f->file_size, older.internal_key(),
+                                            &saver, SaveValue);
+            }
+            if (!s.ok()) {
+                found = true;
+                return false;
+            }
+            switch (saver.state) {
+                case kNotFound:
+                case kMerge:
+                    return true;  // Keep searching in other files
+                case kFound:
+                    found = true;
+                    if (!saver.merge_context->empty()) {
+                        Slice base(*saver.value);
+                        s = saver.merge_context->Merge(merge_operator, saver.user_key, &base, saver.value);
+                    }
                     return false;
-                }
-                switch (state->saver.state) {
-                    case kNotFound:
-                        return true;  // Keep searching in other files
-                    case kFound:
-                        state->found = true;
-                        return false;
-                    case kDeleted:
-                        return false;
-                    case kCorrupt:
-                        state->s =
-                                Status::Corruption("corrupted key for ", state->saver.user_key);
-                        state->found = true;
-                        return false;
-                }
+                case kDeleted:
+                    if (!saver.merge_context->empty()) {
+                        found = true;
+                        s = saver.merge_context->Merge(merge_operator, saver.user_key, nullptr, saver.value);
+                    }
+                    return false;
+                case kCorrupt:
+                    s = Status::Corruption("corrupted key for ", saver.user_key);
+                    found = true;
+                    return false;
+            }
+
+            // Not reached. Added to avoid false compilation warnings of
+            // "control reaches end of non-void function".
+            return false;
+        }
+
+        Status Result() {
+            if (!found && !saver.merge_context->empty()) {
+                // 所有数据中都没有操作数之下的值
+                return saver.merge_context->Merge(merge_operator, saver.user_key, nullptr, saver.value);
+            }
+            return found ? s : Status::NotFound(Slice());
+        }
 
-                // Not reached. Added to avoid false compilation warnings of
-                // "control reaches end of non-void function".
+        static bool Match(void *arg, int level, FileMetaData *f) {
+            GetState *state = reinterpret_cast<GetState *>(arg);
+            if (!state->StartFile(level, f)) {
                 return false;
             }
-        };
+            state->s = state->vset->table_cache_->Get(*state->options, f->number, f->file_size,
+                                                      state->ikey, &state->saver, SaveValue);
+            return state->FinishFile(f);
+        }
 
-        State state;
-        state.found = false;
-        state.stats = stats;
-        state.last_file_read = nullptr;
-        state.last_file_read_level = -1;
+        // Look in each files[j] for the keys of states[batches[j][i]],
+        // performing the block reads of all the files together.
+        static void MatchFiles(std::vector<GetState> *states, int level,
+                               const std::vector<FileMetaData *> &files,
+                               const std::vector<std::vector<size_t>> &batches) {
+            std::vector<TableCache::FileLookups> lookups(files.size());
+            std::vector<std::vector<size_t>> started(files.size());
+            for (size_t j = 0; j < files.size(); j++) {
+                lookups[j].file_number = files[j]->number;
+                lookups[j].file_size = files[j]->file_size;
+                for (size_t i : batches[j]) {
+                    GetState *state = &(*states)[i];
+                    if (state->StartFile(level, files[j])) {
+                        started[j].push_back(i);
+                        lookups[j].keys.push_back(state->ikey);
+                        lookups[j].args.push_back(&state->saver);
+                    } else {
+                        state->done = true;
+                    }
+                }
+            }
+            const GetState &first = states->front();
+            first.vset->table_cache_->MultiGet(*first.options, &lookups, SaveValue);
+            for (size_t j = 0; j < files.size(); j++) {
+                for (size_t i = 0; i < started[j].size(); i++) {
+                    GetState *state = &(*states)[started[j][i]];
+                    state->s = lookups[j].statuses[i];
+                    if (!state->FinishFile(files[j])) {
+                        state->done = true;
+                    }
+                }
+            }
+        }
+    };
 
-        state.options = &options;
-        state.ikey = k.internal_key();
-        state.vset = vset_;
+    Status Version::Get(const ReadOptions &options, const LookupKey &k, std::string *value, GetStats *stats,
+                        MergeContext *merge_context, SequenceNumber *max_covering_tombstone_seq) {
+        GetState state;
+        state.Init(vset_, options, k, value, stats, merge_context, max_covering_tombstone_seq);
+        ForEachOverlapping(state.saver.user_key, state.ikey, &state, &GetState::Match);
+        return state.Result();
+    }
 
-        state.saver.state = kNotFound;
-        state.saver.ucmp = vset_->icmp_.user_comparator();
-        state.saver.user_key = k.user_key();
-        state.saver.value = value;
+    void Version::MultiGet(const ReadOptions &options, std::vector<GetRequest> *requests) {
+        const Comparator *ucmp = vset_->icmp_.user_comparator();
+        const size_t n = requests->size();
+        std::vector<GetState> states(n);
+        for (size_t i = 0; i < n; i++) {
+            GetRequest &req = (*requests)[i];
+            states[i].Init(vset_, options, *req.key, req.value, &req.stats, req.merge_context,
+                           req.max_covering_tombstone_seq);
+        }
+
+        // Search level-0 in order from newest to oldest
+        std::vector<FileMetaData *> files(1);
+        std::vector<std::vector<size_t>> batches(1);
+        for (FileMetaData *f : level0_newest_first_) {
+            files[0] = f;
+            batches[0].clear();
+            for (size_t i = 0; i < n; i++) {
+                const Slice user_key = states[i].saver.user_key;
+                if (ucmp->Compare(user_key, f->largest.user_key()) > 0) {
+                    break;  // Keys are sorted
+                }
+                if (!states[i].done && ucmp->Compare(user_key, f->smallest.user_key()) >= 0) {
+                    batches[0].push_back(i);
+                }
+            }
+            if (!batches[0].empty()) {
+                GetState::MatchFiles(&states, 0, files, batches);
+            }
+        }
 
-        ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
+        // Search other levels.  The files of a level are sorted like the
+        // keys, so each file is visited once with all the keys it may hold,
+        // and the files of a level are read together.
+        for (int level = 1; level < config::kNumLevels; level++) {
+            const std::vector<FileMetaData *> &level_files = files_[level];
+            if (level_files.empty()) continue;
+
+            files.clear();
+            batches.clear();
+            size_t index = level_files.size();
+            for (size_t i = 0; i < n; i++) {
+                if (states[i].done) continue;
+                const Slice ikey = states[i].ikey;
+                if (index == level_files.size() ||
+                    vset_->icmp_.Compare(level_files[index]->largest.Encode(), ikey) < 0) {
+                    // Binary search to find earliest index whose largest key >= ikey.
+                    index = FindFile(vset_->icmp_, level_files, ikey);
+                    if (index == level_files.size()) break;
+                }
+                FileMetaData *f = level_files[index];
+                if (ucmp->Compare(states[i].saver.user_key, f->smallest.user_key()) >= 0) {
+                    if (files.empty() || files.back() != f) {
+                        files.push_back(f);
+                        batches.emplace_back();
+                    }
+                    batches.back().push_back(i);
+                }
+            }
+            if (!files.empty()) {
+                GetState::MatchFiles(&states, level, files, batches);
+            }
+        }
 
-        return state.found ? state.s : Status::NotFound(Slice());
+        for (size_t i = 0; i < n; i++) {
+            (*requests)[i].status = states[i].Result();
+        }
+    }
+
+    Status Version::AddRangeTombstones(RangeDelAggregator *range_del) {
+        for (int level = 0; level < config::kNumLevels; level++) {
+            for (FileMetaData *f : files_[level]) {
+                if (f->has_range_deletions) {
+                    Status s = range_del->AddTombstones(
+                            vset_->table_cache_->NewRangeTombstoneIterator(f->number, f->file_size));
+                    if (!s.ok()) {
+                        return s;
+                    }
+                }
+            }
+        }
+        return Status::OK();
     }
 
     bool Version::UpdateStats(const GetStats &stats) {
@@ -802,7 +1062,7 @@ namespace leveldb {
         }
 
         edit->SetNextFile(next_file_number_);
-        edit->SetLastSequence(last_sequence_);
+        edit->SetLastSequence(LastSequence());
 
         Version *v = new Version(this);
         {
@@ -981,7 +1241,7 @@ namespace leveldb {
             AppendVersion(v);
             manifest_file_number_ = next_file;
             next_file_number_ = next_file + 1;
-            last_sequence_ = last_sequence;
+            last_sequence_.store(last_sequence, std::memory_order_release);
             log_number_ = log_number;
             prev_log_number_ = prev_log_number;
 
@@ -1067,6 +1327,8 @@ namespace leveldb {
 
         v->compaction_level_ = best_level;
         v->compaction_score_ = best_score;
+
+        v->BuildLevel0Index();
     }
 
     Status VersionSet::WriteSnapshot(log::Writer *log) {
@@ -1090,7 +1352,7 @@ namespace leveldb {
             const std::vector<FileMetaData *> &files = current_->files_[level];
             for (size_t i = 0; i < files.size(); i++) {
                 const FileMetaData *f = files[i];
-                edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+                edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest, f->has_range_deletions);
             }
         }
 
@@ -1166,6 +1428,21 @@ namespace leveldb {
         return TotalFileSize(current_->files_[level]);
     }
 
+    uint64_t VersionSet::PendingCompactionBytes() const {
+        uint64_t result = 0;
+        if (NumLevelFiles(0) >= config::kL0_CompactionTrigger) {
+            result += NumLevelBytes(0);
+        }
+        // The last level has no size limit.
+        for (int level = 1; level < config::kNumLevels - 1; level++) {
+            const double excess = static_cast<double>(NumLevelBytes(level)) - MaxBytesForLevel(options_, level);
+            if (excess > 0) {
+                result += static_cast<uint64_t>(excess);
+            }
+        }
+        return result;
+    }
+
     int64_t VersionSet::MaxNextLevelOverlappingBytes() {
         int64_t result = 0;
         std::vector<FileMetaData *> overlaps;
@@ -1512,6 +1789,23 @@ namespace leveldb {
                 edit->RemoveFile(level_ + which, inputs_[which][i]->number);
             }
         }
+        for (FileMetaData *f : covered_inputs_) {
+            edit->RemoveFile(level_ + 1, f->number);
+        }
+    }
+
+    bool Compaction::IsBaseLevelForRange(const Slice &start, const Slice &end) {
+        for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+            if (input_version_->OverlapInLevel(lvl, &start, &end)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Compaction::DropCoveredInput(int i) {
+        covered_inputs_.push_back(inputs_[1][i]);
+        inputs_[1].erase(inputs_[1].begin() + i);
     }
 
     bool Compaction::IsBaseLevelForKey(const Slice &user_key) {
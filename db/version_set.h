@@ -15,6 +15,7 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
@@ -36,6 +37,10 @@ namespace leveldb {
 
     class MemTable;
 
+    class MergeContext;
+
+    class RangeDelAggregator;
+
     class TableBuilder;
 
     class TableCache;
@@ -67,6 +72,11 @@ namespace leveldb {
     public:
         // Lookup the value for key.  If found, store it in *val and
         // return OK.  Else return a non-OK status.  Fills *stats.
+        // Merge operands found on the way are added to *merge_context, which
+        // may already hold newer operands found in the memtables, and are
+        // combined with the value found under them.  Entries older than
+        // *max_covering_tombstone_seq, which the range tombstones of the files
+        // looked at may raise, are deleted.
         // REQUIRES: lock is not held
         struct GetStats {
             FileMetaData *seek_file;
@@ -79,7 +89,28 @@ namespace leveldb {
         void AddIterators(const ReadOptions &, std::vector<Iterator *> *iters);
 
         Status Get(const ReadOptions &, const LookupKey &key, std::string *val,
-                   GetStats *stats);
+                   GetStats *stats, MergeContext *merge_context,
+                   SequenceNumber *max_covering_tombstone_seq);
+
+        // The arguments and results of the lookup of one key by MultiGet().
+        struct GetRequest {
+            const LookupKey *key;
+            std::string *value;
+            MergeContext *merge_context;
+            SequenceNumber *max_covering_tombstone_seq;
+            GetStats stats;
+            Status status;
+        };
+
+        // Look up the key of every request as Get() would, storing the result
+        // in its status.  Visits each file once for all the keys that may be
+        // in it instead of once per key.
+        // REQUIRES: "requests" are sorted by user key and share one snapshot
+        // REQUIRES: lock is not held
+        void MultiGet(const ReadOptions &, std::vector<GetRequest> *requests);
+
+        // Add the range tombstones of all files of this Version to *range_del.
+        Status AddRangeTombstones(RangeDelAggregator *range_del);
 
         // Adds "stats" into the current state.  Returns true if a new
         // compaction may need to be triggered, false otherwise.
@@ -128,6 +159,8 @@ namespace leveldb {
 
         class LevelFileNumIterator;
 
+        struct GetState;
+
         explicit Version(VersionSet *vset)
                 : vset_(vset),
                   next_(this),
@@ -154,6 +187,14 @@ namespace leveldb {
         void ForEachOverlapping(Slice user_key, Slice internal_key, void *arg,
                                 bool (*func)(void *, int, FileMetaData *));
 
+        // Build level0_newest_first_ and the level-0 interval index from
+        // files_[0].  Called by VersionSet::Finalize().
+        void BuildLevel0Index();
+
+        // Return the index of the level-0 key range user_key falls in, or -1
+        // if no level-0 file can hold user_key.
+        int FindLevel0Range(const Slice &user_key) const;
+
         VersionSet *vset_;  // 该版本所属的 VersionSet
         Version *next_;     // 链表中的下一个版本
         Version *prev_;     // 链表中的上一个版本
@@ -162,6 +203,19 @@ namespace leveldb {
         // 每个级别的文件列表
         std::vector<FileMetaData *> files_[config::kNumLevels];
 
+        // files_[0] 从新到旧排列
+        std::vector<FileMetaData *> level0_newest_first_;
+
+        // Interval index over the level-0 files.  The distinct user keys that
+        // start or end a level-0 file, in order, cut the key space into
+        // ranges: range 2i holds just level0_bounds_[i], and range 2i+1 the
+        // keys between level0_bounds_[i] and the next bound.  The files that
+        // overlap range r are level0_range_files_[level0_range_start_[r] ..
+        // level0_range_start_[r+1]), newest first.
+        std::vector<Slice> level0_bounds_;
+        std::vector<uint32_t> level0_range_start_;
+        std::vector<FileMetaData *> level0_range_files_;
+
         // 根据搜索统计信息压缩的下一个文件
         FileMetaData *file_to_compact_;
         int file_to_compact_level_;
@@ -215,13 +269,22 @@ namespace leveldb {
         // Return the combined file size of all files at the specified level.
         int64_t NumLevelBytes(int level) const;
 
-        // 返回最后一个序列号
-        uint64_t LastSequence() const { return last_sequence_; }
+        // Estimate how many bytes compaction has to rewrite before every
+        // level is back within its size limit (level-0: its file limit).
+        uint64_t PendingCompactionBytes() const;
+
+        // 返回最后一个序列号。读取不需要持有锁，因此读操作可以不加锁取得最新快照
+        uint64_t LastSequence() const { return last_sequence_.load(std::memory_order_acquire); }
 
-        // Set the last sequence number to s.
+        // Set the last sequence number to s and publish it to readers: the
+        // store is release-ordered, pairing with the acquire in LastSequence().
+        // REQUIRES: the caller is the only thread advancing the sequence, i.e.
+        // the write-queue leader (which need not hold mutex when writes are not
+        // pipelined), the memtable-writer leader of a pipelined write group
+        // (mutex held), or DB recovery before any write starts.
         void SetLastSequence(uint64_t s) {
-            assert(s >= last_sequence_);
-            last_sequence_ = s;
+            assert(s >= last_sequence_.load(std::memory_order_relaxed));
+            last_sequence_.store(s, std::memory_order_release);
         }
 
         // Mark the specified file number as used.
@@ -309,7 +372,7 @@ namespace leveldb {
         const InternalKeyComparator icmp_;
         uint64_t next_file_number_;
         uint64_t manifest_file_number_;
-        uint64_t last_sequence_;
+        std::atomic<uint64_t> last_sequence_;
         uint64_t log_number_;
         uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
 
@@ -359,6 +422,17 @@ namespace leveldb {
         // in levels greater than "level+1".
         bool IsBaseLevelForKey(const Slice &user_key);
 
+        // Like IsBaseLevelForKey(), for all the user keys in [start, end).
+        bool IsBaseLevelForRange(const Slice &start, const Slice &end);
+
+        // Do not read the ith input file of "level+1": all its entries are
+        // deleted by a range tombstone of "level".  It is still deleted from
+        // the version by AddInputDeletions().
+        void DropCoveredInput(int i);
+
+        // Number of input files dropped by DropCoveredInput().
+        int num_covered_inputs() const { return covered_inputs_.size(); }
+
         // Returns true iff we should stop building the current output
         // before processing "internal_key".
         bool ShouldStopBefore(const Slice &internal_key);
@@ -381,6 +455,7 @@ namespace leveldb {
 
         // Each compaction reads inputs from "level_" and "level_+1"
         std::vector<FileMetaData *> inputs_[2];  // The two sets of inputs
+        std::vector<FileMetaData *> covered_inputs_;  // Dropped from inputs_[1] unread
 
         // State used to check for number of overlapping grandparent files
         // (parent == level_ + 1, grandparent == level_ + 2)
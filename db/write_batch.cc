@@ -8,13 +8,19 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeSingleDeletion varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
 
 #include "leveldb/write_batch.h"
 
+#include <algorithm>
+#include <utility>
+
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
@@ -24,14 +30,30 @@
 namespace leveldb {
 
     // WriteBatch 标头具有 8 字节的序列号，后跟 4 字节的计数。
-    static const size_t kHeader = 12;
+    static const size_t kHeader = WriteBatchInternal::kHeader;
 
     WriteBatch::WriteBatch() { Clear(); }
 
+    WriteBatch::WriteBatch(size_t reserved_bytes) {
+        rep_.reserve(std::max(reserved_bytes, kHeader));
+        Clear();
+    }
+
+    // 内容原样保留：太短的内容由 Iterate() 和 DB::Write() 报告为损坏
+    WriteBatch::WriteBatch(std::string &&rep) : rep_(std::move(rep)) {}
+
     WriteBatch::~WriteBatch() = default;
 
     WriteBatch::Handler::~Handler() = default;
 
+    void WriteBatch::Handler::Merge(const Slice & /*key*/, const Slice & /*value*/) { unsupported_ = true; }
+
+    void WriteBatch::Handler::DeleteRange(const Slice & /*begin_key*/, const Slice & /*end_key*/) {
+        unsupported_ = true;
+    }
+
+    void WriteBatch::Handler::SingleDelete(const Slice &key) { Delete(key); }
+
     void WriteBatch::Clear() {
         rep_.clear();
         rep_.resize(kHeader);
@@ -75,6 +97,33 @@ namespace leveldb {
                         return Status::Corruption("bad WriteBatch Delete");
                     }
                     break;
+                case kTypeMerge: // 合并操作数
+                    if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value)) {
+                        handler->Merge(key, value);
+                        if (handler->unsupported_) {
+                            return Status::NotSupported("WriteBatch::Handler does not handle Merge");
+                        }
+                    } else {
+                        return Status::Corruption("bad WriteBatch Merge");
+                    }
+                    break;
+                case kTypeRangeDeletion: // 范围删除
+                    if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value)) {
+                        handler->DeleteRange(key, value);
+                        if (handler->unsupported_) {
+                            return Status::NotSupported("WriteBatch::Handler does not handle DeleteRange");
+                        }
+                    } else {
+                        return Status::Corruption("bad WriteBatch DeleteRange");
+                    }
+                    break;
+                case kTypeSingleDeletion: // 单次删除标识
+                    if (GetLengthPrefixedSlice(&input, &key)) {
+                        handler->SingleDelete(key);
+                    } else {
+                        return Status::Corruption("bad WriteBatch SingleDelete");
+                    }
+                    break;
                 default:
                     return Status::Corruption("unknown WriteBatch tag");
             }
@@ -115,12 +164,39 @@ namespace leveldb {
         PutLengthPrefixedSlice(&rep_, value);
     }
 
+    void WriteBatch::Put(const SliceParts &key, const SliceParts &value) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeValue));
+        PutLengthPrefixedSliceParts(&rep_, key);
+        PutLengthPrefixedSliceParts(&rep_, value);
+    }
+
     void WriteBatch::Delete(const Slice &key) {
         WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
         rep_.push_back(static_cast<char>(kTypeDeletion));
         PutLengthPrefixedSlice(&rep_, key);
     }
 
+    void WriteBatch::Merge(const Slice &key, const Slice &value) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeMerge));
+        PutLengthPrefixedSlice(&rep_, key);
+        PutLengthPrefixedSlice(&rep_, value);
+    }
+
+    void WriteBatch::DeleteRange(const Slice &begin_key, const Slice &end_key) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+        PutLengthPrefixedSlice(&rep_, begin_key);
+        PutLengthPrefixedSlice(&rep_, end_key);
+    }
+
+    void WriteBatch::SingleDelete(const Slice &key) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeSingleDeletion));
+        PutLengthPrefixedSlice(&rep_, key);
+    }
+
     void WriteBatch::Append(const WriteBatch &source) {
         WriteBatchInternal::Append(this, &source);
     }
@@ -131,24 +207,41 @@ namespace leveldb {
         public:
             SequenceNumber sequence_;
             MemTable *mem_;
+            bool concurrent_;
 
             void Put(const Slice &key, const Slice &value) override {
                 // 添加到内存中
-                mem_->Add(sequence_, kTypeValue, key, value);
+                mem_->Add(sequence_, kTypeValue, key, value, concurrent_);
                 sequence_++;
             }
 
             void Delete(const Slice &key) override {
-                mem_->Add(sequence_, kTypeDeletion, key, Slice());
+                mem_->Add(sequence_, kTypeDeletion, key, Slice(), concurrent_);
+                sequence_++;
+            }
+
+            void Merge(const Slice &key, const Slice &value) override {
+                mem_->Add(sequence_, kTypeMerge, key, value, concurrent_);
+                sequence_++;
+            }
+
+            void DeleteRange(const Slice &begin_key, const Slice &end_key) override {
+                mem_->Add(sequence_, kTypeRangeDeletion, begin_key, end_key, concurrent_);
+                sequence_++;
+            }
+
+            void SingleDelete(const Slice &key) override {
+                mem_->Add(sequence_, kTypeSingleDeletion, key, Slice(), concurrent_);
                 sequence_++;
             }
         };
     }  // namespace
 
-    Status WriteBatchInternal::InsertInto(const WriteBatch *b, MemTable *memtable) {
+    Status WriteBatchInternal::InsertInto(const WriteBatch *b, MemTable *memtable, bool concurrent) {
         MemTableInserter inserter;
         inserter.sequence_ = WriteBatchInternal::Sequence(b);
         inserter.mem_ = memtable;
+        inserter.concurrent_ = concurrent;
         return b->Iterate(&inserter);
     }
 
@@ -15,6 +15,9 @@ namespace leveldb {
     // WriteBatchInternal 提供了静态方法来处理我们在公共 WriteBatch 接口中不需要的 WriteBatch。
     class WriteBatchInternal {
     public:
+        // 批处理标头的字节数（格式见 write_batch.cc）
+        static const size_t kHeader = 12;
+
         // 返回批处理中的条目数
         static int Count(const WriteBatch *batch);
 
@@ -33,7 +36,9 @@ namespace leveldb {
 
         static void SetContents(WriteBatch *batch, const Slice &contents);
 
-        static Status InsertInto(const WriteBatch *batch, MemTable *memtable);
+        // If concurrent is true, other threads may insert into memtable (also
+        // with concurrent == true) at the same time.
+        static Status InsertInto(const WriteBatch *batch, MemTable *memtable, bool concurrent = false);
 
         static void Append(WriteBatch *dst, const WriteBatch *src);
     };
@@ -37,11 +37,42 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
+      case kTypeRangeDeletion:
+        break;  // Kept apart from the other entries
+      case kTypeSingleDeletion:
+        state.append("SingleDelete(");
+        state.append(ikey.user_key.ToString());
+        state.append(")");
+        count++;
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      state.append("DeleteRange(");
+      state.append(ikey.user_key.ToString());
+      state.append(", ");
+      state.append(iter->value().ToString());
+      state.append(")@");
+      state.append(NumberToString(ikey.sequence));
+      count++;
+    }
+    delete iter;
+  }
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -51,6 +82,19 @@ static std::string PrintContents(WriteBatch* b) {
   return state;
 }
 
+// A handler written before batches could hold merge operands or range
+// deletions.
+class PutDeleteHandler : public WriteBatch::Handler {
+ public:
+  std::string seen;
+  void Put(const Slice& key, const Slice& value) override {
+    seen += "Put(" + key.ToString() + ", " + value.ToString() + ")";
+  }
+  void Delete(const Slice& key) override {
+    seen += "Delete(" + key.ToString() + ")";
+  }
+};
+
 TEST(WriteBatchTest, Empty) {
   WriteBatch batch;
   ASSERT_EQ("", PrintContents(&batch));
@@ -72,6 +116,56 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("m1"));
+  batch.Merge(Slice("baz"), Slice("m2"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Merge(baz, m2)@102"
+      "Merge(foo, m1)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+
+  PutDeleteHandler handler;
+  ASSERT_TRUE(batch.Iterate(&handler).IsNotSupportedError());
+  ASSERT_EQ("Put(foo, bar)", handler.seen);
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.DeleteRange(Slice("m"), Slice("z"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Put(foo, bar)@100"
+      "DeleteRange(a, g)@101"
+      "DeleteRange(m, z)@102",
+      PrintContents(&batch));
+
+  PutDeleteHandler handler;
+  ASSERT_TRUE(batch.Iterate(&handler).IsNotSupportedError());
+  ASSERT_EQ("Put(foo, bar)", handler.seen);
+}
+
+TEST(WriteBatchTest, SingleDelete) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.SingleDelete(Slice("foo"));
+  batch.Delete(Slice("box"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Delete(box)@102"
+      "SingleDelete(foo)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -129,6 +223,40 @@ TEST(WriteBatchTest, ApproximateSize) {
   ASSERT_LT(two_keys_size, post_delete_size);
 }
 
+TEST(WriteBatchTest, SliceParts) {
+  WriteBatch batch(1000);
+  ASSERT_EQ(0, WriteBatchInternal::Count(&batch));
+  const Slice key_parts[] = {Slice("f"), Slice("oo")};
+  const Slice value_parts[] = {Slice("b"), Slice(""), Slice("ar")};
+  batch.Put(SliceParts(key_parts, 2), SliceParts(value_parts, 3));
+  batch.Put(SliceParts(key_parts, 1), SliceParts());
+  WriteBatchInternal::SetSequence(&batch, 100);
+
+  WriteBatch expected;
+  expected.Put("foo", "bar");
+  expected.Put("f", "");
+  WriteBatchInternal::SetSequence(&expected, 100);
+  ASSERT_EQ(expected.Data(), batch.Data());
+  ASSERT_EQ("Put(f, )@101Put(foo, bar)@100", PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, FromData) {
+  WriteBatch batch;
+  batch.Put("foo", "bar");
+  batch.Delete("box");
+  WriteBatchInternal::SetSequence(&batch, 100);
+  std::string data = batch.Data();
+  WriteBatch copy(std::move(data));
+  ASSERT_EQ(batch.Data(), copy.Data());
+  ASSERT_EQ("Delete(box)@101Put(foo, bar)@100", PrintContents(&copy));
+
+  // Too short to be a batch: kept as given and reported as corrupt
+  WriteBatch truncated(std::string("x"));
+  ASSERT_EQ("x", truncated.Data());
+  WriteBatch::Handler* handler = nullptr;
+  ASSERT_TRUE(truncated.Iterate(handler).IsCorruption());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+    static const uint64_t kMicrosPerSecond = 1000000;
+    // 令牌桶的补充周期
+    static const uint64_t kMicrosPerRefill = 1000;
+
+    WriteController::WriteController(Env *env)
+            : env_(env), rate_(0), credit_in_bytes_(0), next_refill_time_(0) {}
+
+    void WriteController::SetDelayedWriteRate(uint64_t bytes_per_second) {
+        if (rate_ == 0 && bytes_per_second > 0) {
+            // Start from an empty bucket whenever writes become delayed.
+            credit_in_bytes_ = 0;
+            next_refill_time_ = 0;
+        }
+        rate_ = bytes_per_second;
+    }
+
+    uint64_t WriteController::GetDelay(uint64_t num_bytes) {
+        if (rate_ == 0) {
+            return 0;
+        }
+        if (credit_in_bytes_ >= num_bytes) {
+            credit_in_bytes_ -= num_bytes;
+            return 0;
+        }
+
+        const uint64_t now = env_->NowMicros();
+        if (next_refill_time_ == 0) {
+            next_refill_time_ = now;
+        }
+        if (next_refill_time_ <= now) {
+            // Refill for the time elapsed since the last refill was due.
+            const uint64_t elapsed = now - next_refill_time_ + kMicrosPerRefill;
+            credit_in_bytes_ += static_cast<uint64_t>(static_cast<double>(elapsed) / kMicrosPerSecond * rate_);
+            next_refill_time_ = now + kMicrosPerRefill;
+            if (credit_in_bytes_ >= num_bytes) {
+                credit_in_bytes_ -= num_bytes;
+                return 0;
+            }
+        }
+
+        // Borrow the missing bytes from the future: the write waits until
+        // the bucket would have been refilled with them.
+        const uint64_t bytes_over_budget = num_bytes - credit_in_bytes_;
+        const uint64_t needs_delay =
+                static_cast<uint64_t>(static_cast<double>(bytes_over_budget) / rate_ * kMicrosPerSecond);
+        credit_in_bytes_ = 0;
+        next_refill_time_ += needs_delay;
+        return std::max(next_refill_time_ - now, kMicrosPerRefill);
+    }
+
+}  // namespace leveldb
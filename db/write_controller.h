@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Not thread-safe: callers provide external synchronization (DBImpl::mutex_).
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+    class Env;
+
+    // Spreads the delay imposed on writes while compaction is falling behind
+    // evenly over time: writes are admitted at a fixed byte rate by a token
+    // bucket that is refilled every millisecond.
+    class WriteController {
+    public:
+        explicit WriteController(Env *env);
+
+        WriteController(const WriteController &) = delete;
+
+        WriteController &operator=(const WriteController &) = delete;
+
+        // Admit writes at bytes_per_second.  0 means writes are not delayed.
+        void SetDelayedWriteRate(uint64_t bytes_per_second);
+
+        uint64_t delayed_write_rate() const { return rate_; }
+
+        bool IsDelayed() const { return rate_ > 0; }
+
+        // Return the number of microseconds a write of num_bytes has to wait
+        // before it may proceed, and charge it to the bucket.  The caller is
+        // expected to actually sleep that long.
+        uint64_t GetDelay(uint64_t num_bytes);
+
+    private:
+        Env *const env_;
+        uint64_t rate_;             // Bytes per second, 0 when not delayed
+        uint64_t credit_in_bytes_;  // Tokens left in the bucket
+        uint64_t next_refill_time_; // Micros; 0 until the first delayed write
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
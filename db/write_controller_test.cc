@@ -0,0 +1,78 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+// Env whose clock only moves when the test says so.
+class ManualClockEnv : public EnvWrapper {
+ public:
+  ManualClockEnv() : EnvWrapper(Env::Default()), now_micros_(1000000) {}
+
+  uint64_t NowMicros() override { return now_micros_; }
+
+  void Advance(uint64_t micros) { now_micros_ += micros; }
+
+ private:
+  uint64_t now_micros_;
+};
+
+TEST(WriteControllerTest, NotDelayed) {
+  ManualClockEnv env;
+  WriteController controller(&env);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1 << 30));
+
+  controller.SetDelayedWriteRate(1 << 20);
+  ASSERT_TRUE(controller.IsDelayed());
+  controller.SetDelayedWriteRate(0);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1 << 30));
+}
+
+TEST(WriteControllerTest, LargeWriteWaitsForItsBytes) {
+  ManualClockEnv env;
+  WriteController controller(&env);
+  controller.SetDelayedWriteRate(1 << 20);  // 1MB/s
+
+  // A 1MB write has to wait about a second.
+  uint64_t delay = controller.GetDelay(1 << 20);
+  ASSERT_GE(delay, 990000);
+  ASSERT_LE(delay, 1010000);
+  env.Advance(delay);
+
+  // Once the delay has passed, a small write fits into the next refill.
+  ASSERT_EQ(0, controller.GetDelay(1000));
+}
+
+TEST(WriteControllerTest, SpreadsWritesEvenly) {
+  ManualClockEnv env;
+  WriteController controller(&env);
+  controller.SetDelayedWriteRate(1 << 20);  // 1MB/s
+
+  // 4MB in 100-byte writes, each sleeping as long as it is told.
+  uint64_t total_delay = 0;
+  uint64_t max_delay = 0;
+  for (int i = 0; i < 4 * (1 << 20) / 100; i++) {
+    const uint64_t delay = controller.GetDelay(100);
+    total_delay += delay;
+    if (delay > max_delay) max_delay = delay;
+    env.Advance(delay);
+  }
+  ASSERT_GE(total_delay, 3960000);
+  ASSERT_LE(total_delay, 4040000);
+  // No single write pays for the others.
+  ASSERT_LE(max_delay, 2000);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -287,6 +287,18 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& fname,
+                           const std::string& old_fname,
+                           WritableFile** result) override {
+    Status s = RenameFile(old_fname, fname);
+    if (!s.ok()) {
+      *result = nullptr;
+      return s;
+    }
+    // In-memory files cannot be written over in place, so start afresh.
+    return NewWritableFile(fname, result);
+  }
+
   bool FileExists(const std::string& fname) override {
     MutexLock lock(&mutex_);
     return file_map_.find(fname) != file_map_.end();
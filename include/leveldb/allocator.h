@@ -0,0 +1,40 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An Allocator hands out memory that lives as long as the allocator and is
+// freed all at once with it.  A memtable passes its allocator to the
+// MemTableRep it creates (see memtablerep.h), so that the representation's
+// nodes count towards write_buffer_size and need not be freed one by one.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_ALLOCATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_ALLOCATOR_H_
+
+#include <stddef.h>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT Allocator {
+ public:
+  virtual ~Allocator();
+
+  // Return a pointer to a newly allocated memory block of "bytes" bytes.
+  // REQUIRES: bytes > 0
+  virtual char* Allocate(size_t bytes) = 0;
+
+  // Like Allocate(), with the alignment guarantees provided by malloc.
+  virtual char* AllocateAligned(size_t bytes) = 0;
+
+  // Thread-safe versions of Allocate() and AllocateAligned().  Only used
+  // by representations that support concurrent inserts, and never at the
+  // same time as the unsynchronized versions.
+  virtual char* AllocateConcurrently(size_t bytes) = 0;
+
+  virtual char* AllocateAlignedConcurrently(size_t bytes) = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_ALLOCATOR_H_
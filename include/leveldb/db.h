@@ -8,6 +8,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <string>
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
@@ -88,6 +91,30 @@ namespace leveldb {
         // Note: consider setting options.sync = true.
         virtual Status Delete(const WriteOptions &options, const Slice &key) = 0;
 
+        // Record "value" as a merge operand for "key": Options::merge_operator
+        // combines it with the value of "key" when the key is next read or
+        // compacted, so that read-modify-write updates such as incrementing a
+        // counter need no Get().  Returns OK on success, and a non-OK status
+        // on error, e.g. if the database has no merge operator.
+        // Note: consider setting options.sync = true.
+        virtual Status Merge(const WriteOptions &options, const Slice &key, const Slice &value);
+
+        // Remove the database entries (if any) for the keys in the range
+        // ["begin_key", "end_key").  Writes a single range tombstone instead of
+        // a deletion per key, and compactions drop the keys (and whole files)
+        // it covers.  Returns OK on success, and a non-OK status on error,
+        // e.g. if "end_key" is before "begin_key".
+        // Note: consider setting options.sync = true.
+        virtual Status DeleteRange(const WriteOptions &options, const Slice &begin_key, const Slice &end_key);
+
+        // Remove the database entry for "key", which must have been written
+        // by exactly one Put() since it was last deleted (see
+        // WriteBatch::SingleDelete()).  Unlike Delete(), the deletion is
+        // dropped together with that Put() as soon as a compaction sees
+        // both, so write-once keys cost no tombstone in the deeper levels.
+        // Note: consider setting options.sync = true.
+        virtual Status SingleDelete(const WriteOptions &options, const Slice &key);
+
         // Apply the specified updates to the database.
         // Returns OK on success, non-OK on failure.
         // Note: consider setting options.sync = true.
@@ -102,6 +129,15 @@ namespace leveldb {
         // May return some other Status on an error.
         virtual Status Get(const ReadOptions &options, const Slice &key, std::string *value) = 0;
 
+        // Look up every key of "keys" as Get() would, from a single view of
+        // the database.  Resizes "*values" and "*statuses" to the number of
+        // keys and stores the result of the lookup of keys[i] in
+        // (*values)[i] and (*statuses)[i].  Cheaper than calling Get() once
+        // per key: the state of the database is pinned once for the whole
+        // batch, and each table file is searched once for all its keys.
+        virtual void MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                              std::vector<std::string> *values, std::vector<Status> *statuses);
+
         // Return a heap-allocated iterator over the contents of the database.
         // The result of NewIterator() is initially invalid (caller must
         // call one of the Seek methods on the iterator before using it).
@@ -136,6 +172,11 @@ namespace leveldb {
         //     of the sstables that make up the db contents.
         //  "leveldb.approximate-memory-usage" - returns the approximate number of
         //     bytes of memory in use by the DB.
+        //  "leveldb.num-immutable-mem-table" - returns the number of memtables
+        //     that are full and waiting to be written to a table.
+        //  "leveldb.write-stall-stats" - returns a multi-line string with the
+        //     number of writes delayed or stopped for each reason, the time
+        //     they waited, and the current delayed write rate.
         virtual bool GetProperty(const Slice &property, std::string *value) = 0;
 
         // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -159,6 +200,17 @@ namespace leveldb {
         // Therefore the following call will compact the entire database:
         //    db->CompactRange(nullptr, nullptr);
         virtual void CompactRange(const Slice *begin, const Slice *end) = 0;
+
+        // Write the contents of the memtable to a level-0 table and wait
+        // until that is done.  Afterwards every earlier write is durable,
+        // including those made with WriteOptions::disable_wal.
+        virtual Status FlushMemTable();
+
+        // Sync the log file to storage, making every earlier write that
+        // went through the log durable, as if it had used
+        // WriteOptions::sync.  Writes made with WriteOptions::disable_wal
+        // are not affected; see FlushMemTable().
+        virtual Status SyncWAL();
     };
 
     // Destroy the contents of the specified database.
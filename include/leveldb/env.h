@@ -54,6 +54,18 @@ namespace leveldb {
 
     class WritableFile;
 
+    // A read of "n" bytes at "offset" of "file" submitted to Env::MultiRead().
+    // "scratch" and "result" are used as by RandomAccessFile::Read(), whose
+    // status is stored in "status".
+    struct LEVELDB_EXPORT ReadRequest {
+        const RandomAccessFile *file;
+        uint64_t offset;
+        size_t n;
+        char *scratch;
+        Slice result;
+        Status status;
+    };
+
     /**
      * 系统级别的操作，可以实现自己的逻辑
      */
@@ -117,6 +129,22 @@ namespace leveldb {
         virtual Status NewAppendableFile(const std::string &fname,
                                          WritableFile **result);
 
+        // Rename the existing file "old_fname" to "fname" and open it for
+        // writing from its beginning, without truncating it.  The old
+        // contents past the data written through *result stay in the file,
+        // so callers must be able to tell them apart from new data.  Writing
+        // over a file that already has its final size avoids the metadata
+        // updates that growing a new file costs on every sync.
+        //
+        // On success, stores a pointer to the file in *result and returns
+        // OK.  On failure stores nullptr in *result and returns non-OK.
+        //
+        // May return an IsNotSupportedError error if this Env does not
+        // support reusing files.
+        virtual Status ReuseWritableFile(const std::string &fname,
+                                         const std::string &old_fname,
+                                         WritableFile **result);
+
         /** 如果命名文件存在，则返回true */
         virtual bool FileExists(const std::string &fname) = 0;
 
@@ -228,6 +256,13 @@ namespace leveldb {
 
         // Sleep/delay the thread for the prescribed number of micro-seconds.
         virtual void SleepForMicroseconds(int micros) = 0;
+
+        // Perform the "n" reads of "reqs", which may be on different files, and
+        // return once all of them have completed.  An implementation may issue
+        // the reads concurrently so that their latencies overlap.
+        //
+        // The default implementation performs the reads one at a time.
+        virtual void MultiRead(ReadRequest *reqs, size_t n);
     };
 
     // 用于顺序读取文件的文件抽象类
@@ -374,6 +409,11 @@ namespace leveldb {
             return target_->NewAppendableFile(f, r);
         }
 
+        Status ReuseWritableFile(const std::string &f, const std::string &old_f,
+                                 WritableFile **r) override {
+            return target_->ReuseWritableFile(f, old_f, r);
+        }
+
         bool FileExists(const std::string &f) override {
             return target_->FileExists(f);
         }
@@ -430,6 +470,10 @@ namespace leveldb {
             target_->SleepForMicroseconds(micros);
         }
 
+        void MultiRead(ReadRequest *reqs, size_t n) override {
+            target_->MultiRead(reqs, n);
+        }
+
     private:
         Env *target_;
     };
@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MemTableRep is the data structure a memtable keeps its entries in.
+// Each entry is a length-prefixed internal key followed by the value; the
+// representation only needs to store the entry pointers and hand them back
+// in key order.  Entries live in memory owned by the memtable, so a
+// representation never copies or frees them.
+//
+// The default representation is a skiplist.  Options::memtable_factory
+// selects another one, e.g. one of the builtin ones below:
+//
+//  - NewVectorRepFactory() appends entries to a vector and sorts it only
+//    when it is read.  Fast for bulk loads that do not read back what they
+//    write before the memtable is flushed.
+//  - NewHashSkipListRepFactory() hashes entries on a fixed-length prefix
+//    of their user key into buckets, each a small skiplist.  Point lookups
+//    only search one bucket, but iterating over the whole memtable (for a
+//    DB iterator or a flush) sorts all of its entries first.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "leveldb/allocator.h"
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MemTableRep {
+ public:
+  // Orders memtable entries.  Supplied by the memtable.
+  class KeyComparator {
+   public:
+    virtual ~KeyComparator();
+
+    // Three-way comparison of two entries.
+    virtual int operator()(const char* a, const char* b) const = 0;
+
+    // Return the user key of an entry.
+    virtual Slice UserKey(const char* entry) const = 0;
+
+    // Return an order-preserving summary of an entry: KeyPrefix(a) <
+    // KeyPrefix(b) must imply that a sorts before b.  Representations may
+    // keep it next to their links and compare it before the entries.  The
+    // default returns the same value for every entry, which tells nothing.
+    virtual uint64_t KeyPrefix(const char* /*entry*/) const { return 0; }
+  };
+
+  // Iteration over the entries of a representation, in key order.  An
+  // iterator sees at least the entries inserted before it was created.
+  class Iterator {
+   public:
+    virtual ~Iterator();
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Position at the first entry at or after target.
+    virtual void Seek(const char* target) = 0;
+
+    virtual void SeekToFirst() = 0;
+
+    virtual void SeekToLast() = 0;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep();
+
+  // Insert entry.  Calls are serialized by the memtable, but may run at
+  // the same time as reads and iteration.
+  // REQUIRES: nothing that compares equal to entry is in the
+  // representation.
+  virtual void Insert(const char* entry) = 0;
+
+  // Like Insert(), but several threads may call it at the same time.
+  // Only called if the factory's IsInsertConcurrentlySupported() is true.
+  virtual void InsertConcurrently(const char* entry);
+
+  // Return the first entry at or after target, or nullptr if there is
+  // none.  Used for point lookups: the caller checks that the result has
+  // the user key of target, so representations that partition entries by
+  // key only need to search the partition of target.
+  virtual const char* Lookup(const char* target) = 0;
+
+  // Return a new iterator over all the entries.  The caller must delete it
+  // before the representation.
+  virtual Iterator* NewIterator() = 0;
+
+  // Memory used by the representation outside of the allocator passed to
+  // the factory.
+  virtual size_t ApproximateMemoryUsage() { return 0; }
+};
+
+class LEVELDB_EXPORT MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory();
+
+  // Return the name of this kind of representation.
+  virtual const char* Name() const = 0;
+
+  // Return a new representation ordered by cmp.  Both cmp and allocator
+  // outlive the result, and the representation may allocate its memory
+  // from allocator, which is the memtable's.
+  virtual MemTableRep* CreateMemTableRep(const MemTableRep::KeyComparator& cmp,
+                                         Allocator* allocator) const = 0;
+
+  // Whether the representations support InsertConcurrently().  If not,
+  // Options::allow_concurrent_memtable_write is ignored.
+  virtual bool IsInsertConcurrentlySupported() const { return false; }
+};
+
+// Return a new factory of skiplists, the default representation.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT MemTableRepFactory* NewSkipListRepFactory();
+
+// Return a new factory of vectors that are sorted when read.  Each vector
+// starts out with room for reserved_count entries.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT MemTableRepFactory* NewVectorRepFactory(
+    size_t reserved_count = 0);
+
+// Return a new factory of hash tables of skiplists, with bucket_count
+// buckets.  Entries are hashed on the first prefix_length bytes of their
+// user key (or the whole user key, if shorter).  The bucket array is
+// allocated from the memtable's allocator, so it counts towards
+// write_buffer_size.  Like a FilterPolicy, this assumes that the
+// comparator treats user keys with different bytes as different.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count = 50000);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets DB::Merge() record a change to a value (e.g. "add
+// 3 to this counter", "append this item to this list") without reading
+// the value first.  The database keeps the merge operands written for a
+// key and combines them with the value they were written on top of only
+// when the result is needed: by a read, or by a compaction that can drop
+// the operands.
+//
+// Most people will want one of the builtin operators below.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.
+  virtual const char* Name() const = 0;
+
+  // Combine operands[0,n-1], the operands written by Merge() for key in
+  // the order they were written, with the value they were written on top
+  // of: *existing_value, or nullptr if key had no value (it was never
+  // written, or was deleted).  Store the result in *new_value and return
+  // true.  Return false if the operands or the existing value are
+  // malformed; the read or compaction that needed the result then fails
+  // with a Corruption status.
+  //
+  // A database may call this with any suffix of the operands written for
+  // a key, after replacing the rest with the result of merging them, so
+  // merging must be associative in that sense.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+};
+
+// Return a merge operator for counters.  Values and operands are 8-byte
+// little-endian unsigned integers, and merging adds the operands to the
+// value (0 if the key has none), wrapping around on overflow.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewUInt64AddOperator();
+
+// Return a merge operator for lists.  Merging appends each operand to the
+// value, separated by delimiter.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewStringAppendOperator(char delimiter);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
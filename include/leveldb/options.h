@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "leveldb/export.h"
 
@@ -21,6 +22,10 @@ namespace leveldb {
 
     class Logger;
 
+    class MemTableRepFactory;
+
+    class MergeOperator;
+
     class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -87,6 +92,29 @@ namespace leveldb {
         // 的写缓冲区将导致下次打开数据库时较长的恢复时间。
         size_t write_buffer_size = 4 * 1024 * 1024;
 
+        // Maximum number of write buffers (the active memtable plus the full
+        // ones waiting to be written to disk) held in memory.  Writes stall
+        // only when this many are in use, so values above 2 let the DB absorb
+        // write bursts while earlier memtables are still being compacted.
+        // Full memtables are compacted in the order in which they filled up.
+        //
+        // Default: 2
+        int max_write_buffer_number = 2;
+
+        // Once compaction falls behind (too many level-0 files, or more than
+        // soft_pending_compaction_bytes_limit bytes waiting to be compacted),
+        // writes are slowed down to at most this many bytes per second.  The
+        // further compaction falls behind, the lower the actual rate.
+        //
+        // Default: 16MB/s
+        uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+        // Start slowing down writes once compaction is estimated to be this
+        // many bytes behind.  0 disables the check.
+        //
+        // Default: 1GB
+        uint64_t soft_pending_compaction_bytes_limit = 1024 * 1024 * 1024;
+
         // 数据库可以使用的打开文件数。如果数据库的工作集很大（每2MB的工作集预算一个打开的文件），则
         // 可能需要增加此数量。
         int max_open_files = 1000;
@@ -130,6 +158,35 @@ namespace leveldb {
         // efficiently detect that and will switch to uncompressed mode.
         CompressionType compression = kSnappyCompression;
 
+        // If greater than one, a table builder hands its finished data blocks
+        // to this many background threads for compression while it keeps
+        // adding keys, and writes the compressed blocks out in order as they
+        // come back.  This speeds up memtable flushes and compactions whose
+        // cost is dominated by compression.  Has no effect when "compression"
+        // is kNoCompression.
+        //
+        // Default: 1, which compresses every block inline
+        int compression_parallel_threads = 1;
+
+        // Compress the records of the write-ahead log with the specified
+        // algorithm.  A record stays uncompressed if compression would not
+        // save at least 12.5% of its size.  Compressed logs cannot be read
+        // by versions of leveldb that predate this option.
+        //
+        // Default: kNoCompression
+        CompressionType wal_compression = kNoCompression;
+
+        // If non-zero, keep up to this many obsolete log files around and
+        // write new logs over them instead of creating fresh files.  Writing
+        // over a file that already has its size saves the file system from
+        // updating its metadata on every sync, which makes synced writes
+        // faster.  Logs are then written in a format that older versions
+        // of leveldb cannot read, and they are never appended to by
+        // reuse_logs.
+        //
+        // Default: 0
+        size_t recycle_log_file_num = 0;
+
         // EXPERIMENTAL: If true, append to existing MANIFEST and log files
         // when a database is opened.  This can significantly speed up open.
         //
@@ -140,6 +197,100 @@ namespace leveldb {
         // Many applications will benefit from passing the result of
         // NewBloomFilterPolicy() here.
         const FilterPolicy *filter_policy = nullptr;
+
+        // If non-null, DB::Merge() writes operands that this operator combines
+        // with the existing value of their key when the key is read or
+        // compacted (see leveldb/merge_operator.h).  A database that holds
+        // merge operands must always be opened with the same operator.
+        //
+        // Default: nullptr, which makes DB::Merge() fail
+        const MergeOperator *merge_operator = nullptr;
+
+        // If non-null, memtables keep their entries in representations created
+        // by this factory (see leveldb/memtablerep.h), e.g. the result of
+        // NewVectorRepFactory() for bulk loads.
+        //
+        // Default: nullptr, which keeps entries in a skiplist
+        const MemTableRepFactory *memtable_factory = nullptr;
+
+        // Memtables carve their small allocations out of blocks of this many
+        // bytes.  Larger blocks mean fewer allocations, at the price of a
+        // coarser ApproximateMemoryUsage() and up to one block of unused memory
+        // per memtable.
+        //
+        // Default: 4KB
+        size_t arena_block_size = 4 * 1024;
+
+        // If true, each memtable takes its blocks from one region of
+        // write_buffer_size bytes mapped with mmap() instead of allocating each
+        // block from the heap.  If write_buffer_size is a multiple of 2MB and
+        // the system has huge pages reserved, the region uses them
+        // (MAP_HUGETLB); otherwise it asks for transparent huge pages
+        // (MADV_HUGEPAGE).  Either way large memtables cause fewer TLB misses.
+        // Falls back to the heap where mmap() is not available or fails.  The
+        // region is accounted in full when it is mapped, so the memtable is
+        // full once the region is used up.
+        //
+        // Default: false
+        bool memtable_use_mmap = false;
+
+        // If positive, each memtable keeps a bloom filter over the user keys
+        // written to it, using about this many bits per key, so that Get()
+        // can skip searching memtables that do not hold the key.  Worth it
+        // for workloads that look up many keys that are not in the memtables.
+        // Like filter_policy, it assumes that the comparator treats keys with
+        // different bytes as different.
+        //
+        // Default: 0 (disabled)
+        int memtable_bloom_bits_per_key = 0;
+
+        // If true, DB::Write() pipelines the log write and the memtable
+        // insertion of consecutive write groups: the next group may append
+        // to the log while the previous one is still being inserted into the
+        // memtable.  Writes still become visible in sequence number order.
+        //
+        // Mostly useful when the memtable insertion of a group costs about
+        // as much as its log write.
+        //
+        // Default: false
+        bool enable_pipelined_write = false;
+
+        // If true, the writers of a write group insert their own batches into
+        // the memtable in parallel once the group's log record is written,
+        // instead of the group leader inserting all of them.  Scales memtable
+        // insertion with the number of concurrent writers.
+        //
+        // Default: false
+        bool allow_concurrent_memtable_write = false;
+
+        // Group commit: concurrent writes are gathered into one write group
+        // that shares a single log record (and fsync).  A group stops growing
+        // at max_write_group_size bytes of batches; if the first write of
+        // the group is at most 1/8 of that, at the first write's size plus
+        // max_write_group_size / 8, so that small writes are not slowed down
+        // by large groups.
+        //
+        // Default: 1MB
+        size_t max_write_group_size = 1 << 20;
+
+        // Maximum number of writes in a write group, or 0 for no limit.
+        //
+        // Default: 0
+        int max_write_group_writers = 0;
+
+        // If positive, a sync write that leads a write group first waits this
+        // many microseconds for more writes to join the group, so that they
+        // share its fsync.  Trades latency of sync writes for fewer fsyncs.
+        //
+        // Default: 0
+        uint64_t write_group_linger_micros = 0;
+
+        // If true, sync writes may join a group led by a non-sync write, and
+        // the whole group is then synced.  Otherwise a sync write always
+        // starts a new group behind a non-sync one.
+        //
+        // Default: false
+        bool merge_sync_writes = false;
     };
 
     // 控制读取操作的选项
@@ -159,6 +310,14 @@ namespace leveldb {
         // not have been released).  If "snapshot" is null, use an implicit
         // snapshot of the state at the beginning of this read operation.
         const Snapshot *snapshot = nullptr;
+
+        // If true, DB::MultiGet() submits the data block reads that miss the
+        // block cache in all the files of a level together through
+        // Env::MultiRead(), which may perform them concurrently.  Worth it
+        // when the reads go to a device that serves many requests at once,
+        // such as an SSD; data in the operating system's page cache is
+        // usually faster to read one block at a time.
+        bool async_io = false;
     };
 
     // Options that control write operations
@@ -180,6 +339,13 @@ namespace leveldb {
         // with sync==true has similar crash semantics to a "write()"
         // system call followed by "fsync()".
         bool sync = false;
+
+        // If true, the write goes straight to the memtable without being
+        // written to the log first, and is lost if the process crashes
+        // before the memtable is written to a table.  Meant for loads that
+        // can be redone from scratch; call DB::FlushMemTable() once they are
+        // done to make the data durable.  Cannot be combined with sync.
+        bool disable_wal = false;
     };
 
 }  // namespace leveldb
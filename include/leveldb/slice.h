@@ -122,6 +122,18 @@ namespace leveldb {
         return r;
     }
 
+    // A key or value made of several fragments, written out as their
+    // concatenation without assembling it first.  Like Slice, it does not
+    // own the fragments.
+    struct LEVELDB_EXPORT SliceParts {
+        SliceParts() : parts(nullptr), num_parts(0) {}
+
+        SliceParts(const Slice *parts, int num_parts) : parts(parts), num_parts(num_parts) {}
+
+        const Slice *parts;
+        int num_parts;
+    };
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_SLICE_H_
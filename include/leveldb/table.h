@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -18,6 +20,7 @@ class Footer;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
+struct ReadRequest;
 class TableCache;
 
 // A Table is a sorted map from strings to strings.  Tables are
@@ -50,6 +53,12 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the entries added to the table with
+  // TableBuilder::AddRangeTombstone().  Unlike NewIterator(), it never
+  // reads the file: the range deletions are loaded when the table is
+  // opened.
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -73,8 +82,30 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  struct MultiGetState;
+
+  // InternalGet() for each keys[i] and args[i] in two steps, so that the
+  // block reads of several tables can be performed together.
+  // PrepareMultiGet() finds the data block of each key and appends to
+  // *reads the reads of the blocks that are not in the block cache; keys
+  // that fall in the same block share its read.  Once those reads are
+  // done, FinishMultiGet() completes the lookups, stores the status of
+  // each in (*statuses)[i], and deletes "state".
+  // REQUIRES: keys are sorted
+  MultiGetState* PrepareMultiGet(const ReadOptions&,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<ReadRequest>* reads);
+  void FinishMultiGet(MultiGetState* state,
+                      const std::vector<ReadRequest>& reads,
+                      const std::vector<Slice>& keys,
+                      const std::vector<void*>& args,
+                      void (*handle_result)(void* arg, const Slice& k,
+                                            const Slice& v),
+                      std::vector<Status>* statuses);
+
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeDel(const Slice& range_del_handle_value);
 
   Rep* const rep_;
 };
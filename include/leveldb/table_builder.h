@@ -51,6 +51,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add key,value to the range deletion meta block of the table.  The
+  // entries of that block are kept apart from the ones added by Add() and
+  // are read back by Table::NewRangeTombstoneIterator().
+  // REQUIRES: key is after any previously added range deletion key
+  // according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -75,14 +83,20 @@ class LEVELDB_EXPORT TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
+  // Number of calls to AddRangeTombstone() so far.
+  uint64_t NumRangeTombstones() const;
+
   // Size of the file generated so far.  If invoked after a successful
-  // Finish() call, returns the size of the final generated file.
+  // Finish() call, returns the size of the final generated file.  With
+  // options.compression_parallel_threads > 1, blocks that have not been
+  // written yet are counted with their uncompressed size.
   uint64_t FileSize() const;
 
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void WritePendingBlocks(bool wait);
 
   struct Rep;
   Rep* rep_;
@@ -30,6 +30,8 @@ namespace leveldb {
 
     class Slice;
 
+    struct SliceParts;
+
     /**
      * WriteBatch 主要是将一批操作进行批量处理
      */
@@ -42,10 +44,37 @@ namespace leveldb {
             virtual void Put(const Slice &key, const Slice &value) = 0;
 
             virtual void Delete(const Slice &key) = 0;
+
+            // The default makes Iterate() stop with a NotSupported error, for
+            // handlers written before batches could hold merge operands.
+            virtual void Merge(const Slice &key, const Slice &value);
+
+            // The default makes Iterate() stop with a NotSupported error.
+            virtual void DeleteRange(const Slice &begin_key, const Slice &end_key);
+
+            // The default treats a single deletion as a plain deletion.
+            virtual void SingleDelete(const Slice &key);
+
+        private:
+            friend class WriteBatch;
+
+            // Set by the default Merge() and DeleteRange()
+            bool unsupported_ = false;
         };
 
         WriteBatch();
 
+        // Create an empty batch with room for reserved_bytes of contents
+        // (see ApproximateSize()) before its buffer has to grow.
+        explicit WriteBatch(size_t reserved_bytes);
+
+        // Create a batch from the contents of another batch (see Data()),
+        // taking over the buffer of "rep" instead of copying it.  "rep" is
+        // kept as given: if it is too short to be a batch, Iterate() and
+        // DB::Write() return a Corruption error, and the batch must not be
+        // modified before Clear().
+        explicit WriteBatch(std::string &&rep);
+
         // Intentionally copyable.
         WriteBatch(const WriteBatch &) = default;
 
@@ -56,9 +85,29 @@ namespace leveldb {
         // Store the mapping "key->value" in the database.
         void Put(const Slice &key, const Slice &value);
 
+        // Same as Put(), with the key and the value given as the concatenation
+        // of their parts.  The parts are copied straight into the batch.
+        void Put(const SliceParts &key, const SliceParts &value);
+
         // If the database contains a mapping for "key", erase it.  Else do nothing.
         void Delete(const Slice &key);
 
+        // Record "value" as a merge operand for "key", to be combined with the
+        // value of "key" by Options::merge_operator when it is read.
+        void Merge(const Slice &key, const Slice &value);
+
+        // Erase the mappings of the database for the keys in the range
+        // ["begin_key", "end_key").  Keys written after this in the same batch
+        // are not affected.
+        void DeleteRange(const Slice &begin_key, const Slice &end_key);
+
+        // Erase the mapping for "key", which must have been written by exactly
+        // one Put() since it was last deleted, and never merged or overwritten.
+        // Compactions drop the deletion together with that Put() as soon as
+        // they meet, instead of keeping it down to the last level.  Reads
+        // are undefined if the key does not follow these rules.
+        void SingleDelete(const Slice &key);
+
         // Clear all updates buffered in this batch.
         void Clear();
 
@@ -78,6 +127,10 @@ namespace leveldb {
         // Support for iterating over the contents of a batch.
         Status Iterate(Handler *handler) const;
 
+        // The serialized contents of the batch, which WriteBatch(std::string&&)
+        // turns back into a batch.
+        const std::string &Data() const { return rep_; }
+
     private:
         friend class WriteBatchInternal;
 
@@ -63,10 +63,6 @@ Status Footer::DecodeFrom(Slice* input) {
 
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
@@ -75,8 +71,22 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
   if (!s.ok()) {
     delete[] buf;
+    result->data = Slice();
+    result->cachable = false;
+    result->heap_allocated = false;
     return s;
   }
+  return DecodeBlock(options, handle, buf, contents, result);
+}
+
+Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                   char* buf, const Slice& contents, BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  size_t n = static_cast<size_t>(handle.size());
+  Status s;
   if (contents.size() != n + kBlockTrailerSize) {
     delete[] buf;
     return Status::Corruption("truncated block read");
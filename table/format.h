@@ -79,6 +79,9 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Name of the meta block that holds the range deletions of a table.
+static const char kRangeDelBlockName[] = "leveldb.range_del";
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -90,6 +93,13 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Check and uncompress "contents", the block identified by "handle" and its
+// trailer as read into "buf", and store the block in *result like
+// ReadBlock().  Takes ownership of "buf", which must have been allocated
+// with new[] to hold handle.size() + kBlockTrailerSize bytes.
+Status DecodeBlock(const ReadOptions& options, const BlockHandle& handle,
+                   char* buf, const Slice& contents, BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -22,6 +22,7 @@ struct Table::Rep {
     delete filter;
     delete[] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
@@ -33,6 +34,11 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;  // nullptr if the table has no range deletions
+  // Non-ok if the range deletions of the table could not be read.  Unlike
+  // the filter they are needed for correct reads, so the error is reported
+  // by NewRangeTombstoneIterator().
+  Status range_del_status;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -74,6 +80,7 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->range_del_block = nullptr;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -82,29 +89,38 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
+  // An empty metaindex block only holds its restart array: one restart
+  // point and the number of restarts.
+  if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
     return;  // Do not need any metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // The filter is not needed for operation, but the range deletions the
+    // metaindex may point to are
+    rep_->range_del_status = s;
     return;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    ReadRangeDel(iter->value());
   }
   delete iter;
   delete meta;
@@ -133,6 +149,28 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadRangeDel(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle range_del_handle;
+  Status s = range_del_handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    rep_->range_del_status = s;
+    return;
+  }
+
+  // Always verify the checksum: a corrupted tombstone would resurrect or
+  // hide keys instead of failing the read.
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, range_del_handle, &block);
+  if (!s.ok()) {
+    rep_->range_del_status = s;
+    return;
+  }
+  rep_->range_del_block = new Block(block);
+}
+
 Table::~Table() { delete rep_; }
 
 static void DeleteBlock(void* arg, void* ignored) {
@@ -150,6 +188,20 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+// Return an iterator over "block" that deletes it, or releases it from
+// "block_cache" if "cache_handle" is non-null, when it is deleted.
+static Iterator* NewBlockIterator(const Comparator* comparator, Block* block,
+                                  Cache* block_cache,
+                                  Cache::Handle* cache_handle) {
+  Iterator* iter = block->NewIterator(comparator);
+  if (cache_handle == nullptr) {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  return iter;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
@@ -195,12 +247,8 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
-    }
+    iter = NewBlockIterator(table->rep_->options.comparator, block,
+                            block_cache, cache_handle);
   } else {
     iter = NewErrorIterator(s);
   }
@@ -213,6 +261,16 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (!rep_->range_del_status.ok()) {
+    return NewErrorIterator(rep_->range_del_status);
+  }
+  if (rep_->range_del_block == nullptr) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
@@ -243,6 +301,149 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   return s;
 }
 
+// Marks the keys of a MultiGetState that need no data block.
+static const size_t kNoDataBlock = ~static_cast<size_t>(0);
+
+struct Table::MultiGetState {
+  struct DataBlock {
+    std::string index_value;       // Encoded handle of the block
+    BlockHandle handle;
+    Cache::Handle* cache_handle;  // Non-null if found in the block cache
+    size_t read;                  // Index of the read of the block otherwise
+  };
+
+  ReadOptions options;
+  std::vector<DataBlock> blocks;
+  std::vector<size_t> key_block;  // Index in blocks, or kNoDataBlock
+  std::vector<Status> key_status;
+};
+
+Table::MultiGetState* Table::PrepareMultiGet(const ReadOptions& options,
+                                             const std::vector<Slice>& keys,
+                                             std::vector<ReadRequest>* reads) {
+  MultiGetState* state = new MultiGetState;
+  state->options = options;
+  state->key_block.assign(keys.size(), kNoDataBlock);
+  state->key_status.resize(keys.size());
+  Cache* block_cache = rep_->options.block_cache;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  for (size_t i = 0; i < keys.size(); i++) {
+    const Slice& k = keys[i];
+    Status& s = state->key_status[i];
+    iiter->Seek(k);
+    if (iiter->Valid()) {
+      Slice handle_value = iiter->value();
+      FilterBlockReader* filter = rep_->filter;
+      BlockHandle handle;
+      s = handle.DecodeFrom(&handle_value);
+      if (s.ok() && filter != nullptr &&
+          !filter->KeyMayMatch(handle.offset(), k)) {
+        // Not found
+      } else if (s.ok()) {
+        // Keys are sorted, so the keys of a block are next to each other
+        if (state->blocks.empty() ||
+            Slice(state->blocks.back().index_value) != iiter->value()) {
+          MultiGetState::DataBlock block;
+          block.index_value = iiter->value().ToString();
+          block.handle = handle;
+          block.cache_handle = nullptr;
+          block.read = 0;
+          if (block_cache != nullptr) {
+            char cache_key_buffer[16];
+            EncodeFixed64(cache_key_buffer, rep_->cache_id);
+            EncodeFixed64(cache_key_buffer + 8, handle.offset());
+            block.cache_handle = block_cache->Lookup(
+                Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+          }
+          if (block.cache_handle == nullptr) {
+            ReadRequest req;
+            req.file = rep_->file;
+            req.offset = handle.offset();
+            req.n = static_cast<size_t>(handle.size()) + kBlockTrailerSize;
+            req.scratch = new char[req.n];
+            block.read = reads->size();
+            reads->push_back(req);
+          }
+          state->blocks.push_back(block);
+        }
+        state->key_block[i] = state->blocks.size() - 1;
+      }
+    }
+    if (s.ok()) {
+      s = iiter->status();
+    }
+  }
+  delete iiter;
+  return state;
+}
+
+void Table::FinishMultiGet(MultiGetState* state,
+                           const std::vector<ReadRequest>& reads,
+                           const std::vector<Slice>& keys,
+                           const std::vector<void*>& args,
+                           void (*handle_result)(void*, const Slice&,
+                                                 const Slice&),
+                           std::vector<Status>* statuses) {
+  const Comparator* comparator = rep_->options.comparator;
+  Cache* block_cache = rep_->options.block_cache;
+  std::vector<Iterator*> block_iters;
+  block_iters.reserve(state->blocks.size());
+  for (const MultiGetState::DataBlock& b : state->blocks) {
+    if (b.cache_handle != nullptr) {
+      Block* block = reinterpret_cast<Block*>(block_cache->Value(b.cache_handle));
+      block_iters.push_back(
+          NewBlockIterator(comparator, block, block_cache, b.cache_handle));
+      continue;
+    }
+    const ReadRequest& req = reads[b.read];
+    BlockContents contents;
+    Status s = req.status;
+    if (s.ok()) {
+      s = DecodeBlock(state->options, b.handle, req.scratch, req.result,
+                      &contents);
+    } else {
+      delete[] req.scratch;
+    }
+    if (!s.ok()) {
+      block_iters.push_back(NewErrorIterator(s));
+      continue;
+    }
+    Block* block = new Block(contents);
+    Cache::Handle* cache_handle = nullptr;
+    if (block_cache != nullptr && contents.cachable &&
+        state->options.fill_cache) {
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
+      EncodeFixed64(cache_key_buffer + 8, b.handle.offset());
+      cache_handle = block_cache->Insert(
+          Slice(cache_key_buffer, sizeof(cache_key_buffer)), block,
+          block->size(), &DeleteCachedBlock);
+    }
+    block_iters.push_back(
+        NewBlockIterator(comparator, block, block_cache, cache_handle));
+  }
+
+  statuses->assign(keys.size(), Status::OK());
+  for (size_t i = 0; i < keys.size(); i++) {
+    Status& s = (*statuses)[i];
+    if (state->key_block[i] != kNoDataBlock) {
+      Iterator* block_iter = block_iters[state->key_block[i]];
+      block_iter->Seek(keys[i]);
+      if (block_iter->Valid()) {
+        (*handle_result)(args[i], block_iter->key(), block_iter->value());
+      }
+      s = block_iter->status();
+    }
+    if (s.ok()) {
+      s = state->key_status[i];
+    }
+  }
+  for (Iterator* block_iter : block_iters) {
+    delete block_iter;
+  }
+  delete state;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
@@ -6,6 +6,10 @@
 
 #include <assert.h>
 
+#include <deque>
+#include <thread>
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
@@ -13,11 +17,64 @@
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+namespace {
+
+// Compress "raw" with "*type" into "*compressed" and return the block
+// contents to write.  Resets "*type" to kNoCompression if the block is
+// stored uncompressed.
+Slice CompressBlock(const Slice& raw, std::string* compressed,
+                    CompressionType* type) {
+  // TODO(postrelease): Support more compression options: zlib?
+  switch (*type) {
+    case kNoCompression:
+      return raw;
+
+    case kSnappyCompression: {
+      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
+          compressed->size() < raw.size() - (raw.size() / 8u)) {
+        return *compressed;
+      }
+      // Snappy not supported, or compressed less than 12.5%, so just
+      // store uncompressed form
+      *type = kNoCompression;
+      return raw;
+    }
+  }
+  *type = kNoCompression;
+  return raw;
+}
+
+// A data block handed to the compression threads.  Only "done" is shared
+// with them; the other fields are set by the builder before the block is
+// queued, by the compression thread that picks it up, or by the builder
+// once the next key is known.
+struct ParallelBlock {
+  std::string raw;
+  std::string compressed;
+  CompressionType type;
+  Slice contents;  // Points into raw or compressed once done
+
+  // Separator between this block and the next one, used as its index key.
+  bool has_index_key = false;
+  std::string index_key;
+
+  // Keys of the block, added to the filter once the offset is known.
+  std::string keys;
+  std::vector<size_t> key_sizes;
+
+  bool done = false;
+};
+
+}  // namespace
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
@@ -26,13 +83,65 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
+        num_range_tombstones(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        compression_work_cv(&compression_mu),
+        compression_done_cv(&compression_mu),
+        compression_shutting_down(false),
+        pending_raw_bytes(0) {
     index_block_options.block_restart_interval = 1;
+    if (opt.compression != kNoCompression &&
+        opt.compression_parallel_threads > 1) {
+      for (int i = 0; i < opt.compression_parallel_threads; i++) {
+        compression_threads.emplace_back(&Rep::CompressionThread, this);
+      }
+    }
+  }
+
+  bool parallel_compression() const { return !compression_threads.empty(); }
+
+  void CompressionThread() {
+    MutexLock l(&compression_mu);
+    while (true) {
+      while (compression_queue.empty() && !compression_shutting_down) {
+        compression_work_cv.Wait();
+      }
+      if (compression_shutting_down) {
+        return;
+      }
+      ParallelBlock* block = compression_queue.front();
+      compression_queue.pop_front();
+      compression_mu.Unlock();
+      block->contents =
+          CompressBlock(block->raw, &block->compressed, &block->type);
+      compression_mu.Lock();
+      block->done = true;
+      compression_done_cv.SignalAll();
+    }
+  }
+
+  // Stop the compression threads and drop the blocks they did not write.
+  void StopCompressionThreads() {
+    if (!parallel_compression()) return;
+    compression_mu.Lock();
+    compression_shutting_down = true;
+    compression_work_cv.SignalAll();
+    compression_mu.Unlock();
+    for (std::thread& thread : compression_threads) {
+      thread.join();
+    }
+    compression_threads.clear();
+    for (ParallelBlock* block : pending_blocks) {
+      delete block;
+    }
+    pending_blocks.clear();
+    pending_raw_bytes = 0;
   }
 
   Options options;
@@ -42,8 +151,11 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
+  std::string last_range_tombstone_key;
   int64_t num_entries;
+  int64_t num_range_tombstones;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
@@ -60,6 +172,28 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;
+
+  // Parallel compression (options.compression_parallel_threads > 1).  The
+  // builder queues each finished data block and keeps adding keys; blocks
+  // are written to the file, in order, as their compression completes.
+  // Their index entries and filter keys are only added then, because the
+  // offset of a block is not known before the blocks ahead of it have
+  // been written.
+  //
+  // Invariant: r->pending_index_entry is true only if the last element of
+  // pending_blocks has no index key yet.
+  std::vector<std::thread> compression_threads;
+  port::Mutex compression_mu;
+  port::CondVar compression_work_cv;
+  port::CondVar compression_done_cv;
+  bool compression_shutting_down GUARDED_BY(compression_mu);
+  std::deque<ParallelBlock*> compression_queue GUARDED_BY(compression_mu);
+  std::deque<ParallelBlock*> pending_blocks;  // In file order
+  uint64_t pending_raw_bytes;  // Uncompressed size of pending_blocks
+
+  // Keys of data_block, kept for the filter block.
+  std::string block_keys;
+  std::vector<size_t> block_key_sizes;
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
@@ -71,6 +205,7 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  rep_->StopCompressionThreads();
   delete rep_->filter_block;
   delete rep_;
 }
@@ -99,7 +234,15 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
 
-  if (r->pending_index_entry) {
+  if (r->pending_index_entry && r->parallel_compression()) {
+    assert(r->data_block.empty());
+    r->options.comparator->FindShortestSeparator(&r->last_key, key);
+    ParallelBlock* block = r->pending_blocks.back();
+    block->index_key = r->last_key;
+    block->has_index_key = true;
+    r->pending_index_entry = false;
+    WritePendingBlocks(false);
+  } else if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
     std::string handle_encoding;
@@ -109,7 +252,12 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 
   if (r->filter_block != nullptr) {
-    r->filter_block->AddKey(key);
+    if (r->parallel_compression()) {
+      r->block_keys.append(key.data(), key.size());
+      r->block_key_sizes.push_back(key.size());
+    } else {
+      r->filter_block->AddKey(key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -122,12 +270,42 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  if (r->num_range_tombstones > 0) {
+    assert(r->options.comparator->Compare(
+               key, Slice(r->last_range_tombstone_key)) > 0);
+  }
+  r->last_range_tombstone_key.assign(key.data(), key.size());
+  r->num_range_tombstones++;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  if (r->parallel_compression()) {
+    ParallelBlock* block = new ParallelBlock;
+    block->raw = r->data_block.Finish().ToString();
+    block->type = r->options.compression;
+    block->keys.swap(r->block_keys);
+    block->key_sizes.swap(r->block_key_sizes);
+    r->data_block.Reset();
+    r->pending_blocks.push_back(block);
+    r->pending_raw_bytes += block->raw.size() + kBlockTrailerSize;
+    r->compression_mu.Lock();
+    r->compression_queue.push_back(block);
+    r->compression_work_cv.Signal();
+    r->compression_mu.Unlock();
+    r->pending_index_entry = true;
+    WritePendingBlocks(false);
+    return;
+  }
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
     r->pending_index_entry = true;
@@ -147,31 +325,61 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   Rep* r = rep_;
   Slice raw = block->Finish();
 
-  Slice block_contents;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
+  Slice block_contents = CompressBlock(raw, &r->compressed_output, &type);
+  WriteRawBlock(block_contents, type, handle);
+  r->compressed_output.clear();
+  block->Reset();
+}
 
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
+void TableBuilder::WritePendingBlocks(bool wait) {
+  Rep* r = rep_;
+  // Bound the memory held by blocks waiting to be compressed or written.
+  const size_t max_pending = 2 * r->compression_threads.size();
+  bool wrote = false;
+  while (!r->pending_blocks.empty()) {
+    ParallelBlock* block = r->pending_blocks.front();
+    if (!block->has_index_key) {
+      // Wait for the first key of the next block
       break;
     }
+    {
+      MutexLock l(&r->compression_mu);
+      if (!block->done) {
+        if (!wait && r->pending_blocks.size() <= max_pending) {
+          break;
+        }
+        while (!block->done) {
+          r->compression_done_cv.Wait();
+        }
+      }
+    }
+    r->pending_blocks.pop_front();
+    r->pending_raw_bytes -= block->raw.size() + kBlockTrailerSize;
+
+    if (ok()) {
+      BlockHandle handle;
+      WriteRawBlock(block->contents, block->type, &handle);
+      if (ok()) {
+        std::string handle_encoding;
+        handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(block->index_key, Slice(handle_encoding));
+        wrote = true;
+      }
+      if (r->filter_block != nullptr) {
+        const char* key = block->keys.data();
+        for (size_t size : block->key_sizes) {
+          r->filter_block->AddKey(Slice(key, size));
+          key += size;
+        }
+        r->filter_block->StartBlock(r->offset);
+      }
+    }
+    delete block;
+  }
+  if (wrote && ok()) {
+    r->status = r->file->Flush();
   }
-  WriteRawBlock(block_contents, type, handle);
-  r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -201,7 +409,19 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  if (r->parallel_compression()) {
+    if (ok() && r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      r->pending_blocks.back()->index_key = r->last_key;
+      r->pending_blocks.back()->has_index_key = true;
+      r->pending_index_entry = false;
+    }
+    WritePendingBlocks(true);
+    r->StopCompressionThreads();
+  }
+
+  BlockHandle filter_block_handle, range_del_block_handle,
+      metaindex_block_handle, index_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
@@ -209,6 +429,11 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
+  // Write range deletion block
+  if (ok() && r->num_range_tombstones > 0) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
@@ -220,6 +445,12 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (r->num_range_tombstones > 0) {
+      // "leveldb.range_del" sorts after "filter.*"
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -256,10 +487,18 @@ void TableBuilder::Abandon() {
   Rep* r = rep_;
   assert(!r->closed);
   r->closed = true;
+  r->StopCompressionThreads();
 }
 
 uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
-uint64_t TableBuilder::FileSize() const { return rep_->offset; }
+uint64_t TableBuilder::NumRangeTombstones() const {
+  return rep_->num_range_tombstones;
+}
+
+uint64_t TableBuilder::FileSize() const {
+  // Blocks still being compressed count with their uncompressed size
+  return rep_->offset + rep_->pending_raw_bytes;
+}
 
 }  // namespace leveldb
@@ -13,11 +13,13 @@
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -376,30 +378,35 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  int compression_threads;
 };
 
 static const TestArgs kTestArgList[] = {
-    {TABLE_TEST, false, 16},
-    {TABLE_TEST, false, 1},
-    {TABLE_TEST, false, 1024},
-    {TABLE_TEST, true, 16},
-    {TABLE_TEST, true, 1},
-    {TABLE_TEST, true, 1024},
-
-    {BLOCK_TEST, false, 16},
-    {BLOCK_TEST, false, 1},
-    {BLOCK_TEST, false, 1024},
-    {BLOCK_TEST, true, 16},
-    {BLOCK_TEST, true, 1},
-    {BLOCK_TEST, true, 1024},
+    {TABLE_TEST, false, 16, 0},
+    {TABLE_TEST, false, 1, 0},
+    {TABLE_TEST, false, 1024, 0},
+    {TABLE_TEST, true, 16, 0},
+    {TABLE_TEST, true, 1, 0},
+    {TABLE_TEST, true, 1024, 0},
+
+    // Compress the data blocks of tables in the background
+    {TABLE_TEST, false, 16, 4},
+    {TABLE_TEST, true, 16, 4},
+
+    {BLOCK_TEST, false, 16, 0},
+    {BLOCK_TEST, false, 1, 0},
+    {BLOCK_TEST, false, 1024, 0},
+    {BLOCK_TEST, true, 16, 0},
+    {BLOCK_TEST, true, 1, 0},
+    {BLOCK_TEST, true, 1024, 0},
 
     // Restart interval does not matter for memtables
-    {MEMTABLE_TEST, false, 16},
-    {MEMTABLE_TEST, true, 16},
+    {MEMTABLE_TEST, false, 16, 0},
+    {MEMTABLE_TEST, true, 16, 0},
 
     // Do not bother with restart interval variations for DB
-    {DB_TEST, false, 16},
-    {DB_TEST, true, 16},
+    {DB_TEST, false, 16, 0},
+    {DB_TEST, true, 16, 0},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -416,6 +423,7 @@ class Harness : public testing::Test {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.compression_parallel_threads = args.compression_threads;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -721,6 +729,121 @@ TEST_F(Harness, RandomizedLongDB) {
   ASSERT_GT(files, 0);
 }
 
+// Builds one block per child and merges their iterators.
+class MergerTest : public testing::Test {
+ public:
+  MergerTest() {
+    for (int i = 0; i < 20; i++) {
+      children_.push_back(new BlockConstructor(BytewiseComparator()));
+    }
+  }
+
+  ~MergerTest() override {
+    for (BlockConstructor* c : children_) {
+      delete c;
+    }
+  }
+
+  Iterator* NewMerger() {
+    Options options;
+    options.block_restart_interval = 4;
+    std::vector<Iterator*> iters;
+    for (BlockConstructor* c : children_) {
+      std::vector<std::string> keys;
+      KVMap kvmap{STLLessThan(BytewiseComparator())};
+      c->Finish(options, &keys, &kvmap);
+      iters.push_back(c->NewIterator());
+    }
+    return NewMergingIterator(BytewiseComparator(), &iters[0], iters.size());
+  }
+
+  static std::string Entry(Iterator* iter) {
+    return iter->Valid()
+               ? iter->key().ToString() + "->" + iter->value().ToString()
+               : "(invalid)";
+  }
+
+  std::vector<BlockConstructor*> children_;
+};
+
+TEST_F(MergerTest, Randomized) {
+  // Spread distinct keys over the children, a few children staying empty
+  Random rnd(test::RandomSeed());
+  KVMap model{STLLessThan(BytewiseComparator())};
+  for (int i = 0; i < 2000; i++) {
+    std::string key = test::RandomKey(&rnd, rnd.Skewed(4));
+    if (model.count(key) != 0) continue;
+    const int child = rnd.Uniform(children_.size() - 3);
+    const std::string value = std::to_string(child);
+    children_[child]->Add(key, value);
+    model[key] = value;
+  }
+  Iterator* iter = NewMerger();
+
+  KVMap::const_iterator expected = model.end();
+  for (int i = 0; i < 10000; i++) {
+    switch (rnd.Uniform(5)) {
+      case 0:
+        iter->SeekToFirst();
+        expected = model.begin();
+        break;
+      case 1:
+        iter->SeekToLast();
+        expected = model.empty() ? model.end() : std::prev(model.end());
+        break;
+      case 2: {
+        const std::string target = test::RandomKey(&rnd, rnd.Skewed(4));
+        iter->Seek(target);
+        expected = model.lower_bound(target);
+        break;
+      }
+      case 3:
+        if (expected != model.end()) {
+          iter->Next();
+          ++expected;
+        }
+        break;
+      case 4:
+        if (expected != model.end()) {
+          iter->Prev();
+          expected = (expected == model.begin()) ? model.end()
+                                                 : std::prev(expected);
+        }
+        break;
+    }
+    ASSERT_EQ(expected == model.end()
+                  ? "(invalid)"
+                  : expected->first + "->" + expected->second,
+              Entry(iter));
+  }
+  ASSERT_TRUE(iter->status().ok());
+  delete iter;
+}
+
+TEST_F(MergerTest, DuplicateKeys) {
+  // A key present in several children is yielded once per child, in child
+  // order going forward and in reverse child order going backward
+  for (int child : {3, 0, 7}) {
+    children_[child]->Add("b", std::to_string(child));
+  }
+  children_[5]->Add("a", "5");
+  children_[1]->Add("c", "1");
+  Iterator* iter = NewMerger();
+
+  std::string forward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += Entry(iter) + " ";
+  }
+  ASSERT_EQ("a->5 b->0 b->3 b->7 c->1 ", forward);
+
+  std::string backward;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    backward += Entry(iter) + " ";
+  }
+  ASSERT_EQ("c->1 b->7 b->3 b->0 a->5 ", backward);
+  delete iter;
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -745,6 +868,46 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+TEST(MemTableTest, MmapArenaFitsWriteBuffer) {
+  // A memtable has room for writes until its region is used up, whether or
+  // not the region gets huge pages, and whatever the write buffer size.  The
+  // region is never larger than the write buffer and always reported in full.
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (size_t write_buffer_size : {3 << 20, (3 << 20) + 100, 4 << 20}) {
+    Options options;
+    options.write_buffer_size = write_buffer_size;
+    options.memtable_use_mmap = true;
+    options.memtable_bloom_bits_per_key = 10;
+    MemTable* memtable = new MemTable(cmp, options);
+    memtable->Ref();
+    ASSERT_LE(memtable->ApproximateMemoryUsage(), write_buffer_size);
+    ASSERT_LE(memtable->MappedBytes(), write_buffer_size);
+
+    SequenceNumber seq = 100;
+    WriteBatch batch;
+    WriteBatchInternal::SetSequence(&batch, seq);
+    batch.Put("k1", "v1");
+    ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtable).ok());
+    ASSERT_LE(memtable->ApproximateMemoryUsage(), write_buffer_size);
+
+    // Fill it until it reports being full
+    char key[32];
+    for (int i = 0; memtable->ApproximateMemoryUsage() <= write_buffer_size;
+         i++) {
+      batch.Clear();
+      WriteBatchInternal::SetSequence(&batch, ++seq);
+      snprintf(key, sizeof(key), "key%08d", i);
+      batch.Put(key, std::string(100, 'v'));
+      ASSERT_TRUE(WriteBatchInternal::InsertInto(&batch, memtable).ok());
+      ASSERT_LE(memtable->MappedBytes(), write_buffer_size);
+      ASSERT_LE(memtable->MappedBytes(), memtable->ApproximateMemoryUsage());
+    }
+    ASSERT_LE(memtable->ApproximateMemoryUsage(),
+              write_buffer_size + 2 * options.arena_block_size);
+    memtable->Unref();
+  }
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -826,6 +989,55 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Compressing the data blocks in the background must produce the same
+// file as compressing them inline.
+TEST(TableTest, ParallelCompression) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  Random rnd(301);
+  std::vector<std::string> keys, values;
+  std::string tmp;
+  for (int i = 0; i < 2000; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    keys.push_back(buf);
+    values.push_back(test::CompressibleString(&rnd, 0.25, rnd.Uniform(500),
+                                              &tmp).ToString());
+  }
+
+  std::string contents[2];
+  for (int threads : {1, 4}) {
+    Options options;
+    options.block_size = 1024;
+    options.compression = kSnappyCompression;
+    options.compression_parallel_threads = threads;
+    options.filter_policy = policy;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    for (size_t i = 0; i < keys.size(); i++) {
+      builder.Add(keys[i], values[i]);
+      ASSERT_GE(builder.FileSize(), sink.contents().size());
+    }
+    ASSERT_LEVELDB_OK(builder.Finish());
+    ASSERT_EQ(sink.contents().size(), builder.FileSize());
+    contents[threads == 1 ? 0 : 1] = sink.contents();
+  }
+  ASSERT_TRUE(contents[0] == contents[1]);
+
+  // Abandoning a builder with blocks in flight must not leak or hang
+  {
+    Options options;
+    options.block_size = 256;
+    options.compression_parallel_threads = 4;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    for (size_t i = 0; i < keys.size(); i++) {
+      builder.Add(keys[i], values[i]);
+    }
+    builder.Abandon();
+  }
+  delete policy;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,28 +4,75 @@
 
 #include "util/arena.h"
 
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // HAVE_MMAP
+
+#include <thread>
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
-    static const int kBlockSize = 4096;
+    Allocator::~Allocator() = default;
+
+    // MAP_HUGETLB 要求长度是大页大小的整数倍
+    static const size_t kHugePageSize = 2 << 20;
 
-    Arena::Arena() : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    // 每个 CPU 一个分片（取整到 2 的幂）
+    static size_t ShardCount() {
+        size_t cpus = std::thread::hardware_concurrency();
+        size_t count = 1;
+        while (count < cpus && count < 64) {
+            count <<= 1;
+        }
+        return count;
+    }
+
+    // 每个线程固定使用的分片编号，按线程首次并发分配的顺序轮流分配
+    static size_t ThreadShardHint() {
+        static std::atomic<size_t> next_hint(0);
+        static thread_local size_t hint = next_hint.fetch_add(1, std::memory_order_relaxed);
+        return hint;
+    }
+
+    Arena::Arena(size_t block_size, size_t mmap_region_size)
+            : block_size_(block_size),
+              mmap_region_size_(mmap_region_size),
+              alloc_ptr_(nullptr),
+              alloc_bytes_remaining_(0),
+              region_(nullptr),
+              region_size_(0),
+              region_ptr_(nullptr),
+              region_bytes_remaining_(0),
+              mmap_failed_(false),
+              memory_usage_(0),
+              shard_mask_(ShardCount() - 1),
+              shards_(new Shard[shard_mask_ + 1]) {}
 
     Arena::~Arena() {
+        delete[] shards_;
         for (size_t i = 0; i < blocks_.size(); i++) {
             delete[] blocks_[i];
         }
+#if HAVE_MMAP
+        if (region_ != nullptr) {
+            munmap(region_, region_size_);
+        }
+#endif  // HAVE_MMAP
     }
 
     char *Arena::AllocateFallback(size_t bytes) {
-        if (bytes > kBlockSize / 4) {
+        if (bytes > block_size_ / 4) {
             // 对象超过我们块大小的四分之一。单独分配它，以避免浪费剩余字节过多的空间。
             char *result = AllocateNewBlock(bytes);
             return result;
         }
 
-        // 创建了 kBlockSize 大小的内存空间
-        alloc_ptr_ = AllocateNewBlock(kBlockSize);
-        alloc_bytes_remaining_ = kBlockSize;
+        // 创建了 block_size_ 大小的内存空间
+        alloc_ptr_ = AllocateNewBlock(block_size_);
+        alloc_bytes_remaining_ = block_size_;
 
         char *result = alloc_ptr_;
         // 更新使用状态
@@ -58,11 +105,117 @@ namespace leveldb {
         return result;
     }
 
+    char *Arena::AllocateConcurrently(size_t bytes) {
+        return AllocateFromShard(bytes, false);
+    }
+
+    char *Arena::AllocateAlignedConcurrently(size_t bytes) {
+        return AllocateFromShard(bytes, true);
+    }
+
+    char *Arena::AllocateFromShard(size_t bytes, bool aligned) {
+        assert(bytes > 0);
+        if (bytes > block_size_ / 4) {
+            // 与 AllocateFallback() 一样，大对象单独分配一个块
+            MutexLock l(&mu_);
+            return AllocateNewBlock(bytes);
+        }
+
+        const int align = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+        Shard *shard = &shards_[ThreadShardHint() & shard_mask_];
+        MutexLock l(&shard->mu);
+        size_t slop = 0;
+        if (aligned) {
+            size_t current_mod = reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align - 1);
+            slop = (current_mod == 0 ? 0 : align - current_mod);
+        }
+        if (bytes + slop > shard->alloc_bytes_remaining) {
+            // 只有分片换块时才需要 arena 的锁；新块总是对齐的
+            {
+                MutexLock arena_lock(&mu_);
+                shard->alloc_ptr = AllocateNewBlock(block_size_);
+            }
+            shard->alloc_bytes_remaining = block_size_;
+            slop = 0;
+        }
+        char *result = shard->alloc_ptr + slop;
+        shard->alloc_ptr += bytes + slop;
+        shard->alloc_bytes_remaining -= bytes + slop;
+        assert(!aligned || (reinterpret_cast<uintptr_t>(result) & (align - 1)) == 0);
+        return result;
+    }
+
     char *Arena::AllocateNewBlock(size_t block_bytes) {
+        if (mmap_region_size_ > 0 && !mmap_failed_) {
+            char *result = AllocateFromRegion(block_bytes);
+            if (result != nullptr) {
+                return result;
+            }
+        }
         char *result = new char[block_bytes];
         blocks_.push_back(result);
         memory_usage_.fetch_add(block_bytes + sizeof(char *), std::memory_order_relaxed);
         return result;
     }
 
+    char *Arena::AllocateFromRegion(size_t block_bytes) {
+#if HAVE_MMAP
+        // 保持分出去的块按指针大小对齐
+        const size_t align = sizeof(void *) > 8 ? sizeof(void *) : 8;
+        block_bytes = (block_bytes + align - 1) & ~(align - 1);
+        if (block_bytes > mmap_region_size_ / 4) {
+            // 大块交给 new[]，否则会丢弃当前区域剩下的大部分
+            return nullptr;
+        }
+        if (region_ != nullptr) {
+            if (block_bytes > region_bytes_remaining_) {
+                // 每个 arena 只映射一个区域，用完之后的块由 new[] 分配并计入用量
+                return nullptr;
+            }
+        } else {
+            // 区域长度向下取整到页大小，不超过 mmap_region_size_
+            const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            const size_t region_bytes = mmap_region_size_ & ~(page_size - 1);
+            if (block_bytes > region_bytes) {
+                mmap_failed_ = true;
+                return nullptr;
+            }
+            void *region = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+            // 只有系统预留了大页时才会成功
+            if (region_bytes % kHugePageSize == 0) {
+                region = mmap(nullptr, region_bytes, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            }
+#endif  // defined(MAP_HUGETLB)
+            if (region == MAP_FAILED) {
+                region = mmap(nullptr, region_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (region == MAP_FAILED) {
+                    mmap_failed_ = true;
+                    return nullptr;
+                }
+#if defined(MADV_HUGEPAGE)
+                // 尽力而为：内核不支持透明大页时忽略错误
+                madvise(region, region_bytes, MADV_HUGEPAGE);
+#endif  // defined(MADV_HUGEPAGE)
+            }
+            // MAP_HUGETLB 在映射时就占用整个区域，所以区域在映射时整个计入用量，
+            // 之后从中分出的块不再计入；区域末尾用不上的部分也就不会漏算
+            region_ = static_cast<char *>(region);
+            region_size_ = region_bytes;
+            region_ptr_ = region_;
+            region_bytes_remaining_ = region_bytes;
+            memory_usage_.fetch_add(region_bytes, std::memory_order_relaxed);
+        }
+        char *result = region_ptr_;
+        region_ptr_ += block_bytes;
+        region_bytes_remaining_ -= block_bytes;
+        return result;
+#else
+        (void) block_bytes;
+        mmap_failed_ = true;
+        return nullptr;
+#endif  // HAVE_MMAP
+    }
+
 }  // namespace leveldb
@@ -11,23 +11,52 @@
 #include <cstdint>
 #include <vector>
 
+#include "leveldb/allocator.h"
+#include "port/port.h"
+
 namespace leveldb {
 
-    class Arena {
+    // final，使通过 Arena* 的调用仍是静态调用
+    class Arena final : public Allocator {
     public:
-        Arena();
+        static const size_t kDefaultBlockSize = 4096;
+
+        // Small allocations are carved out of blocks of block_size bytes.
+        //
+        // If mmap_region_size is non-zero, blocks are carved in turn out of a
+        // single region of that many bytes (rounded down to the page size)
+        // mapped with mmap() instead of being allocated with new[].  If the
+        // region is a multiple of 2MB and the system has huge pages reserved,
+        // it uses them (MAP_HUGETLB); otherwise it is marked for transparent
+        // huge pages (MADV_HUGEPAGE).  The whole region is added to
+        // MemoryUsage() when it is mapped.  Once it is used up, and if mmap()
+        // is unavailable or fails, blocks come from new[] as usual, as do
+        // blocks larger than a quarter of the region so that they do not cut
+        // it short.
+        explicit Arena(size_t block_size = kDefaultBlockSize, size_t mmap_region_size = 0);
 
         Arena(const Arena &) = delete;
 
         Arena &operator=(const Arena &) = delete;
 
-        ~Arena();
+        ~Arena() override;
 
         // Return a pointer to a newly allocated memory block of "bytes" bytes.
-        char *Allocate(size_t bytes);
+        char *Allocate(size_t bytes) override;
 
         // Allocate memory with the normal alignment guarantees provided by malloc.
-        char *AllocateAligned(size_t bytes);
+        char *AllocateAligned(size_t bytes) override;
+
+        // Thread-safe versions of Allocate() and AllocateAligned(), for arenas
+        // shared by several inserting threads (concurrent memtable writes).
+        // They must not run at the same time as the unsynchronized versions.
+        //
+        // Each thread allocates from one of several shards, which take blocks
+        // of block_size bytes from the arena, so threads only contend on the
+        // arena when a shard needs a new block.
+        char *AllocateConcurrently(size_t bytes) override;
+
+        char *AllocateAlignedConcurrently(size_t bytes) override;
 
         // Returns an estimate of the total memory usage of data allocated
         // by the arena.
@@ -35,11 +64,35 @@ namespace leveldb {
             return memory_usage_.load(std::memory_order_relaxed);
         }
 
+        // Returns the number of bytes mapped with mmap(), which MemoryUsage()
+        // includes.
+        size_t MappedBytes() const { return region_size_; }
+
     private:
+        // 并发分配的分片，每个分片单独持有一个块
+        struct Shard {
+            Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+
+            port::Mutex mu;
+            char *alloc_ptr;
+            size_t alloc_bytes_remaining;
+            // 让相邻的分片落在不同的缓存行上
+            char padding[64];
+        };
+
         char *AllocateFallback(size_t bytes);
 
+        char *AllocateFromShard(size_t bytes, bool aligned);
+
         char *AllocateNewBlock(size_t block_bytes);
 
+        // Carve block_bytes out of the mmap() region, mapping it on first use.
+        // Returns nullptr if mmap() fails or the region is used up.
+        char *AllocateFromRegion(size_t block_bytes);
+
+        const size_t block_size_;
+        const size_t mmap_region_size_;  // 0 if blocks come from new[]
+
         /** 分配状态 */
         char *alloc_ptr_;
         /** 分配剩余字节数 */
@@ -48,12 +101,27 @@ namespace leveldb {
         /** new [] 个分配的内存块的数组 */
         std::vector<char *> blocks_;
 
+        /** mmap() 映射的区域（起始地址与长度），以及其中尚未分出去的部分 */
+        char *region_;
+        size_t region_size_;
+        char *region_ptr_;
+        size_t region_bytes_remaining_;
+        bool mmap_failed_;  // 一旦 mmap() 失败就不再尝试
+
         /**
          * arena 的总内存使用量
          *
          * TODO(costan): 该成员是通过原子访问的，而其他成员则没有任何锁定地访问。这个可以吗？
          */
         std::atomic<size_t> memory_usage_;
+
+        // Serializes the refills of the shards and the allocations too large
+        // for them.
+        port::Mutex mu_;
+
+        // 分片数量是 2 的幂
+        const size_t shard_mask_;
+        Shard *const shards_;
     };
 
     inline char *Arena::Allocate(size_t bytes) {
@@ -4,6 +4,9 @@
 
 #include "util/arena.h"
 
+#include <cstring>
+#include <thread>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -58,6 +61,97 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, BlockSize) {
+  const size_t kBlockSize = 64 << 10;
+  Arena arena(kBlockSize);
+  arena.Allocate(100);
+  ASSERT_EQ(kBlockSize + sizeof(char*), arena.MemoryUsage());
+  // Stays within the first block
+  arena.Allocate(kBlockSize / 2);
+  ASSERT_EQ(kBlockSize + sizeof(char*), arena.MemoryUsage());
+  // Does not fit, and more than a quarter of a block gets a block of its own
+  arena.Allocate(kBlockSize / 2);
+  ASSERT_EQ(kBlockSize + kBlockSize / 2 + 2 * sizeof(char*),
+            arena.MemoryUsage());
+}
+
+TEST(ArenaTest, MmapRegion) {
+  const size_t kBlockSize = 4096;
+  const size_t kRegionSize = 1 << 20;
+  Arena arena(kBlockSize, kRegionSize);
+  std::vector<std::pair<size_t, char*>> allocated;
+  size_t bytes = 0;
+  Random rnd(301);
+  // Enough to use up the region, plus allocations larger than a region
+  for (int i = 0; bytes < 4 * kRegionSize; i++) {
+    size_t s = rnd.OneIn(1000) ? kRegionSize + rnd.Uniform(kRegionSize)
+                               : 1 + rnd.Uniform(200);
+    char* r = rnd.OneIn(2) ? arena.AllocateAligned(s) : arena.Allocate(s);
+    memset(r, i % 256, s);
+    bytes += s;
+    allocated.push_back(std::make_pair(s, r));
+    ASSERT_GE(arena.MemoryUsage(), bytes);
+    // A single region, counted in full as soon as it is mapped
+    ASSERT_TRUE(arena.MappedBytes() == 0 || arena.MappedBytes() == kRegionSize);
+    ASSERT_LE(arena.MappedBytes(), arena.MemoryUsage());
+    // Blocks from new[] once the region is used up, not another region
+    ASSERT_LE(arena.MemoryUsage(), kRegionSize + bytes * 1.10 + kBlockSize);
+  }
+  for (size_t i = 0; i < allocated.size(); i++) {
+    const char* p = allocated[i].second;
+    for (size_t b = 0; b < allocated[i].first; b++) {
+      ASSERT_EQ(int(p[b]) & 0xff, i % 256);
+    }
+  }
+}
+
+TEST(ArenaTest, MmapRegionRoundedDown) {
+  // The region never exceeds mmap_region_size
+  Arena arena(4096, (1 << 20) + 100);
+  arena.Allocate(100);
+  ASSERT_TRUE(arena.MappedBytes() == 0 || arena.MappedBytes() == (1 << 20));
+  ASSERT_LE(arena.MappedBytes(), arena.MemoryUsage());
+}
+
+TEST(ArenaTest, Concurrent) {
+  const size_t kBlockSize = 4096;
+  const int kThreads = 8;
+  const int kAllocations = 20000;
+  Arena arena(kBlockSize);
+  std::vector<std::vector<std::pair<size_t, char*>>> allocated(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < kAllocations; i++) {
+        // Mostly small allocations, plus some too large for a shard
+        size_t s = rnd.OneIn(1000) ? kBlockSize + rnd.Uniform(kBlockSize)
+                                   : 1 + rnd.Uniform(100);
+        char* r = rnd.OneIn(2) ? arena.AllocateAlignedConcurrently(s)
+                               : arena.AllocateConcurrently(s);
+        memset(r, (t * kAllocations + i) % 256, s);
+        allocated[t].push_back(std::make_pair(s, r));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // No two allocations overlap
+  size_t bytes = 0;
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < kAllocations; i++) {
+      const char* p = allocated[t][i].second;
+      for (size_t b = 0; b < allocated[t][i].first; b++) {
+        ASSERT_EQ(int(p[b]) & 0xff, (t * kAllocations + i) % 256);
+      }
+      bytes += allocated[t][i].first;
+    }
+  }
+  ASSERT_GE(arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -30,6 +30,9 @@ namespace leveldb {
 
     void PutLengthPrefixedSlice(std::string *dst, const Slice &value);
 
+    // Same encoding as PutLengthPrefixedSlice() of the concatenation of the parts
+    void PutLengthPrefixedSliceParts(std::string *dst, const SliceParts &value);
+
 // Standard Get... routines parse a value from the beginning of a Slice
 // and advance the slice past the parsed value.
     bool GetVarint32(Slice *input, uint32_t *value);
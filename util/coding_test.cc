@@ -190,6 +190,19 @@ namespace leveldb {
         ASSERT_EQ("", input.ToString());
     }
 
+    TEST(Coding, SliceParts) {
+        const std::string long_part(200, 'x');
+        const Slice parts[] = {Slice("foo"), Slice(""), Slice(long_part)};
+        std::string s;
+        PutLengthPrefixedSliceParts(&s, SliceParts(parts, 3));
+        PutLengthPrefixedSliceParts(&s, SliceParts());
+
+        std::string expected;
+        PutLengthPrefixedSlice(&expected, "foo" + long_part);
+        PutLengthPrefixedSlice(&expected, Slice());
+        ASSERT_EQ(expected, s);
+    }
+
 }  // namespace leveldb
 
 int main(int argc, char **argv) {
@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <new>
+
+#include "util/arena.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+    namespace {
+
+        // 64-bit words per 64-byte cache line
+        constexpr uint32_t kWordsPerLine = 8;
+        constexpr uint32_t kBitsPerLine = kWordsPerLine * 64;
+        static_assert(kBitsPerLine == 512, "NextProbe() yields 9 bits");
+
+        uint32_t BloomHash(const Slice &key) { return Hash(key.data(), key.size(), 0xbc9f1d34); }
+
+        // Offset of the first word of the cache line that holds the bits of
+        // a key, picked by the high bits of its hash.
+        size_t LineOffset(uint32_t hash, uint32_t num_lines) {
+            return static_cast<size_t>((static_cast<uint64_t>(hash) * num_lines) >> 32) * kWordsPerLine;
+        }
+
+        // Remix the hash and use its top bits as the position of the next
+        // bit within the cache line.
+        uint32_t NextProbe(uint32_t *h) {
+            *h *= 0x9e3779b9;
+            return *h >> (32 - 9);
+        }
+
+    }  // namespace
+
+    DynamicBloom::DynamicBloom(Arena *arena, int bits_per_key, size_t initial_keys)
+            : arena_(arena), bits_per_key_(bits_per_key), num_keys_(0), capacity_(initial_keys) {
+        // Same number of probes as the table filter (see bloom.cc).
+        k_ = static_cast<int>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+        if (k_ < 1) k_ = 1;
+        if (k_ > 30) k_ = 30;
+        newest_.store(NewFilter(initial_keys, false), std::memory_order_relaxed);
+    }
+
+    DynamicBloom::Filter *DynamicBloom::NewFilter(size_t num_keys, bool concurrent) {
+        const size_t bits = num_keys * bits_per_key_;
+        uint32_t num_lines = static_cast<uint32_t>((bits + kBitsPerLine - 1) / kBitsPerLine);
+        if (num_lines == 0) num_lines = 1;
+        // One extra line of room to align the words to a cache line
+        const size_t bytes = sizeof(Filter) + (num_lines + 1) * kWordsPerLine * sizeof(uint64_t);
+        char *mem = concurrent ? arena_->AllocateAlignedConcurrently(bytes) : arena_->AllocateAligned(bytes);
+
+        Filter *filter = new(mem) Filter;
+        filter->num_lines = num_lines;
+        // Start the words at a cache line boundary.
+        uintptr_t words = reinterpret_cast<uintptr_t>(mem + sizeof(Filter));
+        words = (words + 63) & ~static_cast<uintptr_t>(63);
+        filter->words = reinterpret_cast<std::atomic<uint64_t> *>(words);
+        for (uint32_t i = 0; i < num_lines * kWordsPerLine; i++) {
+            new(&filter->words[i]) std::atomic<uint64_t>(0);
+        }
+        filter->older = nullptr;
+        return filter;
+    }
+
+    void DynamicBloom::Grow(size_t num_keys, bool concurrent) {
+        MutexLock l(&grow_mu_);
+        const size_t capacity = capacity_.load(std::memory_order_relaxed);
+        if (num_keys <= capacity) {
+            return;  // Somebody else grew the filter
+        }
+        Filter *filter = NewFilter(capacity, concurrent);
+        filter->older = newest_.load(std::memory_order_relaxed);
+        newest_.store(filter, std::memory_order_release);
+        capacity_.store(2 * capacity, std::memory_order_release);
+    }
+
+    void DynamicBloom::Add(const Slice &key, bool concurrent) {
+        const size_t num_keys = num_keys_.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (num_keys > capacity_.load(std::memory_order_acquire)) {
+            Grow(num_keys, concurrent);
+        }
+        Filter *filter = newest_.load(std::memory_order_acquire);
+
+        uint32_t h = BloomHash(key);
+        std::atomic<uint64_t> *line = filter->words + LineOffset(h, filter->num_lines);
+        for (int j = 0; j < k_; j++) {
+            const uint32_t bitpos = NextProbe(&h);
+            const uint64_t mask = uint64_t{1} << (bitpos % 64);
+            // Skip the read-modify-write when the bit is already set.
+            if ((line[bitpos / 64].load(std::memory_order_relaxed) & mask) == 0) {
+                line[bitpos / 64].fetch_or(mask, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool DynamicBloom::MayContain(const Slice &key) const {
+        const uint32_t hash = BloomHash(key);
+        for (const Filter *filter = newest_.load(std::memory_order_acquire); filter != nullptr;
+             filter = filter->older) {
+            const std::atomic<uint64_t> *line = filter->words + LineOffset(hash, filter->num_lines);
+            uint32_t h = hash;
+            bool match = true;
+            for (int j = 0; j < k_; j++) {
+                const uint32_t bitpos = NextProbe(&h);
+                if ((line[bitpos / 64].load(std::memory_order_relaxed) & (uint64_t{1} << (bitpos % 64))) == 0) {
+                    match = false;
+                    break;
+                }
+            }
+            if (match) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+}  // namespace leveldb
@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+    class Arena;
+
+    // A bloom filter over a set of keys that grows as keys are added, such
+    // as the user keys of a memtable.  It starts with room for initial_keys
+    // keys; whenever the keys added so far fill it up, a filter as large as
+    // all the previous ones together is added.  A key may be present if any
+    // of the filters matches it.  Each filter keeps all the bits of a key
+    // within one 64-byte cache line.
+    //
+    // Memory comes from "*arena", which must outlive the filter.  MayContain()
+    // may run concurrently with Add().  Add() calls made with concurrent ==
+    // true may run concurrently with each other; other Add() calls need
+    // external synchronization, just like Arena::Allocate().
+    class DynamicBloom {
+    public:
+        DynamicBloom(Arena *arena, int bits_per_key, size_t initial_keys = 4096);
+
+        DynamicBloom(const DynamicBloom &) = delete;
+
+        DynamicBloom &operator=(const DynamicBloom &) = delete;
+
+        void Add(const Slice &key, bool concurrent = false);
+
+        bool MayContain(const Slice &key) const;
+
+    private:
+        struct Filter {
+            uint32_t num_lines;
+            std::atomic<uint64_t> *words;  // num_lines cache lines
+            Filter *older;
+        };
+
+        Filter *NewFilter(size_t num_keys, bool concurrent);
+
+        void Grow(size_t num_keys, bool concurrent);
+
+        Arena *const arena_;
+        const int bits_per_key_;
+        int k_;  // Number of probes per key
+        std::atomic<Filter *> newest_;
+        std::atomic<size_t> num_keys_;
+        std::atomic<size_t> capacity_;  // Keys the filters were sized for
+        port::Mutex grow_mu_;           // Serializes Grow()
+    };
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/arena.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+static double FalsePositiveRate(const DynamicBloom& bloom, int first_key) {
+  char buffer[sizeof(int)];
+  int result = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (bloom.MayContain(Key(first_key + i, buffer))) {
+      result++;
+    }
+  }
+  return result / 10000.0;
+}
+
+TEST(DynamicBloomTest, Empty) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 10);
+  ASSERT_TRUE(!bloom.MayContain("hello"));
+  ASSERT_TRUE(!bloom.MayContain("world"));
+}
+
+TEST(DynamicBloomTest, Small) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 10);
+  bloom.Add("hello");
+  bloom.Add("world");
+  ASSERT_TRUE(bloom.MayContain("hello"));
+  ASSERT_TRUE(bloom.MayContain("world"));
+  ASSERT_TRUE(!bloom.MayContain("x"));
+  ASSERT_TRUE(!bloom.MayContain("foo"));
+}
+
+TEST(DynamicBloomTest, Sized) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 10, 10000);
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 10000; i++) {
+    bloom.Add(Key(i, buffer));
+  }
+  for (int i = 0; i < 10000; i++) {
+    ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+  }
+  ASSERT_LE(FalsePositiveRate(bloom, 1000000000), 0.02);
+}
+
+TEST(DynamicBloomTest, Grows) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 10, 100);
+  char buffer[sizeof(int)];
+  int added = 0;
+  for (int length = 100; length <= 100000; length *= 10) {
+    for (; added < length; added++) {
+      bloom.Add(Key(added, buffer));
+    }
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(bloom.MayContain(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+    // Every filter added as the bloom grows adds to the rate
+    ASSERT_LE(FalsePositiveRate(bloom, 1000000000), 0.12) << length;
+  }
+  // About 10 bits per key, plus the unused part of the newest filter
+  ASSERT_LT(arena.MemoryUsage(), 2 * 100000 * 10 / 8 + 16384);
+}
+
+TEST(DynamicBloomTest, ConcurrentAdd) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 10, 64);
+  const int kThreads = 4;
+  const int kKeysPerThread = 20000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&bloom, t]() {
+      char buffer[sizeof(int)];
+      for (int i = t; i < kThreads * kKeysPerThread; i += kThreads) {
+        bloom.Add(Key(i, buffer), true);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kThreads * kKeysPerThread; i++) {
+    ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -20,6 +20,12 @@ namespace leveldb {
         return Status::NotSupported("NewAppendableFile", fname);
     }
 
+    Status Env::ReuseWritableFile(const std::string &fname, const std::string &old_fname,
+                                  WritableFile **result) {
+        *result = nullptr;
+        return Status::NotSupported("ReuseWritableFile", fname);
+    }
+
     Status Env::RemoveDir(const std::string &dirname) { return DeleteDir(dirname); }
 
     Status Env::DeleteDir(const std::string &dirname) { return RemoveDir(dirname); }
@@ -28,6 +34,13 @@ namespace leveldb {
 
     Status Env::DeleteFile(const std::string &fname) { return RemoveFile(fname); }
 
+    void Env::MultiRead(ReadRequest *reqs, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            ReadRequest &req = reqs[i];
+            req.status = req.file->Read(req.offset, req.n, &req.result, req.scratch);
+        }
+    }
+
     SequentialFile::~SequentialFile() = default;
 
     RandomAccessFile::~RandomAccessFile() = default;
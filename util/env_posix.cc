@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -19,6 +20,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <limits>
 #include <queue>
 #include <set>
@@ -58,6 +60,9 @@ namespace leveldb {
         /** 可写文件缓冲区大小 64KB? */
         constexpr const size_t kWritableFileBufferSize = 65536;
 
+        /** 日志文件和表文件每次预分配的空间大小 1MB */
+        constexpr const uint64_t kPreallocationBlockSize = 1024 * 1024;
+
         /** 系统层面的错误 */
         Status PosixError(const std::string &context, int error_number) {
             if (error_number == ENOENT) {
@@ -262,10 +267,19 @@ namespace leveldb {
          */
         class PosixWritableFile final : public WritableFile {
         public:
-            PosixWritableFile(std::string filename, int fd)
+            // If "preallocate" is true, disk space for log and table files is
+            // allocated ahead of the writes.  "initial_size" is the size of the
+            // file when it is opened for writing from its beginning without
+            // being truncated.
+            PosixWritableFile(std::string filename, int fd, bool preallocate = false,
+                              uint64_t initial_size = 0)
                     : pos_(0),
                       fd_(fd),
                       is_manifest_(IsManifest(filename)),
+                      preallocate_(preallocate && IsPreallocated(filename)),
+                      filesize_(0),
+                      initial_size_(initial_size),
+                      preallocated_end_(initial_size),
                       filename_(std::move(filename)),
                       dirname_(Dirname(filename_)) {}
 
@@ -309,6 +323,12 @@ namespace leveldb {
 
             Status Close() override {
                 Status status = FlushBuffer();
+                // 释放文件末尾之后未使用的预分配空间
+                const uint64_t file_end = std::max(filesize_, initial_size_);
+                if (status.ok() && preallocated_end_ > file_end &&
+                    ::ftruncate(fd_, file_end) != 0) {
+                    status = PosixError(filename_, errno);
+                }
                 const int close_result = ::close(fd_);
                 if (close_result < 0 && status.ok()) {
                     status = PosixError(filename_, errno);
@@ -345,6 +365,10 @@ namespace leveldb {
 
             /** 无缓冲数据 */
             Status WriteUnbuffered(const char *data, size_t size) {
+                if (preallocate_ && filesize_ + size > preallocated_end_) {
+                    Preallocate(filesize_ + size);
+                }
+                filesize_ += size;
                 while (size > 0) {
                     ssize_t write_result = ::write(fd_, data, size);
                     if (write_result < 0) {
@@ -359,6 +383,22 @@ namespace leveldb {
                 return Status::OK();
             }
 
+            // 以 kPreallocationBlockSize 为单位为 [preallocated_end_, end) 预分配磁盘空间，
+            // 但不改变文件大小。失败时（例如文件系统不支持）不再预分配，由写操作本身报告错误。
+            void Preallocate(uint64_t end) {
+#if HAVE_FALLOCATE
+                const uint64_t new_end =
+                        (end + kPreallocationBlockSize - 1) / kPreallocationBlockSize * kPreallocationBlockSize;
+                if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(preallocated_end_),
+                                static_cast<off_t>(new_end - preallocated_end_)) == 0) {
+                    preallocated_end_ = new_end;
+                    return;
+                }
+#endif  // HAVE_FALLOCATE
+                (void) end;
+                preallocate_ = false;
+            }
+
             Status SyncDirIfManifest() {
                 Status status;
                 if (!is_manifest_) {
@@ -438,6 +478,15 @@ namespace leveldb {
                 return Basename(filename).starts_with("MANIFEST");
             }
 
+            /** 如果给定文件是日志文件或表文件（值得预分配空间），则为True。 */
+            static bool IsPreallocated(const std::string &filename) {
+                Slice basename = Basename(filename);
+                const size_t n = basename.size();
+                return (n > 4 && (Slice(basename.data() + n - 4, 4) == ".log" ||
+                                  Slice(basename.data() + n - 4, 4) == ".ldb" ||
+                                  Slice(basename.data() + n - 4, 4) == ".sst"));
+            }
+
             // buf_[0, pos_ - 1] contains data to be written to fd_.
             char buf_[kWritableFileBufferSize];
             size_t pos_;
@@ -445,6 +494,10 @@ namespace leveldb {
 
             /** 如果文件名以 MANIFEST 开头，则为True */
             const bool is_manifest_;
+            bool preallocate_;           // 是否为写入预分配空间
+            uint64_t filesize_;          // 已写入（不含缓冲区）的字节数
+            const uint64_t initial_size_;  // 打开时文件的大小
+            uint64_t preallocated_end_;  // 已分配空间的末尾
             const std::string filename_;
             // filename_ 的目录
             const std::string dirname_;
@@ -581,7 +634,33 @@ namespace leveldb {
                     return PosixError(filename, errno);
                 }
 
-                *result = new PosixWritableFile(filename, fd);
+                *result = new PosixWritableFile(filename, fd, true);
+                return Status::OK();
+            }
+
+            Status ReuseWritableFile(const std::string &filename, const std::string &old_filename,
+                                     WritableFile **result) override {
+                if (std::rename(old_filename.c_str(), filename.c_str()) != 0) {
+                    *result = nullptr;
+                    return PosixError(old_filename, errno);
+                }
+
+                // 不截断文件：覆盖已分配好的空间，同步时无需更新文件大小
+                int fd = ::open(filename.c_str(), O_WRONLY | kOpenBaseFlags, 0644);
+                if (fd < 0) {
+                    *result = nullptr;
+                    return PosixError(filename, errno);
+                }
+
+                struct ::stat file_stat;
+                if (::fstat(fd, &file_stat) != 0) {
+                    Status status = PosixError(filename, errno);
+                    ::close(fd);
+                    *result = nullptr;
+                    return status;
+                }
+
+                *result = new PosixWritableFile(filename, fd, true, file_stat.st_size);
                 return Status::OK();
             }
 
@@ -768,9 +847,33 @@ namespace leveldb {
                 std::this_thread::sleep_for(std::chrono::microseconds(micros));
             }
 
+            void MultiRead(ReadRequest *reqs, size_t n) override;
+
         private:
             void BackgroundThreadMain();
 
+            void ReadThreadMain();
+
+            static void ReadThreadEntryPoint(PosixEnv *env) {
+                env->ReadThreadMain();
+            }
+
+            // The reads of a MultiRead() call.  Lives on the stack of the caller,
+            // which waits until every read is done.
+            struct ReadBatch {
+                ReadBatch(ReadRequest *reqs, size_t n, port::Mutex *mu)
+                        : reqs(reqs), n(n), next(0), done(0), done_cv(mu) {}
+
+                ReadRequest *const reqs;
+                const size_t n;
+                size_t next;  // Index of the next read to perform
+                size_t done;  // Number of reads performed
+                port::CondVar done_cv;
+            };
+
+            // Perform read "i" of "batch" with read_mutex_ released.
+            void PerformRead(ReadBatch *batch, size_t i) EXCLUSIVE_LOCKS_REQUIRED(read_mutex_);
+
             static void BackgroundThreadEntryPoint(PosixEnv *env) {
                 env->BackgroundThreadMain();
             }
@@ -796,6 +899,14 @@ namespace leveldb {
             // 背景工作线程队列
             std::queue<BackgroundWorkItem> background_work_queue_ GUARDED_BY(background_work_mutex_);
 
+            // MultiRead() hands its reads to these threads so that they are in
+            // flight together.
+            static constexpr int kReadThreads = 16;
+            port::Mutex read_mutex_;
+            port::CondVar read_work_cv_ GUARDED_BY(read_mutex_);
+            bool started_read_threads_ GUARDED_BY(read_mutex_);
+            std::deque<ReadBatch *> read_queue_ GUARDED_BY(read_mutex_);
+
             PosixLockTable locks_;  // 线程安全的
             Limiter mmap_limiter_;  // 线程安全的
             Limiter fd_limiter_;    // 线程安全的
@@ -827,6 +938,8 @@ namespace leveldb {
     PosixEnv::PosixEnv()
             : background_work_cv_(&background_work_mutex_),
               started_background_thread_(false),
+              read_work_cv_(&read_mutex_),
+              started_read_threads_(false),
               mmap_limiter_(MaxMmaps()),
               fd_limiter_(MaxOpenFiles()) {}
 
@@ -869,6 +982,64 @@ namespace leveldb {
         }
     }
 
+    void PosixEnv::MultiRead(ReadRequest *reqs, size_t n) {
+        if (n <= 1) {
+            Env::MultiRead(reqs, n);
+            return;
+        }
+
+        read_mutex_.Lock();
+        if (!started_read_threads_) {
+            started_read_threads_ = true;
+            for (int i = 0; i < kReadThreads; i++) {
+                std::thread read_thread(PosixEnv::ReadThreadEntryPoint, this);
+                read_thread.detach();
+            }
+        }
+        ReadBatch batch(reqs, n, &read_mutex_);
+        read_queue_.push_back(&batch);
+        read_work_cv_.SignalAll();
+
+        // Perform reads in this thread too rather than just waiting
+        while (batch.next < batch.n) {
+            const size_t i = batch.next++;
+            if (batch.next == batch.n) {
+                read_queue_.erase(std::find(read_queue_.begin(), read_queue_.end(), &batch));
+            }
+            PerformRead(&batch, i);
+        }
+        while (batch.done < batch.n) {
+            batch.done_cv.Wait();
+        }
+        read_mutex_.Unlock();
+    }
+
+    void PosixEnv::ReadThreadMain() {
+        read_mutex_.Lock();
+        while (true) {
+            while (read_queue_.empty()) {
+                read_work_cv_.Wait();
+            }
+            ReadBatch *batch = read_queue_.front();
+            const size_t i = batch->next++;
+            if (batch->next == batch->n) {
+                read_queue_.pop_front();
+            }
+            PerformRead(batch, i);
+        }
+    }
+
+    void PosixEnv::PerformRead(ReadBatch *batch, size_t i) {
+        ReadRequest &req = batch->reqs[i];
+        read_mutex_.Unlock();
+        req.status = req.file->Read(req.offset, req.n, &req.result, req.scratch);
+        read_mutex_.Lock();
+        batch->done++;
+        if (batch->done == batch->n) {
+            batch->done_cv.Signal();
+        }
+    }
+
     namespace {
 
         // Wraps an Env instance whose destructor is never created.
@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include "util/coding.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() = default;
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.UInt64AddOperator"; }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    uint64_t sum = 0;
+    if (existing_value != nullptr) {
+      if (existing_value->size() != sizeof(uint64_t)) {
+        return false;
+      }
+      sum = DecodeFixed64(existing_value->data());
+    }
+    for (const Slice& operand : operands) {
+      if (operand.size() != sizeof(uint64_t)) {
+        return false;
+      }
+      sum += DecodeFixed64(operand.data());
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+};
+
+class StringAppendOperator : public MergeOperator {
+ public:
+  explicit StringAppendOperator(char delimiter) : delimiter_(delimiter) {}
+
+  const char* Name() const override { return "leveldb.StringAppendOperator"; }
+
+  bool FullMerge(const Slice& /*key*/, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    size_t size = existing_value != nullptr ? existing_value->size() : 0;
+    for (const Slice& operand : operands) {
+      size += operand.size() + 1;
+    }
+    new_value->clear();
+    new_value->reserve(size);
+    if (existing_value != nullptr) {
+      new_value->append(existing_value->data(), existing_value->size());
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (i > 0 || existing_value != nullptr) {
+        new_value->push_back(delimiter_);
+      }
+      new_value->append(operands[i].data(), operands[i].size());
+    }
+    return true;
+  }
+
+ private:
+  const char delimiter_;
+};
+
+}  // namespace
+
+const MergeOperator* NewUInt64AddOperator() { return new UInt64AddOperator; }
+
+const MergeOperator* NewStringAppendOperator(char delimiter) {
+  return new StringAppendOperator(delimiter);
+}
+
+}  // namespace leveldb
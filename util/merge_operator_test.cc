@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static std::string Fixed64(uint64_t v) {
+  std::string result;
+  PutFixed64(&result, v);
+  return result;
+}
+
+TEST(MergeOperatorTest, UInt64Add) {
+  std::unique_ptr<const MergeOperator> op(NewUInt64AddOperator());
+  const std::string one = Fixed64(1), two = Fixed64(2);
+  std::string result;
+
+  ASSERT_TRUE(op->FullMerge("k", nullptr, {one, two}, &result));
+  ASSERT_EQ(Fixed64(3), result);
+
+  const std::string base = Fixed64(~uint64_t{0});
+  Slice base_slice(base);
+  ASSERT_TRUE(op->FullMerge("k", &base_slice, {two}, &result));
+  ASSERT_EQ(Fixed64(1), result);  // Wraps around
+
+  ASSERT_TRUE(op->FullMerge("k", &base_slice, {}, &result));
+  ASSERT_EQ(base, result);
+
+  // Malformed operands and values
+  ASSERT_TRUE(!op->FullMerge("k", nullptr, {one, "x"}, &result));
+  Slice bad("short");
+  ASSERT_TRUE(!op->FullMerge("k", &bad, {one}, &result));
+}
+
+TEST(MergeOperatorTest, StringAppend) {
+  std::unique_ptr<const MergeOperator> op(NewStringAppendOperator(','));
+  std::string result;
+
+  ASSERT_TRUE(op->FullMerge("k", nullptr, {"a"}, &result));
+  ASSERT_EQ("a", result);
+  ASSERT_TRUE(op->FullMerge("k", nullptr, {"a", "", "b"}, &result));
+  ASSERT_EQ("a,,b", result);
+
+  Slice base("x");
+  ASSERT_TRUE(op->FullMerge("k", &base, {"a", "b"}, &result));
+  ASSERT_EQ("x,a,b", result);
+
+  Slice empty("");
+  ASSERT_TRUE(op->FullMerge("k", &empty, {"a"}, &result));
+  ASSERT_EQ(",a", result);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/no_destructor.h"
+
+namespace leveldb {
+
+namespace {
+
+struct Entry {
+  Entry() : ptr(nullptr) {}
+  Entry(const Entry& e) : ptr(e.ptr.load(std::memory_order_relaxed)) {}
+
+  std::atomic<void*> ptr;
+};
+
+struct ThreadData;
+
+// Bookkeeping shared by all ThreadLocalPtr instances and all threads.
+struct Registry {
+  port::Mutex mutex;
+  std::vector<ThreadData*> threads GUARDED_BY(mutex);
+  std::vector<ThreadLocalPtr::UnrefHandler> handlers GUARDED_BY(mutex);
+  std::vector<uint32_t> free_ids GUARDED_BY(mutex);
+};
+
+Registry* GetRegistry() {
+  static NoDestructor<Registry> registry;
+  return registry.get();
+}
+
+// The values of one thread, indexed by ThreadLocalPtr id.  Only the owning
+// thread resizes "entries", and only while holding the registry mutex, so
+// other threads may access the entries while they hold that mutex.
+struct ThreadData {
+  ThreadData() {
+    Registry* registry = GetRegistry();
+    MutexLock l(&registry->mutex);
+    registry->threads.push_back(this);
+  }
+
+  ~ThreadData() {
+    // The handlers run while the registry mutex is held so that Scrape()
+    // (and therefore the destruction of the owner of a ThreadLocalPtr)
+    // cannot finish while one of its values is still being released.
+    Registry* registry = GetRegistry();
+    MutexLock l(&registry->mutex);
+    for (size_t id = 0; id < entries.size(); id++) {
+      void* ptr = entries[id].ptr.exchange(nullptr, std::memory_order_acquire);
+      if (ptr != nullptr && registry->handlers[id] != nullptr) {
+        (*registry->handlers[id])(ptr);
+      }
+    }
+    registry->threads.erase(std::find(registry->threads.begin(),
+                                      registry->threads.end(), this));
+  }
+
+  std::atomic<void*>* Slot(uint32_t id) {
+    if (id >= entries.size()) {
+      Registry* registry = GetRegistry();
+      MutexLock l(&registry->mutex);
+      entries.resize(id + 1);
+    }
+    return &entries[id].ptr;
+  }
+
+  std::vector<Entry> entries;
+};
+
+ThreadData* GetThreadData() {
+  static thread_local ThreadData data;
+  return &data;
+}
+
+uint32_t NewId(ThreadLocalPtr::UnrefHandler handler) {
+  Registry* registry = GetRegistry();
+  MutexLock l(&registry->mutex);
+  uint32_t id;
+  if (registry->free_ids.empty()) {
+    id = static_cast<uint32_t>(registry->handlers.size());
+    registry->handlers.push_back(handler);
+  } else {
+    id = registry->free_ids.back();
+    registry->free_ids.pop_back();
+    registry->handlers[id] = handler;
+  }
+  return id;
+}
+
+}  // namespace
+
+ThreadLocalPtr::ThreadLocalPtr(UnrefHandler handler) : id_(NewId(handler)) {}
+
+ThreadLocalPtr::~ThreadLocalPtr() {
+  Registry* registry = GetRegistry();
+  MutexLock l(&registry->mutex);
+  for (ThreadData* t : registry->threads) {
+    if (id_ < t->entries.size()) {
+      t->entries[id_].ptr.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+  registry->handlers[id_] = nullptr;
+  registry->free_ids.push_back(id_);
+}
+
+void* ThreadLocalPtr::Get() const {
+  ThreadData* t = GetThreadData();
+  if (id_ >= t->entries.size()) {
+    return nullptr;
+  }
+  return t->entries[id_].ptr.load(std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Reset(void* ptr) {
+  GetThreadData()->Slot(id_)->store(ptr, std::memory_order_release);
+}
+
+void* ThreadLocalPtr::Swap(void* ptr) {
+  return GetThreadData()->Slot(id_)->exchange(ptr, std::memory_order_acq_rel);
+}
+
+bool ThreadLocalPtr::CompareAndSwap(void* ptr, void** expected) {
+  return GetThreadData()->Slot(id_)->compare_exchange_strong(
+      *expected, ptr, std::memory_order_acq_rel, std::memory_order_acquire);
+}
+
+void ThreadLocalPtr::Scrape(std::vector<void*>* ptrs, void* replacement) {
+  Registry* registry = GetRegistry();
+  MutexLock l(&registry->mutex);
+  for (ThreadData* t : registry->threads) {
+    if (id_ < t->entries.size()) {
+      void* ptr =
+          t->entries[id_].ptr.exchange(replacement, std::memory_order_acq_rel);
+      if (ptr != nullptr) {
+        ptrs->push_back(ptr);
+      }
+    }
+  }
+}
+
+}  // namespace leveldb
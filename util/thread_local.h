@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace leveldb {
+
+// A pointer with a separate value for every thread, which unlike a
+// thread_local variable can be a member of an object.  Each thread reads
+// and writes its own value without locking; Scrape() lets another thread
+// collect the values of all threads, e.g. to release what they cache.
+//
+// Typical usage:
+//
+//   ThreadLocalPtr cached(&ReleaseCachedState);
+//   State* state = static_cast<State*>(cached.Swap(nullptr));
+//   ... use and replace state ...
+//   cached.Reset(state);
+class ThreadLocalPtr {
+ public:
+  // Called with the non-null value of a thread when that thread exits.
+  typedef void (*UnrefHandler)(void* ptr);
+
+  explicit ThreadLocalPtr(UnrefHandler handler = nullptr);
+
+  ThreadLocalPtr(const ThreadLocalPtr&) = delete;
+  ThreadLocalPtr& operator=(const ThreadLocalPtr&) = delete;
+
+  // Forgets the values of all threads without calling the handler on them.
+  ~ThreadLocalPtr();
+
+  // Return the value of the calling thread, initially nullptr.
+  void* Get() const;
+
+  // Set the value of the calling thread.
+  void Reset(void* ptr);
+
+  // Set the value of the calling thread and return its previous value.
+  void* Swap(void* ptr);
+
+  // Set the value of the calling thread to "ptr" if it is "*expected", and
+  // return true.  Otherwise store the value in "*expected" and return false.
+  bool CompareAndSwap(void* ptr, void** expected);
+
+  // Replace the value of every thread with "replacement", and append the
+  // non-null values that were replaced to "*ptrs".
+  void Scrape(std::vector<void*>* ptrs, void* replacement);
+
+ private:
+  const uint32_t id_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_LOCAL_H_
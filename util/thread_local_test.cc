@@ -0,0 +1,150 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_local.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+std::atomic<int> unref_calls(0);
+
+void CountUnref(void* ptr) {
+  unref_calls.fetch_add(1);
+  static_cast<std::atomic<int>*>(ptr)->fetch_add(1);
+}
+
+}  // namespace
+
+TEST(ThreadLocalTest, SingleThread) {
+  ThreadLocalPtr tls;
+  int a, b;
+  ASSERT_EQ(nullptr, tls.Get());
+  tls.Reset(&a);
+  ASSERT_EQ(&a, tls.Get());
+  ASSERT_EQ(&a, tls.Swap(&b));
+  ASSERT_EQ(&b, tls.Get());
+
+  void* expected = &a;
+  ASSERT_TRUE(!tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(&b, expected);
+  ASSERT_TRUE(tls.CompareAndSwap(nullptr, &expected));
+  ASSERT_EQ(nullptr, tls.Get());
+}
+
+TEST(ThreadLocalTest, Instances) {
+  ThreadLocalPtr tls1, tls2;
+  int a, b;
+  tls1.Reset(&a);
+  tls2.Reset(&b);
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(&b, tls2.Get());
+
+  // A new instance may reuse the id of a destroyed one, but not its values.
+  {
+    ThreadLocalPtr tls3;
+    tls3.Reset(&a);
+  }
+  ThreadLocalPtr tls4;
+  ASSERT_EQ(nullptr, tls4.Get());
+  ASSERT_EQ(&a, tls1.Get());
+  ASSERT_EQ(&b, tls2.Get());
+}
+
+TEST(ThreadLocalTest, ValuesArePerThread) {
+  ThreadLocalPtr tls;
+  int a, b;
+  tls.Reset(&a);
+  std::thread t([&]() {
+    ASSERT_EQ(nullptr, tls.Get());
+    tls.Reset(&b);
+    ASSERT_EQ(&b, tls.Get());
+    tls.Reset(nullptr);
+  });
+  t.join();
+  ASSERT_EQ(&a, tls.Get());
+}
+
+TEST(ThreadLocalTest, UnrefOnThreadExit) {
+  ThreadLocalPtr tls(&CountUnref);
+  std::atomic<int> released(0);
+  unref_calls.store(0);
+
+  const int kThreads = 8;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&]() { tls.Reset(&released); });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(kThreads, released.load());
+  ASSERT_EQ(kThreads, unref_calls.load());
+
+  // Threads that leave no value behind are not reported.
+  std::thread t([&]() {
+    tls.Reset(&released);
+    tls.Reset(nullptr);
+  });
+  t.join();
+  ASSERT_EQ(kThreads, unref_calls.load());
+}
+
+TEST(ThreadLocalTest, Scrape) {
+  ThreadLocalPtr tls(&CountUnref);
+  std::atomic<int> released(0);
+  unref_calls.store(0);
+  int values[4];
+  int replacement;
+
+  // Keep the threads alive until their values have been scraped.
+  const int kThreads = 4;
+  std::atomic<int> ready(0);
+  std::atomic<bool> scraped(false);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+      tls.Reset(&values[i]);
+      ready.fetch_add(1);
+      while (!scraped.load()) {
+        std::this_thread::yield();
+      }
+      ASSERT_EQ(&replacement, tls.Get());
+      tls.Reset(&released);
+    });
+  }
+  while (ready.load() < kThreads) {
+    std::this_thread::yield();
+  }
+  tls.Reset(&replacement);
+
+  std::vector<void*> ptrs;
+  tls.Scrape(&ptrs, &replacement);
+  scraped.store(true);
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  // The value of this thread was "replacement" already.
+  ASSERT_EQ(kThreads + 1, ptrs.size());
+  for (int i = 0; i < kThreads; i++) {
+    ASSERT_NE(ptrs.end(), std::find(ptrs.begin(), ptrs.end(), &values[i]));
+  }
+  ASSERT_EQ(kThreads, released.load());
+  ASSERT_EQ(&replacement, tls.Get());
+  tls.Reset(nullptr);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}